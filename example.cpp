@@ -44,6 +44,7 @@
  */
 
 #include <string>
+#include <cstdlib>
 #include <sstream>
 #include <fstream>
 #include <iostream>
@@ -60,9 +61,17 @@ int main(int argc, char* argv[])
    cout << "G#2G: CNC G# macro-code converter to plain G-Code" << endl;
    cout << " Using libgsharp ver " << r.GetVersionStr() << "" << endl;
    cout << " More info at https://github.com/nrsoft/gsharp" << endl << endl;
+
+   // translate the program into C++ instead of running it?
+   bool emit_cpp = (argc > 1 && string(argv[1]) == "--emit-cpp");
+   if(emit_cpp){
+      --argc;
+      ++argv;
+   }
    if(argc < 3){
       cout << "Usage: " << endl;
-      cout << " g#2g <input_file> <output_file>" << endl << endl;
+      cout << " g#2g <input_file> <output_file> [threads (0: one per core)]" << endl;
+      cout << " g#2g --emit-cpp <input_file> <output_cpp_file> [class_name]" << endl << endl;
       return 1;
    }
 
@@ -95,34 +104,47 @@ int main(int argc, char* argv[])
       return 1;
    }
 
-   // run interpreter
-   string str;
-   gsharp::ExtraInfo extra;
-   try{
-      while(r.Step(str, extra)){
-         // record next G-Code line
-         if(!str.empty()){
-            file_out << str << endl;
-            //cout << "(" << r.GetCurrentLineNumber() << "): " << str << endl; // console check
-         }
-         // any messages to display?
-         gsharp::ExtraInfo::Type t;
-         while(extra.FirstNonEmpty(&t)){
-            switch(t){
-               case gsharp::ExtraInfo::PRN:
-                  cout << "PRN";
-                  break;
-               case gsharp::ExtraInfo::DBG:
-                  cout << "DBG";
-                  break;
-               case gsharp::ExtraInfo::LOG:
-                  cout << "LOG";
-                  break;
-               default:
-                  cout << "MSG";
-            }
-            cout << ": " << extra.Retrieve(t) << endl;
+   // C++ class with the same output, compiled with "gsharp_runtime.h"
+   if(emit_cpp){
+      r.EmitCpp(file_out, (argc > 3)? argv[3]: "GSharpProgram");
+      return 0;
+   }
+
+   auto output = [&](const string& str, gsharp::ExtraInfo& extra){
+      // record next G-Code line
+      if(!str.empty()){
+         file_out << str << '\n';
+         //cout << "(" << r.GetCurrentLineNumber() << "): " << str << endl; // console check
+      }
+      // any messages to display?
+      gsharp::ExtraInfo::Type t;
+      while(extra.FirstNonEmpty(&t)){
+         switch(t){
+            case gsharp::ExtraInfo::PRN:
+               cout << "PRN";
+               break;
+            case gsharp::ExtraInfo::DBG:
+               cout << "DBG";
+               break;
+            case gsharp::ExtraInfo::LOG:
+               cout << "LOG";
+               break;
+            default:
+               cout << "MSG";
          }
+         cout << ": " << extra.Retrieve(t) << endl;
+      }
+   };
+
+   // run interpreter step by step, or with [threads] (0: one per core) independent parts in parallel
+   try{
+      if(argc > 3)
+         r.Run(output, atoi(argv[3]));
+      else{
+         string str;
+         gsharp::ExtraInfo extra;
+         while(r.Step(str, extra))
+            output(str, extra);
       }
    }
    catch(exception& e){
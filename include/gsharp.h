@@ -36,14 +36,15 @@
  *      and RS274/NGC (https://www.nist.gov/customcf/get_pdf.cfm?pub_id=823374)
  *
  *  The major differences to the above standards:
- *   - does NOT support <named_parameters> and correspondingly no EXIST[] funcion
  *   - all numbered parameters are volatile (TODO: make some of them persistent, as required)
  *   - two '%' demarcation lines can appear anywhere in the program,
  *      first % line marks the start, second - stop of the execution
  *   - O-subs can be located anywhere in the code: they are executed only if called and
  *      jumped over in all other cases
  *   - O-call can NOT be issued to a subroutine located in a separate file
- *   - O-endsub and O-return can return a value, but it will be stored in parameter #5000
+ *   - O-endsub and O-return store the returned value in parameter #5000 as well as in #<_value>
+ *   - the sign '-' (or '+') can precede any operand of the expression, not only the numbers:
+ *      [-#1], [-[#1 + 1]], [2 * -sin[30]]; it belongs to the operand, so [-#1 ** 2] is [[-#1] ** 2]
  *   - comments can be anywhere in any line (except for % lines: only after % character),
  *   - comments can contain pairs of brackets "()", but not a non-matched single bracket
  *   - (PROBE*) comments are ignored as not relevant (should be managed by the machine control system)
@@ -52,7 +53,13 @@
 #define GSHARP_H_INCLUDED
 
 #include <string>
+#include <iosfwd>
+#include <functional>
 #include "gsharp_extra.h"
+#include "gsharp_number.h"
+#include "gsharp_memory.h"
+#include "gsharp_native.h"
+#include "gsharp_modal.h"
 
 
 namespace gsharp
@@ -74,12 +81,22 @@ namespace gsharp
 // The error string contains the current line number in the brackets and the description
 // Load() and Step() functions must be wrapped into the try-catch block
 //
+// The parameters and the expressions are calculated in <Number> type (see "gsharp_number.h"):
+//  Interpreter uses double, BasicInterpreter<float> and BasicInterpreter<Fixed> are for
+//  the controllers with single-precision FPU or without FPU
+//
+// The loaded program is kept in the arena, which takes the memory from <upstream> resource
+//  (the heap by default) and gives all of it back at once on the next Load() (see "gsharp_memory.h")
+//
 
-class Interpreter
+template<class Number> class BasicExpression;
+
+template<class Number>
+class BasicInterpreter
 {
 public:
-   Interpreter();
-   virtual ~Interpreter();
+   explicit BasicInterpreter(MemoryResource* upstream=nullptr);
+   virtual ~BasicInterpreter();
 
    // current library version
    const char* GetVersionStr() const;
@@ -94,12 +111,45 @@ public:
    // extra messages can be present at any step, even if return is true and the line is empty
    bool Step(std::string& line, ExtraInfo& extra);
 
+   // run the rest of the program at once: same as calling Step() until it returns false,
+   //  every step is passed to <handler> in the same order (GetCurrentLineNumber() is valid there)
+   // independent parts of the program are interpreted in parallel by <threads> workers (0 = one per core)
+   void Run(const std::function<void(const std::string&, ExtraInfo&)>& handler, unsigned int threads=1);
+
    // to be able to restart program execution again, global parameters remain untouched
    void Rewind();
 
    // reset global parameters to zero
    void Clear();
 
+   // save the complete state of the execution (between the steps), e.g. to repeat the part of the job later
+   // the parameters are shared with the interpreter until they are changed, so the state is cheap to keep
+   // the states belong to the loaded program: Load() releases all of them
+   unsigned int Checkpoint();
+
+   // continue the execution from the saved state, which stays for the next Restore()
+   void Restore(unsigned int checkpoint);
+   void ReleaseCheckpoint(unsigned int checkpoint);
+
+   // restart the job in the middle: run the program from the start (same as Rewind()) up to the output
+   //  line <line> (1-based), or up to the <occurrence> of the source line, which is run by the next Step()
+   // the seek to the output line stops right after the line <line>-1, so the steps with only the messages
+   //  in between (e.g. the comment before the line) come first, the messages of the lines before are dropped
+   // the skipped lines are not formatted, false: the program has finished before
+   bool SeekToOutputLine(size_t line);
+   bool SeekToSourceLine(unsigned int line, unsigned int occurrence=1);
+
+   // modal words and positions of the lines skipped by the last seek (see "gsharp_modal.h")
+   const ModalState& GetModalState() const;
+
+   // keep the last steps (up to <bytes> of memory, 0 disables it, the default) to go back by StepBack()
+   // the repeated loops and the calls are executed as usual while it's enabled, they are not replayed
+   void SetJournalSize(size_t bytes);
+
+   // go back <steps> steps, so the next Step() produces the same line again: one by one for the kept steps,
+   //  otherwise from the nearest of the few states saved on the way and on to the line silently
+   void StepBack(size_t steps);
+
    // call to enable g-code 'block delete' feature (default = disabled)
    void EnableBlockDelete(bool enable=true);
 
@@ -109,12 +159,45 @@ public:
    // call to enable generating output in uppercase, otherwise lowercase (default = enabled)
    void EnableConvertToUpper(bool enable=true);
 
+   // call to enable compiling small subroutines into the calling lines (default = enabled)
+   // takes effect on the next Load, disable it for debugging
+   void EnableInlineSubs(bool enable=true);
+
    // assign value to specific parameter (can be called between steps e.g. for debugging)
+   // the value is converted to <Number> and back in GetParam()
    void SetParam(unsigned int number, double value);
 
    // retrieve the current value of specific parameter (e.g. for debging)
    double GetParam(unsigned int number) const;
 
+   // max depth of subroutine calls (default = 1000)
+   // the memory is reserved here or by Load() of the program with the calls, not during the steps
+   void SetStackDepth(std::size_t levels);
+
+   // number of subroutine calls to remember (default = 64, 0 to disable)
+   // the output of subs, which depend only on their arguments, is reused for the same arguments
+   void SetSubCacheSize(std::size_t calls);
+
+   // host function, called from the expressions as <name>[arg1][arg2].. (e.g. lookup table interpolation)
+   // the name (letters only) is resolved when the program is loaded, so register the functions before Load()
+   // the result must depend only on the arguments: the calls may be calculated once and reused,
+   //  with several threads of Run() the function is called concurrently
+   // std::exception thrown by the function is reported as an error of the current line
+   typedef std::function<Number(const Number* args)> NativeFunction;
+   void RegisterFunction(const std::string& name, unsigned int arity, const NativeFunction& function);
+
+   // host implementation of sub <number>: 'o<number> call [..]' of the next loaded program runs <handler> instead
+   // the handler gets the arguments, reads and writes the parameters and gives the lines (see "gsharp_native.h"),
+   //  which are produced by the next steps one at a time, same as the lines of the interpreted sub
+   // std::exception thrown by the handler is reported as an error of the 'call' line, empty <handler> removes it
+   typedef std::function<void(NativeCall<Number>& call)> SubHandler;
+   void RegisterSub(unsigned int number, const SubHandler& handler);
+
+   // write the loaded program as C++ class <name>, which produces the same lines without the interpreter
+   // the class is compiled with "gsharp_runtime.h" header, see "g#2g --emit-cpp"
+   // the programs with named parameters, native functions or subs are not supported
+   void EmitCpp(std::ostream& out, const std::string& name) const;
+
    // retrieve the source line
    const std::string GetSourceLine(unsigned int num) const;
 
@@ -123,8 +206,50 @@ public:
 
 private:
    void* _interpreter; // implementation
+   friend class BasicExpression<Number>;
 };
 
+typedef BasicInterpreter<double> Interpreter;
+
+
+// Expression of the host application (e.g. the feed from the chip load), compiled once and evaluated
+//  over the parameters of the interpreter as many times as needed:
+//
+//  Expression rpm(interp, "[#1 * 1000 / [3.1416 * #2]]");
+//  double value = rpm.Evaluate();
+//
+// The operations and the functions are the same as in the program (incl. the registered ones),
+//  the named parameters are not supported. The expression stays valid after Load() of the next program,
+//  but the interpreter must outlive it. The errors are thrown the same way as by the interpreter.
+template<class Number>
+class BasicExpression
+{
+public:
+   BasicExpression(BasicInterpreter<Number>& interp, const std::string& text);
+   virtual ~BasicExpression();
+
+   // the value for the current parameters, doesn't allocate memory
+   double Evaluate() const;
+
+   // the values for <rows> sets of the parameters: <numbers>[<count>] take the next <count> values
+   //  of <values> for every evaluation, the results go to <results>[<rows>]
+   // the parameters have the same values after the call as before, the memory to keep them is reused
+   void Evaluate(const unsigned int* numbers, std::size_t count, const double* values, std::size_t rows,
+                 double* results) const;
+
+   // the text of the expression as given
+   const std::string& GetText() const;
+
+private:
+   BasicExpression(const BasicExpression&);
+   BasicExpression& operator=(const BasicExpression&);
+
+   void* _interpreter; // implementation of the bound interpreter
+   void* _expression; // compiled
+};
+
+typedef BasicExpression<double> Expression;
+
 } // namespace
 
 #endif // GSHARP_H_INCLUDED
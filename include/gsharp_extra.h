@@ -72,6 +72,15 @@ public:
          for(string& m: _msg) m.clear();
    }
 
+   /////////  R e s e r v e  ////////
+   // memory for the messages, so the shorter ones don't allocate
+   inline void Reserve(size_t size)
+   {
+      for(string& m: _msg)
+         if(m.capacity() < size) m.reserve(size);
+      if(_output.capacity() < size) _output.reserve(size);
+   }
+
    ///////  F i r s t  N o n  E m p t y  ///////
    inline bool FirstNonEmpty(Type* type = nullptr) const
    {
@@ -0,0 +1,147 @@
+/*
+ *  Copyright 2016, Night Road Software (https://github.com/nrsoft)
+ *  All rights reserved.
+ *  
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are
+ *  met:
+ *  
+ *      * Redistributions of source code must retain the above copyright
+ *  notice, this list of conditions and the following disclaimer.
+ *      * Redistributions in binary form must reproduce the above
+ *  copyright notice, this list of conditions and the following disclaimer
+ *  in the documentation and/or other materials provided with the
+ *  distribution.
+ *      * Neither the name of "Night Road Software" nor the names of its
+ *  contributors may be used to endorse or promote products derived from
+ *  this software without specific prior written permission.
+ *  
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *  *********************************************************************
+ *
+ *  Memory of the loaded program, see BasicInterpreter in "gsharp.h"
+ *
+ *  MemoryResource:  source of memory, same idea as std::pmr::memory_resource (C++17)
+ *  MonotonicArena:  takes the memory from the upstream resource in big chunks and
+ *                   gives it back all at once, when the next program is loaded
+ *  ArenaAllocator:  standard allocator over the resource, for the containers
+ *
+ *  Null resource everywhere means the global heap (operator new/delete)
+ */
+#ifndef GSHARP_MEMORY_H_INCLUDED
+#define GSHARP_MEMORY_H_INCLUDED
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+
+namespace gsharp
+{
+
+/////////  class  M e m o r y R e s o u r c e  ////////
+class MemoryResource
+{
+public:
+   virtual ~MemoryResource() {}
+
+   virtual void* Allocate(std::size_t bytes, std::size_t alignment) = 0;
+   virtual void Deallocate(void* ptr, std::size_t bytes, std::size_t alignment) = 0;
+};
+
+
+/////////  class  M o n o t o n i c A r e n a  ////////
+// hands out the memory of the chunks one after another, Deallocate() does nothing
+// the first chunk is taken by the first Allocate(), every next one is twice as big
+// (a first chunk sized by Release() is an estimate, the next ones start from <chunk_size>)
+// Release() gives all of them back to the upstream
+class MonotonicArena: public MemoryResource
+{
+public:
+   const static std::size_t DEFAULT_CHUNK_SIZE = 16 * 1024; // the first chunk
+
+   explicit MonotonicArena(MemoryResource* upstream=nullptr, std::size_t chunk_size=DEFAULT_CHUNK_SIZE);
+   MonotonicArena(const MonotonicArena& other); // empty, with the same upstream
+   MonotonicArena& operator=(const MonotonicArena&) {return *this;} // keeps its own memory
+   virtual ~MonotonicArena() {Release();}
+
+   virtual void* Allocate(std::size_t bytes, std::size_t alignment);
+   virtual void Deallocate(void*, std::size_t, std::size_t) {}
+
+   void Release(std::size_t first_chunk=0); // the size of the next first chunk (0: <chunk_size> of the constructor)
+   inline std::size_t Size() const {return _size;} // taken from the upstream
+
+private:
+   struct Chunk
+   {
+      Chunk* next;
+      std::size_t size; // incl. this header
+   };
+
+   MemoryResource* _upstream;
+   std::size_t _chunk_size;
+   std::size_t _next_size;
+   std::size_t _first_size; // 0: <_next_size>
+   Chunk* _chunks; // the last one first
+   char* _current; // free memory of the last chunk
+   std::size_t _left;
+   std::size_t _size;
+};
+
+
+/////////  class  A r e n a A l l o c a t o r  ////////
+// the copy of the container goes to the heap (like std::pmr::polymorphic_allocator goes to the default resource),
+//  swap exchanges the resources, so the emptied container can be given to the arena
+template<class T>
+class ArenaAllocator
+{
+public:
+   typedef T value_type;
+   typedef std::false_type propagate_on_container_copy_assignment;
+   typedef std::false_type propagate_on_container_move_assignment;
+   typedef std::true_type propagate_on_container_swap;
+   template<class U> struct rebind {typedef ArenaAllocator<U> other;};
+
+   ArenaAllocator(MemoryResource* resource=nullptr) noexcept: _resource(resource) {}
+   template<class U>
+   ArenaAllocator(const ArenaAllocator<U>& other) noexcept: _resource(other.Resource()) {}
+
+   inline T* allocate(std::size_t n)
+   {
+      return static_cast<T*>((_resource != nullptr)? _resource->Allocate(n * sizeof(T), alignof(T)):
+                                                     ::operator new(n * sizeof(T)));
+   }
+
+   inline void deallocate(T* ptr, std::size_t n) noexcept
+   {
+      if(_resource != nullptr)
+         _resource->Deallocate(ptr, n * sizeof(T), alignof(T));
+      else
+         ::operator delete(ptr);
+   }
+
+   inline ArenaAllocator select_on_container_copy_construction() const {return ArenaAllocator();}
+   inline MemoryResource* Resource() const {return _resource;}
+
+private:
+   MemoryResource* _resource;
+};
+
+template<class T, class U>
+inline bool operator==(const ArenaAllocator<T>& lhs, const ArenaAllocator<U>& rhs) {return lhs.Resource() == rhs.Resource();}
+template<class T, class U>
+inline bool operator!=(const ArenaAllocator<T>& lhs, const ArenaAllocator<U>& rhs) {return lhs.Resource() != rhs.Resource();}
+
+} // namespace gsharp
+
+#endif // GSHARP_MEMORY_H_INCLUDED
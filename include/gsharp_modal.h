@@ -0,0 +1,261 @@
+/*
+ *  Copyright 2016, Night Road Software (https://github.com/nrsoft)
+ *  All rights reserved.
+ *  
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are
+ *  met:
+ *  
+ *      * Redistributions of source code must retain the above copyright
+ *  notice, this list of conditions and the following disclaimer.
+ *      * Redistributions in binary form must reproduce the above
+ *  copyright notice, this list of conditions and the following disclaimer
+ *  in the documentation and/or other materials provided with the
+ *  distribution.
+ *      * Neither the name of "Night Road Software" nor the names of its
+ *  contributors may be used to endorse or promote products derived from
+ *  this software without specific prior written permission.
+ *  
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *  *********************************************************************
+ *
+ *  Modal state of the machine after the output lines, see SeekToOutputLine() in "gsharp.h"
+ *
+ *  ModalState:  the last words of the modal groups and the positions of the axes,
+ *               the host builds the preamble from them to continue the job
+ *               in the middle of the program
+ */
+#ifndef GSHARP_MODAL_H_INCLUDED
+#define GSHARP_MODAL_H_INCLUDED
+
+#include <string>
+#include <cstdlib>
+#include <cmath>
+#include "gsharp_number.h"
+
+namespace gsharp
+{
+
+/////////  class  M o d a l S t a t e  ////////
+// the words are kept as they were output, but in uppercase (e.g. "G1", "G38.2", "F200"), empty: not output yet
+// the positions are in the current units and the coordinate system, the increments of G91 are added up
+// the axis words of G10, G28, G30, G53 and G92 lines are not the positions, they are ignored
+class ModalState
+{
+public:
+   // the order of the groups is the order of the words in the preamble
+   enum Group: unsigned int {UNITS=0, PLANE, DISTANCE, ARC_DISTANCE, FEED_MODE, CUTTER_COMP, TOOL_LENGTH,
+                             COORDINATE_SYSTEM, PATH_CONTROL, RETRACT, TOOL, SPEED, SPINDLE, COOLANT, FEED,
+                             MOTION, TOTAL_GROUPS};
+   enum Axis: unsigned int {X=0, Y, Z, A, B, C, U, V, W, TOTAL_AXES};
+
+   std::string words[TOTAL_GROUPS];
+   double position[TOTAL_AXES];
+   bool known[TOTAL_AXES]; // the axis has been in the output
+
+   ModalState() {Reset();}
+
+   /////////  R e s e t  ////////
+   inline void Reset()
+   {
+      for(auto& word: words)
+         word.clear();
+      for(unsigned int i=0; i<TOTAL_AXES; ++i){
+         position[i] = 0.0;
+         known[i] = false;
+      }
+      Discard();
+      _incremental = _mist = _flood = false;
+   }
+
+   /////////  W o r d  ////////
+   // the word of the next Update(), which is not in its' text: <letter> in lowercase, <value> is output
+   //  with <precision> digits after the point (negative: as it is)
+   // false: the word has to be in the text (the modal words, except the axes, are kept as they are output)
+   inline bool Word(char letter, double value, int precision)
+   {
+      static const char* axis_letters = "xyzabcuvw";
+      for(unsigned int i=0; i<TOTAL_AXES; ++i){
+         if(letter == axis_letters[i]){
+            if(precision >= 0 && precision < 16){
+               double scale = 1.0;
+               for(int k=0; k<precision; ++k)
+                  scale *= 10.0;
+               value = std::round(value * scale) / scale;
+            }
+            _axes[i] = value;
+            _given[i] = true;
+            return true;
+         }
+      }
+      switch(letter){
+         case 'd': case 'h': case 'i': case 'j': case 'k': case 'l': case 'p': case 'q': case 'r':
+            return true; // not tracked
+      }
+      return false;
+   }
+
+   /////////  D i s c a r d  ////////
+   // the words given for the next Update() are not g-code (e.g. the values of the message)
+   inline void Discard()
+   {
+      for(auto& given: _given)
+         given = false;
+   }
+
+   /////////  U p d a t e  ////////
+   // the output line in any case, with or without the spaces between the words
+   inline void Update(const std::string& line)
+   {
+      bool positions = true;
+      const char* p = line.c_str();
+      while(*p != '\0' && *p != ';'){
+         char letter = *p++;
+         if(letter == '('){ // comment
+            while(*p != '\0' && *p != ')')
+               ++p;
+            continue;
+         }
+         if(letter >= 'A' && letter <= 'Z')
+            letter += 'a' - 'A';
+         if(letter < 'a' || letter > 'z')
+            continue;
+         while(*p == ' ' || *p == '\t')
+            ++p;
+         char text[32]; // the number
+         size_t len = 0;
+         if(*p == '-' || *p == '+')
+            text[len++] = *p++;
+         while(len < sizeof(text) - 1 && ((*p >= '0' && *p <= '9') || *p == '.'))
+            text[len++] = *p++;
+         text[len] = '\0';
+         if(len == 0 || (len == 1 && (text[0] == '-' || text[0] == '+')))
+            continue;
+         double value = ParseDecimal(text, nullptr, std::strtod);
+
+         static const char* axis_letters = "xyzabcuvw";
+         for(unsigned int i=0; i<TOTAL_AXES; ++i){
+            if(letter == axis_letters[i]){
+               _axes[i] = value;
+               _given[i] = true;
+            }
+         }
+         if(letter == 'g')
+            positions = _GCode(std::lround(value * 10.0), text) && positions;
+         else if(letter == 'm')
+            _MCode(std::lround(value), text);
+         else if(letter == 't')
+            _Assign(TOOL, 'T', text);
+         else if(letter == 's')
+            _Assign(SPEED, 'S', text);
+         else if(letter == 'f')
+            _Assign(FEED, 'F', text);
+      }
+      // G90 and G91 of the same line apply to its' axes
+      for(unsigned int i=0; positions && i<TOTAL_AXES; ++i){
+         if(_given[i]){
+            position[i] = _incremental? position[i] + _axes[i]: _axes[i];
+            known[i] = true;
+         }
+      }
+      Discard();
+   }
+
+   /////////  P r e a m b l e  ////////
+   // all known words in one line, e.g. "G21 G17 G90 G94 G40 G49 G54 T1 S1000 M3 M8 F200 G1"
+   inline std::string Preamble() const
+   {
+      std::string line;
+      for(const auto& word: words){
+         if(!word.empty())
+            line += (line.empty()? "": " ") + word;
+      }
+      return line;
+   }
+
+private:
+   // <code> is the number of the word multiplied by 10 (e.g. 382 for G38.2)
+   // false: the axis words of the line are not the positions
+   inline bool _GCode(long code, const char* text)
+   {
+      switch(code){
+         case 0: case 10: case 20: case 30: case 330: case 382: case 383: case 384: case 385:
+         case 730: case 760: case 800: case 810: case 820: case 830: case 840: case 850:
+         case 860: case 870: case 880: case 890:
+            _Assign(MOTION, 'G', text);
+            break;
+         case 170: case 171: case 180: case 181: case 190: case 191:
+            _Assign(PLANE, 'G', text);
+            break;
+         case 900: case 910:
+            _incremental = (code == 910);
+            _Assign(DISTANCE, 'G', text);
+            break;
+         case 901: case 911:
+            _Assign(ARC_DISTANCE, 'G', text);
+            break;
+         case 930: case 940: case 950:
+            _Assign(FEED_MODE, 'G', text);
+            break;
+         case 200: case 210:
+            _Assign(UNITS, 'G', text);
+            break;
+         case 400: case 410: case 411: case 420: case 421:
+            _Assign(CUTTER_COMP, 'G', text);
+            break;
+         case 430: case 431: case 432: case 490:
+            _Assign(TOOL_LENGTH, 'G', text);
+            break;
+         case 540: case 550: case 560: case 570: case 580: case 590: case 591: case 592: case 593:
+            _Assign(COORDINATE_SYSTEM, 'G', text);
+            break;
+         case 610: case 611: case 640:
+            _Assign(PATH_CONTROL, 'G', text);
+            break;
+         case 980: case 990:
+            _Assign(RETRACT, 'G', text);
+            break;
+         case 100: case 280: case 281: case 300: case 301: case 530: case 920: case 921: case 922: case 923:
+            return false;
+      }
+      return true;
+   }
+
+   inline void _MCode(long code, const char* text)
+   {
+      if(code >= 3 && code <= 5)
+         _Assign(SPINDLE, 'M', text);
+      else if(code >= 7 && code <= 9){
+         _mist = (code == 7) || (_mist && code == 8);
+         _flood = (code == 8) || (_flood && code == 7);
+         words[COOLANT] = (_mist && _flood)? "M7 M8": _mist? "M7": _flood? "M8": "M9";
+      }
+   }
+
+   inline void _Assign(Group group, char letter, const char* text)
+   {
+      words[group] = letter;
+      words[group] += text;
+   }
+
+   double _axes[TOTAL_AXES]; // of the line being updated
+   bool _given[TOTAL_AXES];
+   bool _incremental; // G91
+   bool _mist; // M7
+   bool _flood; // M8
+};
+
+} // namespace gsharp
+
+#endif // GSHARP_MODAL_H_INCLUDED
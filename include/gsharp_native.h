@@ -0,0 +1,72 @@
+/*
+ *  Copyright 2016, Night Road Software (https://github.com/nrsoft)
+ *  All rights reserved.
+ *  
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are
+ *  met:
+ *  
+ *      * Redistributions of source code must retain the above copyright
+ *  notice, this list of conditions and the following disclaimer.
+ *      * Redistributions in binary form must reproduce the above
+ *  copyright notice, this list of conditions and the following disclaimer
+ *  in the documentation and/or other materials provided with the
+ *  distribution.
+ *      * Neither the name of "Night Road Software" nor the names of its
+ *  contributors may be used to endorse or promote products derived from
+ *  this software without specific prior written permission.
+ *  
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *  *********************************************************************
+ *
+ *  Subroutines implemented by the host, see RegisterSub() in "gsharp.h"
+ *
+ *  NativeCall:  the call of the sub as seen by its' handler: the arguments,
+ *               the parameters and the output lines, which are produced by Step()
+ *               one at a time after the handler returns
+ */
+#ifndef GSHARP_NATIVE_H_INCLUDED
+#define GSHARP_NATIVE_H_INCLUDED
+
+#include <string>
+#include "gsharp_extra.h"
+
+namespace gsharp
+{
+
+/////////  class  N a t i v e C a l l  ////////
+// the arguments are also the local parameters #1.. of the sub, all local parameters are restored after the call
+template<class Number>
+class NativeCall
+{
+public:
+   virtual ~NativeCall() {}
+
+   virtual unsigned int Arguments() const = 0; // number of the arguments in the 'call' line
+   virtual Number Argument(unsigned int index) const = 0; // 0-based, zero if not given
+
+   virtual double GetParam(unsigned int number) const = 0;
+   virtual void SetParam(unsigned int number, double value) = 0;
+
+   // the next g-code line (formatted as the plain lines of the program), the messages go with the next line
+   // the messages after the last line are produced on their own
+   virtual void Output(const std::string& line) = 0;
+   virtual void Message(ExtraInfo::Type type, const std::string& text) = 0;
+
+   virtual void Return(Number value) = 0; // to #5000 and #<_value>, same as 'endsub [value]'
+};
+
+} // namespace gsharp
+
+#endif // GSHARP_NATIVE_H_INCLUDED
@@ -0,0 +1,272 @@
+/*
+ *  Copyright 2016, Night Road Software (https://github.com/nrsoft)
+ *  All rights reserved.
+ *  
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are
+ *  met:
+ *  
+ *      * Redistributions of source code must retain the above copyright
+ *  notice, this list of conditions and the following disclaimer.
+ *      * Redistributions in binary form must reproduce the above
+ *  copyright notice, this list of conditions and the following disclaimer
+ *  in the documentation and/or other materials provided with the
+ *  distribution.
+ *      * Neither the name of "Night Road Software" nor the names of its
+ *  contributors may be used to endorse or promote products derived from
+ *  this software without specific prior written permission.
+ *  
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *  *********************************************************************
+ *
+ *  Numeric types of the parameters and the expressions, see BasicInterpreter in "gsharp.h"
+ *
+ *  double:  default, same as LinuxCNC
+ *  float:   for the controllers with single-precision FPU
+ *  Fixed:   32.32 fixed point, for the controllers without FPU
+ *
+ *  The functions of the expressions have the same semantics for all types:
+ *   - angles are in degrees (RS274/NGC)
+ *   - MOD is fmod(): the result has the sign of the dividend
+ *   - ** is pow(): negative base requires integer exponent, otherwise the result is NaN
+ *   - EQ and NE compare with the absolute tolerance 0.0001 (LinuxCNC)
+ *  Fixed doesn't have infinity: the results saturate at +/-2^31 (and printed as inf),
+ *   invalid operations (0/0, ln of negative, etc.) produce NaN
+ */
+#ifndef GSHARP_NUMBER_H_INCLUDED
+#define GSHARP_NUMBER_H_INCLUDED
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <cstring>
+#include <clocale>
+#include <limits>
+#include <string>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+namespace gsharp
+{
+
+/////////  class  F i x e d  ////////
+// 32.32 fixed point number, all operations are integer
+class Fixed
+{
+public:
+   const static int FRACTION_BITS = 32;
+   const static int64_t ONE = INT64_C(1) << FRACTION_BITS;
+   const static int64_t MAX_RAW = INT64_MAX; // overflow saturates here
+   const static int64_t NAN_RAW = INT64_MIN; // not a number (the range is symmetric without it)
+
+   Fixed(): _raw(0) {}
+   explicit Fixed(int value): _raw(static_cast<int64_t>(value) * ONE) {}
+   explicit Fixed(double value);
+   explicit operator double() const;
+
+   static inline Fixed FromRaw(int64_t raw) {Fixed f; f._raw = raw; return f;}
+   inline int64_t Raw() const {return _raw;}
+   inline bool IsNan() const {return _raw == NAN_RAW;}
+
+   inline Fixed operator-() const {return FromRaw(IsNan()? NAN_RAW: -_raw);}
+   inline Fixed operator+(Fixed rhs) const
+   {
+      if(IsNan() || rhs.IsNan())
+         return FromRaw(NAN_RAW);
+      if(rhs._raw > 0 && _raw > MAX_RAW - rhs._raw)
+         return FromRaw(MAX_RAW);
+      if(rhs._raw < 0 && _raw < -MAX_RAW - rhs._raw)
+         return FromRaw(-MAX_RAW);
+      return FromRaw(_raw + rhs._raw);
+   }
+   inline Fixed operator-(Fixed rhs) const {return *this + (-rhs);}
+   Fixed operator*(Fixed rhs) const;
+   Fixed operator/(Fixed rhs) const;
+
+   // NaN is not equal to anything, same as IEEE
+   inline bool operator==(Fixed rhs) const {return _raw == rhs._raw && !IsNan();}
+   inline bool operator!=(Fixed rhs) const {return !(*this == rhs);}
+   inline bool operator<(Fixed rhs) const {return _raw < rhs._raw && !IsNan() && !rhs.IsNan();}
+   inline bool operator<=(Fixed rhs) const {return _raw <= rhs._raw && !IsNan() && !rhs.IsNan();}
+   inline bool operator>(Fixed rhs) const {return rhs < *this;}
+   inline bool operator>=(Fixed rhs) const {return rhs <= *this;}
+
+protected:
+   int64_t _raw;
+};
+
+
+/////////  D e c i m a l  ////////
+// "%.*f" and strtod() with the decimal point '.', whatever LC_NUMERIC of the process is (e.g. ',' in de_DE)
+
+// the integer digits go first and the <precision> fraction digits last, the rest is the point of the locale
+inline int PrintDecimal(double value, int precision, char* buf, size_t size)
+{
+   int len = snprintf(buf, size, "%.*f", precision, value);
+   if(precision <= 0 || len <= precision || static_cast<size_t>(len) >= size || !std::isfinite(value))
+      return len;
+   char* point = buf + ((buf[0] == '-')? 1: 0);
+   while('0' <= *point && *point <= '9')
+      ++point;
+   char* fraction = buf + len - precision;
+   if(point == fraction) // no point at all
+      return len;
+   *point = '.';
+   if(fraction > point + 1){ // several bytes (e.g. UTF-8 of the locale)
+      memmove(point + 1, fraction, precision + 1);
+      len -= static_cast<int>(fraction - point - 1);
+   }
+   return len;
+}
+
+// the number is copied with the point of the locale, <convert> is strtod() or strtof()
+template<class Float>
+Float ParseDecimal(const char* str, char** end, Float (*convert)(const char*, char**))
+{
+   const char* locale_point = localeconv()->decimal_point;
+   if(locale_point[0] == '.' && locale_point[1] == '\0')
+      return convert(str, end);
+
+   // [spaces] [sign] digits [. digits] [e [sign] digits], the rest (inf, nan) doesn't have the point
+   const char* p = str;
+   while(*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r' || *p == '\f' || *p == '\v')
+      ++p;
+   if(*p == '+' || *p == '-')
+      ++p;
+   const char* digits = p;
+   while('0' <= *p && *p <= '9')
+      ++p;
+   const char* point = p;
+   if(*p == '.'){
+      ++p;
+      while('0' <= *p && *p <= '9')
+         ++p;
+   }
+   if(point == digits && p <= point + 1) // no digits
+      return convert(str, end);
+   if(*p == 'e' || *p == 'E'){
+      const char* e = p + 1;
+      if(*e == '+' || *e == '-')
+         ++e;
+      while('0' <= *e && *e <= '9')
+         p = ++e;
+   }
+
+   std::string copy(str, point);
+   size_t shift = 0;
+   if(*point == '.'){
+      copy += locale_point;
+      copy.append(point + 1, p);
+      shift = strlen(locale_point) - 1;
+   }
+   char* copy_end;
+   Float value = convert(copy.c_str(), &copy_end);
+   if(end){
+      size_t len = copy_end - copy.c_str();
+      *end = const_cast<char*>(str) + ((len > static_cast<size_t>(point - str))? len - shift: len);
+   }
+   return value;
+}
+
+
+/////////  N u m e r i c  ////////
+// the functions of the expressions for the numeric type
+template<class Number> struct Numeric;
+
+// double and float: standard library
+template<class Float>
+struct FloatNumeric
+{
+   static inline Float FromDouble(double value) {return static_cast<Float>(value);}
+   static inline double ToDouble(Float value) {return value;}
+   static inline Float Tolerance() {return static_cast<Float>(0.0001);}
+   static inline bool IsNan(Float value) {return value != value;}
+   static inline bool IsNegativeZero(Float value) {return value == 0 && std::signbit(value);}
+   static inline bool IsHuge(Float value) {return value == std::numeric_limits<Float>::infinity();}
+   static inline size_t Index(Float value) {return static_cast<size_t>(std::round(value));} // of the parameter
+
+   static inline Float Abs(Float arg) {return std::fabs(arg);}
+   static inline Float Round(Float arg) {return std::round(arg);}
+   static inline Float Floor(Float arg) {return std::floor(arg);}
+   static inline Float Ceil(Float arg) {return std::ceil(arg);}
+   static inline Float Sqrt(Float arg) {return std::sqrt(arg);}
+   static inline Float Exp(Float arg) {return std::exp(arg);}
+   static inline Float Ln(Float arg) {return std::log(arg);}
+   static inline Float Mod(Float lhs, Float rhs) {return std::fmod(lhs, rhs);}
+   static inline Float Pow(Float lhs, Float rhs) {return std::pow(lhs, rhs);}
+   // degrees
+   static inline Float Sin(Float arg) {return std::sin(arg * static_cast<Float>(M_PI) / 180);}
+   static inline Float Cos(Float arg) {return std::cos(arg * static_cast<Float>(M_PI) / 180);}
+   static inline Float Tan(Float arg) {return std::tan(arg * static_cast<Float>(M_PI) / 180);}
+   static inline Float Asin(Float arg) {return std::asin(arg) * 180 / static_cast<Float>(M_PI);}
+   static inline Float Acos(Float arg) {return std::acos(arg) * 180 / static_cast<Float>(M_PI);}
+   static inline Float Atan(Float y, Float x) {return std::atan2(y, x) * 180 / static_cast<Float>(M_PI);}
+
+   // fixed notation, same as "%.*f" in the "C" locale (returns the length)
+   static inline int Print(Float value, int precision, char* buf, size_t size)
+   {
+      return PrintDecimal(static_cast<double>(value), precision, buf, size);
+   }
+};
+
+template<> struct Numeric<double>: FloatNumeric<double>
+{
+   static inline double Parse(const char* str, char** end) {return ParseDecimal(str, end, std::strtod);}
+};
+
+template<> struct Numeric<float>: FloatNumeric<float>
+{
+   static inline float Parse(const char* str, char** end) {return ParseDecimal(str, end, std::strtof);}
+};
+
+// fixed point: integer approximations (see gsharp_number.cpp)
+template<> struct Numeric<Fixed>
+{
+   static inline Fixed FromDouble(double value) {return Fixed(value);}
+   static inline double ToDouble(Fixed value) {return static_cast<double>(value);}
+   static inline Fixed Tolerance() {return Fixed::FromRaw(429497);} // 0.0001
+   static inline bool IsNan(Fixed value) {return value.IsNan();}
+   static inline bool IsNegativeZero(Fixed) {return false;}
+   static inline bool IsHuge(Fixed value) {return value.Raw() == Fixed::MAX_RAW;}
+   static inline size_t Index(Fixed value) {return static_cast<size_t>((value.Raw() + Fixed::ONE / 2) >> Fixed::FRACTION_BITS);}
+
+   static inline Fixed Abs(Fixed arg) {return (arg.Raw() < 0 && !arg.IsNan())? -arg: arg;}
+   static Fixed Round(Fixed arg);
+   static Fixed Floor(Fixed arg);
+   static Fixed Ceil(Fixed arg);
+   static Fixed Sqrt(Fixed arg);
+   static Fixed Exp(Fixed arg);
+   static Fixed Ln(Fixed arg);
+   static Fixed Mod(Fixed lhs, Fixed rhs);
+   static Fixed Pow(Fixed lhs, Fixed rhs);
+   // degrees
+   static Fixed Sin(Fixed arg);
+   static Fixed Cos(Fixed arg);
+   static Fixed Tan(Fixed arg);
+   static Fixed Asin(Fixed arg);
+   static Fixed Acos(Fixed arg);
+   static Fixed Atan(Fixed y, Fixed x);
+
+   // fixed notation, same as "%.*f" of the exact value in the "C" locale (returns the length)
+   static int Print(Fixed value, int precision, char* buf, size_t size);
+   // decimal number, same as strtod() in the "C" locale
+   static Fixed Parse(const char* str, char** end);
+};
+
+} // namespace gsharp
+
+#endif // GSHARP_NUMBER_H_INCLUDED
@@ -0,0 +1,438 @@
+/*
+ *  Copyright 2016, Night Road Software (https://github.com/nrsoft)
+ *  All rights reserved.
+ *  
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are
+ *  met:
+ *  
+ *      * Redistributions of source code must retain the above copyright
+ *  notice, this list of conditions and the following disclaimer.
+ *      * Redistributions in binary form must reproduce the above
+ *  copyright notice, this list of conditions and the following disclaimer
+ *  in the documentation and/or other materials provided with the
+ *  distribution.
+ *      * Neither the name of "Night Road Software" nor the names of its
+ *  contributors may be used to endorse or promote products derived from
+ *  this software without specific prior written permission.
+ *  
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *  *********************************************************************
+ *
+ *  Runtime for the C++ code emitted from G# programs (see "gs2g --emit-cpp")
+ *
+ *  The emitted class derives from runtime::Machine and implements _Run() only,
+ *   everything else (parameters, sub calls, output format) is here.
+ *  The behaviour must match the interpreter: Step() produces the same lines and messages.
+ *
+ */
+#ifndef GSHARP_RUNTIME_H_INCLUDED
+#define GSHARP_RUNTIME_H_INCLUDED
+
+#include <cmath>
+#include <cstdio>
+#include <cstdarg>
+#include <cstdlib>
+#include <array>
+#include <vector>
+#include <string>
+#include <fstream>
+#include <iostream>
+#include <exception>
+#include "gsharp_extra.h"
+#include "gsharp_number.h"
+
+namespace gsharp
+{
+namespace runtime
+{
+
+/////////  class  E r r o r  ////////
+// same text as the interpreter errors: line number in the brackets and the description
+class Error: public std::exception
+{
+public:
+   explicit Error(const std::string& text): _text(text) {}
+   virtual const char* what() const noexcept {return _text.c_str();}
+
+protected:
+   std::string _text;
+};
+
+
+/////////  class  M a c h i n e  ////////
+class Machine
+{
+public:
+   const static size_t TOTAL_CNC_PARAMETERS = 5602;
+   const static size_t TOTAL_LOCAL_PARAMETERS = 30;
+   const static size_t TOTAL_PARAMETERS = TOTAL_CNC_PARAMETERS + 50; // incl. internal ones
+   const static size_t DEFAULT_STACK_LEVELS = 1000;
+   const static size_t RETURN_VALUE_PARAMETER = 5000;
+
+public:
+   // <start>, <end>: the first and the last instruction, <blocks>: number of o-blocks
+   Machine(size_t start, size_t end, size_t blocks): _start(start), _end(end), _run_times(blocks, 0)
+   {
+      _params.fill(0);
+      _block_delete = false;
+      _format_pretty = true;
+      _convert_to_upper = true;
+      SetStackDepth(DEFAULT_STACK_LEVELS);
+      Rewind();
+   }
+   virtual ~Machine() {}
+
+   bool Step(std::string& line, ExtraInfo& extra)
+   {
+      extra.Clear();
+      _output.clear();
+      _pending.clear();
+      return _Run(line, extra);
+   }
+
+   void Rewind()
+   {
+      _pc = _start;
+      _line = 0;
+      _locals.fill(0);
+      _frames.clear();
+      _frame_values.clear();
+      _output.clear();
+      _pending.clear();
+   }
+
+   void Clear() {_params.fill(0);}
+
+   void EnableBlockDelete(bool enable=true) {_block_delete = enable;}
+   void EnablePrettyFormat(bool enable=true) {_format_pretty = enable; _FormatPlainLines();}
+   void EnableConvertToUpper(bool enable=true) {_convert_to_upper = enable; _FormatPlainLines();}
+
+   void SetParam(unsigned int number, double value)
+   {
+      if(number == 0 || number > TOTAL_CNC_PARAMETERS)
+         _Throw("Attempt to set unexisting parameter #%d", number);
+      if(number <= TOTAL_LOCAL_PARAMETERS){
+         unsigned int bit = 1u << (number-1);
+         if(!_frames.empty() && (_frames.back().saved & bit) == 0){ // must be restored after return anyway
+            Frame& frame = _frames.back();
+            size_t pos = frame.values;
+            for(unsigned int b=1; b<bit; b<<=1)
+               if(frame.saved & b)
+                  ++pos;
+            _frame_values.insert(_frame_values.begin() + pos, _locals[number-1]);
+            frame.saved |= bit;
+         }
+         _locals[number-1] = value;
+      }
+      else
+         _params[number-1] = value;
+   }
+
+   double GetParam(unsigned int number) const
+   {
+      if(number == 0 || number > TOTAL_CNC_PARAMETERS)
+         _Throw("Attempt to read unexisting parameter #%d", number);
+      return (number <= TOTAL_LOCAL_PARAMETERS)? _locals[number-1]: _params[number-1];
+   }
+
+   void SetStackDepth(size_t levels)
+   {
+      if(levels < _frames.size())
+         _Throw("Stack depth %d is less than the current one", static_cast<int>(levels));
+      _stack_depth = levels;
+      _frames.reserve(levels);
+      _frame_values.reserve(levels * TOTAL_LOCAL_PARAMETERS);
+   }
+
+   unsigned int GetCurrentLineNumber() const {return _line;}
+
+protected:
+   // result of the part of the emitted code
+   enum Status {LINE_READY, PROGRAM_END, DISPATCH}; // DISPATCH: continue with the part containing _pc
+
+   typedef struct
+   {
+      size_t return_pc;
+      unsigned int saved; // local parameters (bits, #1 is the lowest)
+      size_t values; // position of the first saved value
+   } Frame;
+
+   // executes the emitted code from _pc until the next line is ready
+   virtual bool _Run(std::string& line, ExtraInfo& extra) = 0;
+
+   [[noreturn]] void _Throw(const char* fmt, ...) const
+   {
+      va_list args, args2;
+      va_start(args, fmt);
+      va_copy(args2, args);
+      std::vector<char> buf(16 + vsnprintf(NULL, 0, fmt, args));
+      va_end(args);
+      int written = snprintf(buf.data(), 16, "(%d): ", _line);
+      vsnprintf(buf.data() + written, buf.size() - written, fmt, args2);
+      va_end(args2);
+      throw Error(buf.data());
+   }
+
+   // parameter <index> (computed), unwinds one reference
+   double _Param(double index) const
+   {
+      size_t idx = static_cast<size_t>(round(index));
+      if(idx == 0 || idx > TOTAL_PARAMETERS)
+         _Throw("Parameter #%d does not exist", static_cast<int>(idx));
+      return (idx <= TOTAL_LOCAL_PARAMETERS)? _locals[idx-1]: _params[idx-1];
+   }
+
+   // parameter to assign: <index> has <nref> references to unwind
+   double& _Target(double index, unsigned int nref)
+   {
+      size_t idx = 0;
+      for(; nref > 0; --nref){
+         idx = static_cast<size_t>(round(index));
+         if(idx == 0 || idx > TOTAL_PARAMETERS)
+            _Throw("Parameter #%d does not exist", static_cast<int>(idx));
+         if(nref > 1)
+            index = (idx <= TOTAL_LOCAL_PARAMETERS)? _locals[idx-1]: _params[idx-1];
+      }
+      return (idx <= TOTAL_LOCAL_PARAMETERS)? _locals[idx-1]: _params[idx-1];
+   }
+
+   // functions of the expressions (angles in degrees, RS274/NGC)
+   double _Acos(double arg) const
+   {
+      if(arg < -1.0 || arg > 1.0)
+         _Throw("Out of range ACOS argument");
+      return acos(arg) * 180 / M_PI;
+   }
+   double _Asin(double arg) const
+   {
+      if(arg < -1.0 || arg > 1.0)
+         _Throw("Out of range ASIN argument");
+      return asin(arg) * 180 / M_PI;
+   }
+   double _Sqrt(double arg) const
+   {
+      if(arg < 0.0)
+         _Throw("Negative SQRT argument");
+      return sqrt(arg);
+   }
+   double _Exp(double arg) const
+   {
+      double result = exp(arg);
+      if(result == HUGE_VAL)
+         _Throw("EXP argument is too big");
+      return result;
+   }
+   static double _Atan(double y, double x) {return atan2(y, x) * 180 / M_PI;}
+   static double _Cos(double arg) {return cos(arg * M_PI / 180);}
+   static double _Sin(double arg) {return sin(arg * M_PI / 180);}
+   static double _Tan(double arg) {return tan(arg * M_PI / 180);}
+   static double _Bool(bool value) {return value? 1.0: 0.0;}
+
+   // the value is appended to the output with <precision>, without trailing zeros
+   void _Value(double value, int precision)
+   {
+      if(value == -0.0) value = 0.0;
+      char buf[400];
+      int len = PrintDecimal(value, precision, buf, sizeof(buf));
+      if(len >= static_cast<int>(sizeof(buf)))
+         len = sizeof(buf) - 1;
+      while(len > 0 && buf[len-1] == '0')
+         --len;
+      if(len > 0 && buf[len-1] == '.')
+         --len;
+      if(len == 0)
+         _output += '0';
+      else
+         _output.append(buf, len);
+   }
+
+   // the output which follows is the value to assign
+   void _Assign()
+   {
+      _output += '#';
+      _pending.push_back(_output.size());
+   }
+
+   // the value of the pending assignment <i>, read back from the output
+   double _Pending(size_t i)
+   {
+      const char* start = _output.c_str() + _pending[i];
+      if(*start == '\0' || ((*start < '0' || *start > '9') && *start != '.' && *start != '-'))
+         _Throw("Error in the value to assign");
+      char* last_ptr;
+      double value = ParseDecimal(start, &last_ptr, strtod);
+      _lengths.resize(i + 1);
+      _lengths[i] = last_ptr - start;
+      return value;
+   }
+
+   // all pending assignments are done, remove them from the output
+   void _Commit()
+   {
+      for(size_t i=_pending.size(); i>0; --i)
+         _output.erase(_pending[i-1] - 1, _lengths[i-1] + 1);
+      _pending.clear();
+   }
+
+   void _Message(ExtraInfo& extra, unsigned int type)
+   {
+      extra.Assign(static_cast<ExtraInfo::Type>(type), _output);
+      _output.clear();
+   }
+
+   // the line is ready, unless it's empty and there are no messages
+   bool _Output(std::string& line, const ExtraInfo& extra, size_t next)
+   {
+      _pc = (_output.compare(0, 2, "m2") == 0 || _output.compare(0, 3, "m30") == 0)? _end: next;
+      _FormatPretty(_output);
+      if(_output.empty() && !extra.FirstNonEmpty())
+         return false;
+      line.swap(_output);
+      _output.clear();
+      return true;
+   }
+
+   // plain lines are formatted in advance
+   void _AddPlain(const char* text)
+   {
+      _plain.push_back(text);
+      _formatted.push_back(text);
+      _FormatPretty(_formatted.back());
+   }
+
+   void _CheckStack(unsigned int number) const
+   {
+      if(_frames.size() >= _stack_depth)
+         _Throw("Stack overflow calling sub %d", number);
+   }
+
+   void _PushFrame(size_t return_pc, unsigned int locals)
+   {
+      Frame frame = {return_pc, locals, _frame_values.size()};
+      for(unsigned int i=0; locals != 0; ++i, locals >>= 1)
+         if(locals & 1)
+            _frame_values.push_back(_locals[i]);
+      _frames.push_back(frame);
+   }
+
+   void _PopFrame(unsigned int number)
+   {
+      if(_frames.empty())
+         _Throw("Stack underrun returning form sub %d", number);
+      const Frame& frame = _frames.back();
+      size_t pos = frame.values;
+      unsigned int saved = frame.saved;
+      for(unsigned int i=0; saved != 0; ++i, saved >>= 1)
+         if(saved & 1)
+            _locals[i] = _frame_values[pos++];
+      _frame_values.resize(frame.values);
+      _pc = frame.return_pc;
+      _frames.pop_back();
+   }
+
+   void _FormatPretty(std::string& line) const
+   {
+      if(_format_pretty)
+         for(size_t i=1; i<line.size(); ++i)
+            if(line[i-1] >= '0' && line[i-1] <= '9' && ((line[i] >= 'a' && line[i] <= 'z') || (line[i] >= 'A' && line[i] <= 'Z')))
+               line.insert(i, 1, ' ');
+      if(_convert_to_upper)
+         for(auto& c: line)
+            if(c >= 'a' && c <= 'z')
+               c = static_cast<char>(c - 'a' + 'A');
+   }
+
+   void _FormatPlainLines()
+   {
+      for(size_t i=0; i<_plain.size(); ++i){
+         _formatted[i] = _plain[i];
+         _FormatPretty(_formatted[i]);
+      }
+   }
+
+protected:
+   size_t _pc; // next instruction of the emitted code
+   size_t _start; // the first instruction after rewind
+   size_t _end; // the end of the program (after m2 or m30)
+   unsigned int _line; // the last used source line
+
+   std::array<double, TOTAL_PARAMETERS> _params; // #1-#30 are not used here
+   std::array<double, TOTAL_LOCAL_PARAMETERS> _locals;
+   std::array<double, TOTAL_LOCAL_PARAMETERS> _saved_locals; // during the inlined call
+   std::vector<int> _run_times; // of the o-blocks: loop counters, 'if' conditions
+
+   std::vector<Frame> _frames;
+   std::vector<double> _frame_values;
+   size_t _stack_depth;
+
+   std::string _output;
+   std::vector<size_t> _pending; // positions of the values to assign in the output
+   std::vector<size_t> _lengths; // of these values
+   std::vector<std::string> _plain, _formatted;
+
+   bool _block_delete;
+   bool _format_pretty;
+   bool _convert_to_upper;
+};
+
+
+/////////  M a i n  /////////
+// stand-alone converter, same as gs2g: <output_file> [#<number>=<value> ...]
+template<class Program>
+int Main(int argc, char* argv[])
+{
+   if(argc < 2){
+      std::cout << "Usage: " << argv[0] << " <output_file> [#<number>=<value> ...]" << std::endl;
+      return 1;
+   }
+   Program program;
+   std::ofstream file_out(argv[1], std::ofstream::out);
+   if(!file_out.good()){
+      std::cout << "Cannot create file: " << argv[1] << std::endl;
+      return 1;
+   }
+   std::string str;
+   ExtraInfo extra;
+   try{
+      for(int i=2; i<argc; ++i){
+         char* value = nullptr;
+         unsigned long number = (argv[i][0] == '#')? strtoul(argv[i] + 1, &value, 10): 0;
+         if(value == nullptr || *value != '='){
+            std::cout << "Wrong parameter: " << argv[i] << std::endl;
+            return 1;
+         }
+         program.SetParam(static_cast<unsigned int>(number), ParseDecimal(value + 1, nullptr, strtod));
+      }
+      while(program.Step(str, extra)){
+         if(!str.empty())
+            file_out << str << '\n';
+         ExtraInfo::Type t;
+         while(extra.FirstNonEmpty(&t)){
+            const char* names[] = {"MSG", "PRN", "DBG", "LOG"};
+            std::cout << names[t] << ": " << extra.Retrieve(t) << std::endl;
+         }
+      }
+   }
+   catch(std::exception& e){
+      std::cout << "Interpreter error: " << e.what() << std::endl << std::endl;
+      return 1;
+   }
+   return 0;
+}
+
+} // namespace runtime
+} // namespace gsharp
+
+#endif // GSHARP_RUNTIME_H_INCLUDED
@@ -12,17 +12,33 @@ DEFINES += GSHARP_LIBRARY
 INCLUDEPATH += ../include
 
 SOURCES += gsharp.cpp\
+	gsharp_checkpoint.cpp\
+	gsharp_compiler.cpp\
+	gsharp_emitter.cpp\
+	gsharp_journal.cpp\
+	gsharp_memory.cpp\
+	gsharp_native.cpp\
+	gsharp_number.cpp\
 	gsharp_parser.cpp\
-	gsharp_program.cpp
+	gsharp_parallel.cpp\
+	gsharp_program.cpp\
+	gsharp_seek.cpp
 
 HEADERS += gsharp_except.h\
+        gsharp_params.h\
         gsharp_program.h\
         version.h\
         ../include/gsharp.h\
-        ../include/gsharp_extra.h
+        ../include/gsharp_extra.h\
+        ../include/gsharp_memory.h\
+        ../include/gsharp_modal.h\
+        ../include/gsharp_native.h\
+        ../include/gsharp_number.h\
+        ../include/gsharp_runtime.h
 
 unix {
     target.path = /usr/lib
     INSTALLS += target
     CONFIG   += c++11
+    LIBS     += -lpthread
 }
@@ -37,25 +37,29 @@
 using namespace gsharp;
 
 
-Interpreter::Interpreter()
+template<class Number>
+BasicInterpreter<Number>::BasicInterpreter(MemoryResource* upstream)
 {
-   _interpreter = new Program;
+   _interpreter = new BasicProgram<Number>(upstream);
 }
 
 
-Interpreter::~Interpreter()
+template<class Number>
+BasicInterpreter<Number>::~BasicInterpreter()
 {
-   delete (Program*)_interpreter;
+   delete (BasicProgram<Number>*)_interpreter;
 }
 
 
-const char* Interpreter::GetVersionStr() const
+template<class Number>
+const char* BasicInterpreter<Number>::GetVersionStr() const
 {
    return GSHARP_FULLVERSION_STRING;
 }
 
 
-void Interpreter::GetVersion(int& major, int& minor, int& build, int& rev) const
+template<class Number>
+void BasicInterpreter<Number>::GetVersion(int& major, int& minor, int& build, int& rev) const
 {
    major = GSHARP_MAJOR;
    minor = GSHARP_MINOR;
@@ -64,72 +68,255 @@ void Interpreter::GetVersion(int& major, int& minor, int& build, int& rev) const
 }
 
 
-void Interpreter::Load(const string& code)
+template<class Number>
+void BasicInterpreter<Number>::Load(const string& code)
 {
-   try{ ((Program*)_interpreter)->Load(code); }
+   try{ ((BasicProgram<Number>*)_interpreter)->Load(code); }
    catch(ErrorMsg& err){ throw err; }
 }
 
 
-bool Interpreter::Step(string& line, ExtraInfo& extra)
+template<class Number>
+bool BasicInterpreter<Number>::Step(string& line, ExtraInfo& extra)
 {
-   try{ return ((Program*)_interpreter)->Step(line, extra); }
+   try{ return ((BasicProgram<Number>*)_interpreter)->Step(line, extra); }
    catch(ErrorMsg& err){ throw err; }
 }
 
 
-void Interpreter::Rewind()
+template<class Number>
+void BasicInterpreter<Number>::Run(const std::function<void(const std::string&, ExtraInfo&)>& handler, unsigned int threads)
 {
-   ((Program*)_interpreter)->Rewind();
+   try{ ((BasicProgram<Number>*)_interpreter)->Run(handler, threads); }
+   catch(ErrorMsg& err){ throw err; }
+}
+
+
+template<class Number>
+void BasicInterpreter<Number>::Rewind()
+{
+   ((BasicProgram<Number>*)_interpreter)->Rewind();
+}
+
+
+template<class Number>
+void BasicInterpreter<Number>::Clear()
+{
+   ((BasicProgram<Number>*)_interpreter)->Clear();
+}
+
+
+template<class Number>
+unsigned int BasicInterpreter<Number>::Checkpoint()
+{
+   return ((BasicProgram<Number>*)_interpreter)->Checkpoint();
+}
+
+
+template<class Number>
+void BasicInterpreter<Number>::Restore(unsigned int checkpoint)
+{
+   try{ ((BasicProgram<Number>*)_interpreter)->Restore(checkpoint); }
+   catch(ErrorMsg& err){ throw err; }
+}
+
+
+template<class Number>
+void BasicInterpreter<Number>::ReleaseCheckpoint(unsigned int checkpoint)
+{
+   try{ ((BasicProgram<Number>*)_interpreter)->ReleaseCheckpoint(checkpoint); }
+   catch(ErrorMsg& err){ throw err; }
+}
+
+
+template<class Number>
+bool BasicInterpreter<Number>::SeekToOutputLine(size_t line)
+{
+   try{ return ((BasicProgram<Number>*)_interpreter)->SeekToOutputLine(line); }
+   catch(ErrorMsg& err){ throw err; }
+}
+
+
+template<class Number>
+bool BasicInterpreter<Number>::SeekToSourceLine(unsigned int line, unsigned int occurrence)
+{
+   try{ return ((BasicProgram<Number>*)_interpreter)->SeekToSourceLine(line, occurrence); }
+   catch(ErrorMsg& err){ throw err; }
+}
+
+
+template<class Number>
+const ModalState& BasicInterpreter<Number>::GetModalState() const
+{
+   return ((BasicProgram<Number>*)_interpreter)->GetModalState();
+}
+
+
+template<class Number>
+void BasicInterpreter<Number>::SetJournalSize(size_t bytes)
+{
+   ((BasicProgram<Number>*)_interpreter)->SetJournalSize(bytes);
+}
+
+
+template<class Number>
+void BasicInterpreter<Number>::StepBack(size_t steps)
+{
+   try{ ((BasicProgram<Number>*)_interpreter)->StepBack(steps); }
+   catch(ErrorMsg& err){ throw err; }
 }
 
 
-void Interpreter::Clear()
+template<class Number>
+void BasicInterpreter<Number>::EnableBlockDelete(bool enable)
 {
-   ((Program*)_interpreter)->Clear();
+   ((BasicProgram<Number>*)_interpreter)->EnableBlockDelete(enable);
 }
 
 
-void Interpreter::EnableBlockDelete(bool enable)
+template<class Number>
+void BasicInterpreter<Number>::EnablePrettyFormat(bool enable)
 {
-   ((Program*)_interpreter)->EnableBlockDelete(enable);
+   ((BasicProgram<Number>*)_interpreter)->EnablePrettyFormat(enable);
 }
 
 
-void Interpreter::EnablePrettyFormat(bool enable)
+template<class Number>
+void BasicInterpreter<Number>::EnableConvertToUpper(bool enable)
 {
-   ((Program*)_interpreter)->EnablePrettyFormat(enable);
+   ((BasicProgram<Number>*)_interpreter)->EnableConvertToUpper(enable);
 }
 
 
-void Interpreter::EnableConvertToUpper(bool enable)
+template<class Number>
+void BasicInterpreter<Number>::EnableInlineSubs(bool enable)
 {
-   ((Program*)_interpreter)->EnableConvertToUpper(enable);
+   ((BasicProgram<Number>*)_interpreter)->EnableInlineSubs(enable);
 }
 
 
-void Interpreter::SetParam(unsigned int number, double value)
+template<class Number>
+void BasicInterpreter<Number>::SetParam(unsigned int number, double value)
 {
-   try{ ((Program*)_interpreter)->SetParam(number, value); }
+   try{ ((BasicProgram<Number>*)_interpreter)->SetParam(number, value); }
    catch(ErrorMsg& err){ throw err; }
 }
 
 
-double Interpreter::GetParam(unsigned int number) const
+template<class Number>
+double BasicInterpreter<Number>::GetParam(unsigned int number) const
 {
-   try{ return ((Program*)_interpreter)->GetParam(number); }
+   try{ return ((BasicProgram<Number>*)_interpreter)->GetParam(number); }
    catch(ErrorMsg& err){ throw err; }
 }
 
 
-const std::string Interpreter::GetSourceLine(unsigned int num) const
+template<class Number>
+void BasicInterpreter<Number>::SetStackDepth(size_t levels)
 {
-   try{ return ((Program*)_interpreter)->GetSourceLine(num); }
+   try{ ((BasicProgram<Number>*)_interpreter)->SetStackDepth(levels); }
    catch(ErrorMsg& err){ throw err; }
 }
 
 
-unsigned int Interpreter::GetCurrentLineNumber() const
+template<class Number>
+void BasicInterpreter<Number>::SetSubCacheSize(size_t calls)
 {
-   return ((Program*)_interpreter)->GetCurrentLineNumber();
+   ((BasicProgram<Number>*)_interpreter)->SetSubCacheSize(calls);
 }
+
+
+template<class Number>
+void BasicInterpreter<Number>::RegisterFunction(const std::string& name, unsigned int arity, const NativeFunction& function)
+{
+   try{ ((BasicProgram<Number>*)_interpreter)->RegisterFunction(name, arity, function); }
+   catch(ErrorMsg& err){ throw err; }
+}
+
+
+template<class Number>
+void BasicInterpreter<Number>::RegisterSub(unsigned int number, const SubHandler& handler)
+{
+   ((BasicProgram<Number>*)_interpreter)->RegisterSub(number, handler);
+}
+
+
+template<class Number>
+void BasicInterpreter<Number>::EmitCpp(std::ostream& out, const std::string& name) const
+{
+   ((BasicProgram<Number>*)_interpreter)->EmitCpp(out, name);
+}
+
+
+template<class Number>
+const std::string BasicInterpreter<Number>::GetSourceLine(unsigned int num) const
+{
+   try{ return ((BasicProgram<Number>*)_interpreter)->GetSourceLine(num); }
+   catch(ErrorMsg& err){ throw err; }
+}
+
+
+template<class Number>
+unsigned int BasicInterpreter<Number>::GetCurrentLineNumber() const
+{
+   return ((BasicProgram<Number>*)_interpreter)->GetCurrentLineNumber();
+}
+
+
+template<class Number>
+BasicExpression<Number>::BasicExpression(BasicInterpreter<Number>& interp, const std::string& text)
+{
+   _interpreter = interp._interpreter;
+   auto expression = new typename BasicProgram<Number>::CompiledExpression;
+   try{ ((BasicProgram<Number>*)_interpreter)->CompileExpression(text, *expression); }
+   catch(ErrorMsg& err){
+      delete expression;
+      throw err;
+   }
+   _expression = expression;
+}
+
+
+template<class Number>
+BasicExpression<Number>::~BasicExpression()
+{
+   delete (typename BasicProgram<Number>::CompiledExpression*)_expression;
+}
+
+
+template<class Number>
+double BasicExpression<Number>::Evaluate() const
+{
+   try{
+      return Numeric<Number>::ToDouble(((BasicProgram<Number>*)_interpreter)->Evaluate(
+                                          *(typename BasicProgram<Number>::CompiledExpression*)_expression));
+   }
+   catch(ErrorMsg& err){ throw err; }
+}
+
+
+template<class Number>
+void BasicExpression<Number>::Evaluate(const unsigned int* numbers, std::size_t count, const double* values,
+                                       std::size_t rows, double* results) const
+{
+   try{
+      ((BasicProgram<Number>*)_interpreter)->Evaluate(*(typename BasicProgram<Number>::CompiledExpression*)_expression,
+                                                      numbers, count, values, rows, results);
+   }
+   catch(ErrorMsg& err){ throw err; }
+}
+
+
+template<class Number>
+const std::string& BasicExpression<Number>::GetText() const
+{
+   return ((typename BasicProgram<Number>::CompiledExpression*)_expression)->text;
+}
+
+
+template class gsharp::BasicInterpreter<double>;
+template class gsharp::BasicInterpreter<float>;
+template class gsharp::BasicInterpreter<gsharp::Fixed>;
+template class gsharp::BasicExpression<double>;
+template class gsharp::BasicExpression<float>;
+template class gsharp::BasicExpression<gsharp::Fixed>;
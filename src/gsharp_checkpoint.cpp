@@ -0,0 +1,156 @@
+/*
+ *  Copyright 2016, Night Road Software (https://github.com/nrsoft)
+ *  All rights reserved.
+ *  
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are
+ *  met:
+ *  
+ *      * Redistributions of source code must retain the above copyright
+ *  notice, this list of conditions and the following disclaimer.
+ *      * Redistributions in binary form must reproduce the above
+ *  copyright notice, this list of conditions and the following disclaimer
+ *  in the documentation and/or other materials provided with the
+ *  distribution.
+ *      * Neither the name of "Night Road Software" nor the names of its
+ *  contributors may be used to endorse or promote products derived from
+ *  this software without specific prior written permission.
+ *  
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <iostream>
+#include "gsharp_program.h"
+#include "gsharp_except.h"
+
+using namespace std;
+using namespace gsharp;
+
+
+/////////  C h e c k p o i n t  /////////
+// the handle is the index in the list, the place of the released state is taken again
+template<class Number>
+unsigned int BasicProgram<Number>::Checkpoint()
+{
+   size_t handle = 0;
+   while(handle < _checkpoints.size() && _checkpoints[handle])
+      ++handle;
+   if(handle == _checkpoints.size())
+      _checkpoints.emplace_back();
+   _checkpoints[handle] = make_shared<ExecutionState>();
+   _SaveState(*_checkpoints[handle]);
+   if(_debug_level > 1)
+      cout << "Checkpoint " << handle << " at line " << _last_used_line << endl;
+   return static_cast<unsigned int>(handle);
+}
+
+
+/////////  R e s t o r e  /////////
+// the steps before the checkpoint are not the steps of the journal anymore
+template<class Number>
+void BasicProgram<Number>::Restore(unsigned int checkpoint)
+{
+   if(checkpoint >= _checkpoints.size() || !_checkpoints[checkpoint])
+      throw ErrorMsg(this, "Checkpoint %d does not exist", checkpoint);
+   _RestoreState(*_checkpoints[checkpoint]);
+   _ClearJournal();
+   if(_debug_level > 1)
+      cout << "Restored checkpoint " << checkpoint << " at line " << _last_used_line << endl;
+}
+
+
+/////////  R e l e a s e  C h e c k p o i n t  /////////
+template<class Number>
+void BasicProgram<Number>::ReleaseCheckpoint(unsigned int checkpoint)
+{
+   if(checkpoint >= _checkpoints.size() || !_checkpoints[checkpoint])
+      throw ErrorMsg(this, "Checkpoint %d does not exist", checkpoint);
+   _checkpoints[checkpoint].reset(); // the shared pages belong to the program again
+   while(!_checkpoints.empty() && !_checkpoints.back())
+      _checkpoints.pop_back();
+}
+
+
+/////////  S a v e  S t a t e  /////////
+template<class Number>
+void BasicProgram<Number>::_SaveState(ExecutionState& state)
+{
+   state.pc = _pc;
+   state.current_line = _current_line;
+   state.last_used_line = _last_used_line;
+   state.loop_back = _loop_back;
+   _params.Share(state.params);
+   state.local_params = _local_params;
+   state.saved_locals = _saved_locals;
+   state.named_values = _named_values;
+   state.named_defined = _named_defined;
+   state.frames = _frames;
+   state.frame_values = _frame_values;
+   state.run_times.clear();
+   state.run_times.reserve(_blocks.size());
+   for(const auto& block: _blocks)
+      state.run_times.push_back(block.run_times);
+   state.percent_start = _percent_start;
+   state.percent_stop = _percent_stop;
+
+   // the recordings are not finished yet, the replay and the served call are: the rest of their steps is needed
+   state.replay.mode = Replay::NONE;
+   if(_replay.mode == Replay::REPLAYING)
+      state.replay = _replay;
+   state.serving = (_memo.mode == SubMemo::SERVING);
+   if(state.serving){
+      state.served = *_memo.served;
+      state.next = _memo.next;
+   }
+   state.steps = _steps;
+}
+
+
+/////////  R e s t o r e  S t a t e  /////////
+// the loop-invariant values may be calculated after the checkpoint: all of them are calculated again
+template<class Number>
+void BasicProgram<Number>::_RestoreState(ExecutionState& state)
+{
+   _pc = state.pc;
+   _current_line = state.current_line;
+   _last_used_line = state.last_used_line;
+   _loop_back = state.loop_back;
+   state.params.Share(_params);
+   _local_params = state.local_params;
+   _saved_locals = state.saved_locals;
+   _named_values = state.named_values;
+   _named_defined = state.named_defined;
+   _frames = state.frames; // the reserved memory is enough
+   _frame_values = state.frame_values;
+   for(size_t i=0; i<_blocks.size(); ++i)
+      _blocks[i].run_times = state.run_times[i];
+   _percent_start = state.percent_start;
+   _percent_stop = state.percent_stop;
+
+   _output.clear();
+   _pending.clear();
+   _replay = state.replay;
+   _memo.mode = SubMemo::NONE;
+   if(state.serving){
+      _native_call = state.served;
+      _memo.mode = SubMemo::SERVING;
+      _memo.served = &_native_call;
+      _memo.next = state.next;
+   }
+   _steps = state.steps;
+   _cache_reset = ++_clock; // the replay continues as the usual run
+}
+
+
+template class gsharp::BasicProgram<double>;
+template class gsharp::BasicProgram<float>;
+template class gsharp::BasicProgram<gsharp::Fixed>;
@@ -0,0 +1,1224 @@
+/*
+ *  Copyright 2016, Night Road Software (https://github.com/nrsoft)
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are
+ *  met:
+ *
+ *      * Redistributions of source code must retain the above copyright
+ *  notice, this list of conditions and the following disclaimer.
+ *      * Redistributions in binary form must reproduce the above
+ *  copyright notice, this list of conditions and the following disclaimer
+ *  in the documentation and/or other materials provided with the
+ *  distribution.
+ *      * Neither the name of "Night Road Software" nor the names of its
+ *  contributors may be used to endorse or promote products derived from
+ *  this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <iostream>
+#include <algorithm>
+#include "gsharp_program.h"
+#include "gsharp_except.h"
+
+using namespace std;
+using namespace gsharp;
+
+
+///////  A d d I n s t r u c t i o n  ///////
+template<class Number>
+void BasicProgram<Number>::_AddInstruction(Instruction::Code code, unsigned int data, unsigned int first, unsigned int count)
+{
+   Instruction ins = {code, false, _current_line, data, first, count};
+   _bytecode.push_back(ins);
+}
+
+
+////////  A d d L i t e r a l  ////////
+template<class Number>
+unsigned int BasicProgram<Number>::_AddLiteral(const string& text)
+{
+   _literals.push_back(text);
+   return static_cast<unsigned int>(_literals.size() - 1);
+}
+
+
+////////  C o m p i l e L i n e  ////////
+// translates the source line into instructions, which are appended to the program
+// errors found in the code itself are reported at load time, same as before,
+//  while errors in expressions and parameters are thrown only when the line is executed
+// <control> enables o-word commands (not used by the test parser)
+template<class Number>
+void BasicProgram<Number>::_CompileLine(const string& source, int precision, bool control)
+{
+   string line(source);
+   vector<pair<ExtraInfo::Type, string>> active;
+   _ProcessComments(line, &active); // remove comments
+
+   // active comments are reported before the rest of the line is executed
+   for(const auto& msg: active){
+      if(msg.first == ExtraInfo::MSG){
+         if(!msg.second.empty())
+            _AddInstruction(Instruction::TEXT, _AddLiteral(msg.second));
+      }
+      else{
+         _Tokenize(msg.second, false, true);
+         _CompileText(0, false, 4);
+      }
+      _AddInstruction(Instruction::MESSAGE, msg.first);
+   }
+   bool flush = !active.empty();
+
+   _Tokenize(line, control); // whitespaces, lowcase, operators
+   if(_tokens.empty()){
+      if(flush)
+         _AddInstruction(Instruction::FLUSH);
+      return;
+   }
+
+   // detect and process control lines (which starts with O-word)
+   if(_tokens[0].type == Token::OWORD){
+      ONumber o_num = static_cast<ONumber>(_tokens[0].value);
+      string cmd = _lexeme.substr(_tokens[1].start, _tokens[1].len);
+      if(_debug_level > 1)
+         cout << "Found o-word 'o" << o_num << "' with command: '" << cmd << "'" << endl;
+      _RegisterBlock(o_num, cmd);
+      _CompileControl(2, o_num, cmd, flush);
+      if(cmd == "endsub") // the return value still belongs to the sub
+         _compiling_sub = NO_BLOCK;
+      return;
+   }
+
+   // the line may be skipped at run time, if 'block delete' is enabled
+   size_t block_delete = _bytecode.size();
+   if(_tokens[0].type == Token::BLOCK_DELETE)
+      _AddInstruction(Instruction::BLOCK_DELETE);
+
+   // non-control G-code
+   size_t start = _bytecode.size();
+   _CompileText(0, true, precision);
+   if(_bytecode.size() == start + 1 && _bytecode[start].code == Instruction::TEXT){
+      // plain line without parameters and expressions: the output is known already
+      Instruction& ins = _bytecode[start];
+      string text(_literals[ins.data]);
+      ins.code = Instruction::PLAIN;
+      ins.flush = (text.compare(0, 2, "m2") == 0 || text.compare(0, 3, "m30") == 0);
+      ins.first = ins.data;
+      ins.data = _AddLiteral(text);
+      _FormatPretty(_literals[ins.data]);
+   }
+   else
+      _AddInstruction(Instruction::OUTPUT);
+   if(_bytecode[block_delete].code == Instruction::BLOCK_DELETE)
+      _bytecode[block_delete].data = static_cast<unsigned int>(_bytecode.size() - 1);
+}
+
+
+//////////  R e g i s t e r B l o c k  //////////
+// creates o-blocks and checks that the o-word commands match the corresponding block
+template<class Number>
+void BasicProgram<Number>::_RegisterBlock(ONumber o_num, const string& cmd)
+{
+   // check if we have not used this o-number before
+   if(cmd == "call") // 'call' can appear anywhere, don't process it yet
+      return;
+
+   auto id = _block_ids.find(o_num);
+   if(id == _block_ids.end()){
+      // then create the new code block
+      CodeBlock block{CodeBlock::UNDEF, _current_line, ArenaVector<LineNumber>(&_arena), 0, 0, 0, 0, false, false, 0,
+                      ArenaVector<unsigned int>(&_arena)};
+      if(cmd == "sub")
+         block.type = CodeBlock::SUB;
+      else if(cmd == "if")
+         block.type = CodeBlock::IF;
+      else if(cmd == "do")
+         block.type = CodeBlock::DO;
+      else if(cmd == "while")
+         block.type = CodeBlock::WHILE;
+      else if(cmd == "repeat")
+         block.type = CodeBlock::REPEAT;
+      else if(cmd == "endsub" || cmd == "return" || cmd == "elseif" || cmd == "else" ||
+              cmd == "endif" || cmd == "break" || cmd == "continue" ||
+              cmd == "endwhile" || cmd == "endrepeat")
+         throw ErrorMsg(this, "Unexpected o-code command '%s'", cmd.c_str());
+      else
+         throw ErrorMsg(this, "Unrecognised o-code command '%s'", cmd.c_str());
+
+      _block_ids[o_num] = static_cast<unsigned int>(_blocks.size());
+      if(block.type == CodeBlock::SUB) // the local named parameters which follow are its' own
+         _compiling_sub = static_cast<unsigned int>(_blocks.size());
+      _blocks.push_back(move(block)); // keeps the arena memory of the internal lines
+      if(_debug_level > 0)
+         cout << "Created o-block {" << _blocks.back().start_line << "," <<
+                  _blocks.back().end_line << "," << _blocks.back().type << "}" << endl;
+      return;
+   }
+
+   CodeBlock& block = _blocks[id->second]; // the block with this o-code already exists
+
+    // has the end line been already defined? shouldn't happen
+   if(block.end_line != 0)
+      throw ErrorMsg(this, "O-code block already finished in line %d", block.end_line-1);
+
+   if(cmd == "sub" || cmd == "if" || cmd == "do" || cmd == "repeat" ||
+      (cmd == "while" && block.type != CodeBlock::DO))
+         throw ErrorMsg(this, "O-number %d is alredy used in line %d",
+                        o_num, block.start_line);
+
+   // check if the command matches the corresponding block
+   if((cmd == "return" && block.type != CodeBlock::SUB) ||
+      (cmd == "endsub" && block.type != CodeBlock::SUB) ||
+      (cmd == "elseif" && block.type != CodeBlock::IF)  ||
+      (cmd == "else"   && block.type != CodeBlock::IF)  ||
+      (cmd == "endif"  && block.type != CodeBlock::IF)  ||
+      (cmd == "while"  && block.type != CodeBlock::DO)  ||
+      (cmd == "endwhile" && block.type != CodeBlock::WHILE) ||
+      (cmd == "break" && block.type != CodeBlock::DO && block.type != CodeBlock::WHILE) ||
+      (cmd == "continue" && block.type != CodeBlock::DO && block.type != CodeBlock::WHILE) ||
+      (cmd == "endrepeat" && block.type != CodeBlock::REPEAT))
+         throw ErrorMsg(this, "Unexpected command for o-code block %d", o_num);
+
+   if(cmd == "elseif" || cmd == "else")
+      block.mid_line.push_back(_current_line);
+
+   // set the end line for this o-block
+   if(cmd == "endsub" || cmd == "endif" || cmd == "while" ||
+      cmd == "endwhile" || cmd == "endrepeat"){
+         block.end_line = _current_line + 1;
+      if(_debug_level > 0)
+         cout << "Finished o-block {" << block.start_line << "," <<
+                  block.end_line << "," << block.type << "}" << endl;
+   }
+}
+
+
+/////////  C o m p i l e C o n t r o l  /////////
+// <t> is the first token after the o-word command
+template<class Number>
+void BasicProgram<Number>::_CompileControl(size_t t, ONumber number, const string& command, bool flush)
+{
+   Instruction::Code code;
+   bool arguments = true; // the command may have arguments
+   if(command == "sub")
+      code = Instruction::SUB, arguments = false;
+   else if(command == "break")
+      code = Instruction::BREAK, arguments = false;
+   else if(command == "continue")
+      code = Instruction::CONTINUE, arguments = false;
+   else if(command == "endwhile")
+      code = Instruction::ENDWHILE, arguments = false;
+   else if(command == "endrepeat")
+      code = Instruction::ENDREPEAT, arguments = false;
+   else if(command == "else")
+      code = Instruction::ELSE, arguments = false;
+   else if(command == "call")
+      code = Instruction::CALL;
+   else if(command == "return" || command == "endsub")
+      code = Instruction::RETURN;
+   else if(command == "repeat")
+      code = Instruction::REPEAT;
+   else if(command == "while")
+      code = Instruction::WHILE;
+   else if(command == "if")
+      code = Instruction::IF;
+   else if(command == "elseif")
+      code = Instruction::ELSEIF;
+   else if(command == "do")
+      code = Instruction::DO, arguments = false;
+   else{ // 'endif' doesn't do anything
+      if(flush)
+         _AddInstruction(Instruction::FLUSH);
+      return;
+   }
+
+   // expressions in brackets are the arguments, everything else is ignored
+   unsigned int first = static_cast<unsigned int>(_operands.size());
+   unsigned int count = 0;
+   if(arguments){
+      try{
+         while(t < _tokens.size()){
+            if(_tokens[t].type != Token::OPEN){
+               ++t;
+               continue;
+            }
+            size_t name_len;
+            unsigned int native = 0;
+            Function func = _FindFunction(_tokens[t-1], name_len, &native);
+            size_t first_op = _operations.size();
+            _CompileExpression(t, func, native);
+            _AddOperand(Operand::EXPRESSION, first_op);
+            ++count;
+         }
+      }
+      catch(ErrorMsg& err){
+         _AddError(err);
+         return;
+      }
+   }
+
+   if(code == Instruction::CALL && _inline_subs && _CompileInlineCall(number, first, count, flush))
+      return;
+
+   Control control = {number, NO_BLOCK, 0, 0, NO_TABLE, 0, NO_NATIVE}; // jump targets are resolved after the whole program is loaded
+   _controls.push_back(control);
+   _AddInstruction(code, static_cast<unsigned int>(_controls.size() - 1), first, count);
+   _bytecode.back().flush = flush;
+}
+
+
+/////////  C o m p i l e I n l i n e C a l l  /////////
+// copies the instructions of the small sub into the calling line, if possible
+// the sub must be defined before, without any o-word commands inside (so it can't call anything)
+//  and change the parameters by known numbers only
+// <first>, <count> are the arguments of the call
+template<class Number>
+bool BasicProgram<Number>::_CompileInlineCall(ONumber number, unsigned int first, unsigned int count, bool flush)
+{
+   auto id = _block_ids.find(number);
+   if(id == _block_ids.end() || _sub_handler_ids.count(number) > 0) // or it's replaced by the host
+      return false;
+   const CodeBlock& block = _blocks[id->second];
+   if(block.type != CodeBlock::SUB || block.end_line == 0 || block.end_line - block.start_line > MAX_INLINE_SUB_LINES + 2 ||
+      !block.named.empty()) // the local named parameters need the frame
+         return false;
+
+   // the body from the line after 'sub' to 'endsub' (incl. the messages there)
+   size_t body = _line_start[block.start_line + 1], end = _line_start[block.end_line] - 1;
+   if(_bytecode[end].code != Instruction::RETURN)
+      return false;
+   InlineCall call = {number, vector<unsigned int>(), body, 0, end - body + 1};
+   vector<bool> changed(TOTAL_LOCAL_PARAMETERS, false);
+   for(unsigned int i=0; i<count && i<TOTAL_LOCAL_PARAMETERS; ++i)
+      changed[i] = true; // arguments
+   for(size_t pc=body; pc<end; ++pc){
+      const Instruction& ins = _bytecode[pc];
+      if(ins.code >= Instruction::ENTER)
+         return false;
+      if(ins.code == Instruction::ASSIGN){
+         const Operand& target = _operands[ins.data];
+         const Operation* op = &_operations[target.first];
+         if(target.count == 1 && op[0].code == Operation::NAMED)
+            continue; // global one
+         if(target.count != 2 || op[0].code != Operation::NUMBER || op[1].nref != 1)
+            return false;
+         double index = round(op[0].value);
+         if(index >= 1 && index <= TOTAL_LOCAL_PARAMETERS)
+            changed[static_cast<size_t>(index) - 1] = true;
+      }
+   }
+   for(unsigned int i=0; i<TOTAL_LOCAL_PARAMETERS; ++i)
+      if(changed[i])
+         call.locals.push_back(i);
+
+   unsigned int index = static_cast<unsigned int>(_inline_calls.size());
+   _inline_calls.push_back(call);
+   _AddInstruction(Instruction::ENTER, index, first, count);
+   _bytecode.back().flush = flush;
+   size_t start = _bytecode.size();
+   _inline_calls.back().copy = start;
+   for(size_t pc=body; pc<=end; ++pc){
+      Instruction ins = _bytecode[pc];
+      // the copy gets its' own operands, the optimizer may change them for this place only
+      if(ins.code == Instruction::VALUE)
+         ins.first = _CopyOperand(ins.first);
+      else if(ins.code == Instruction::ASSIGN)
+         ins.data = _CopyOperand(ins.data);
+      else if(ins.code == Instruction::BLOCK_DELETE)
+         ins.data = static_cast<unsigned int>(ins.data - body + start);
+      else if(ins.code == Instruction::RETURN){
+         ins.code = Instruction::LEAVE;
+         ins.data = index;
+         unsigned int args = static_cast<unsigned int>(_operands.size());
+         for(unsigned int i=0; i<ins.count; ++i)
+            _CopyOperand(ins.first + i);
+         ins.first = args;
+      }
+      _bytecode.push_back(ins);
+   }
+   if(_debug_level > 1)
+      cout << "Inlined sub " << number << " (" << (end - body + 1) << " instructions)" << endl;
+   return true;
+}
+
+
+/////////  C o p y O p e r a n d  /////////
+template<class Number>
+unsigned int BasicProgram<Number>::_CopyOperand(unsigned int operand)
+{
+   Operand copy = _operands[operand];
+   _operands.push_back(copy);
+   return static_cast<unsigned int>(_operands.size() - 1);
+}
+
+
+/////////  R e s o l v e C o n t r o l s  /////////
+// finds the o-block and the jump targets for every o-word command
+// all lines must be compiled already
+template<class Number>
+void BasicProgram<Number>::_ResolveControls()
+{
+   // local parameters changed by the subs (calls from the sub restore their own ones)
+   for(auto& block: _blocks){
+      if(block.type != CodeBlock::SUB)
+         continue;
+      for(size_t pc=_line_start[block.start_line + 1]; pc<_line_start[block.end_line]; ++pc){
+         if(_bytecode[pc].code != Instruction::ASSIGN)
+            continue;
+         const Operand& target = _operands[_bytecode[pc].data];
+         const Operation* op = &_operations[target.first];
+         if(target.count == 1 && op[0].code == Operation::NAMED)
+            continue; // saved by the frame separately
+         if(target.count != 2 || op[0].code != Operation::NUMBER || op[1].nref != 1){
+            block.locals = ~0u; // could be any of them
+            break;
+         }
+         double index = round(op[0].value);
+         if(index >= 1 && index <= TOTAL_LOCAL_PARAMETERS)
+            block.locals |= 1u << (static_cast<unsigned int>(index) - 1);
+      }
+   }
+
+   for(const auto& ins: _bytecode){
+      if(ins.code < Instruction::SUB)
+         continue;
+      Control& control = _controls[ins.data];
+      if(ins.code == Instruction::CALL){ // the host implementation replaces the sub
+         auto handler = _sub_handler_ids.find(control.number);
+         if(handler != _sub_handler_ids.end()){
+            control.native = handler->second;
+            continue;
+         }
+      }
+      auto id = _block_ids.find(control.number);
+      if(id == _block_ids.end())
+         continue; // reported at run time, e.g. the call of undefined sub
+      control.block = id->second;
+      const CodeBlock& block = _blocks[control.block];
+      control.exit = _line_start[block.end_line];
+      control.jump = _line_start[ins.line + 1]; // by default: continue with the next line
+
+      switch(ins.code){
+         case Instruction::CALL:{ // local parameters to preserve: changed inside the sub and the arguments
+            unsigned int args = min(ins.count, static_cast<unsigned int>(TOTAL_LOCAL_PARAMETERS));
+            control.locals = (block.locals | ((1u << args) - 1)) & ((1u << TOTAL_LOCAL_PARAMETERS) - 1);
+            control.jump = _line_start[block.start_line + 1]; // straight after 'sub'
+            break;
+         }
+         case Instruction::ENDREPEAT:
+            control.jump = _line_start[block.start_line + 1]; // straight after 'repeat'
+            break;
+         case Instruction::CONTINUE:
+            control.jump = _line_start[block.end_line - 1]; // to the last line of the loop
+            break;
+         case Instruction::ENDWHILE:
+            control.jump = _line_start[block.start_line]; // back to check the loop condition again
+            break;
+         case Instruction::WHILE:
+            if(ins.line != block.start_line)
+               control.jump = _line_start[block.start_line + 1]; // this is 'do-while' loop
+            break;
+         case Instruction::IF:
+         case Instruction::ELSEIF:{ // the next condition to check
+            auto mid = upper_bound(block.mid_line.begin(), block.mid_line.end(), ins.line);
+            control.jump = (mid != block.mid_line.end())? _line_start[*mid]: control.exit;
+            break;
+         }
+         default:
+            break;
+      }
+   }
+
+   // pure subs: the output and the return value depend only on the local parameters read inside,
+   //  so the calls with the same values can be served from the cache
+   for(auto& block: _blocks){
+      if(block.type != CodeBlock::SUB)
+         continue;
+      block.pure = true;
+      for(size_t pc=_line_start[block.start_line + 1]; pc<_line_start[block.end_line] && block.pure; ++pc){
+         const Instruction& ins = _bytecode[pc];
+         switch(ins.code){
+            case Instruction::TEXT: case Instruction::COMMIT: case Instruction::MESSAGE:
+            case Instruction::BLOCK_DELETE: case Instruction::OUTPUT: case Instruction::FLUSH: case Instruction::ERROR:
+               break;
+            case Instruction::VALUE:
+               block.pure = _ReadsLocals(_operands[ins.first], block.reads);
+               break;
+            case Instruction::ASSIGN:{ // only to the local parameters
+               const Operand& target = _operands[ins.data];
+               const Operation* op = &_operations[target.first];
+               block.pure = (target.count == 2 && op[0].code == Operation::NUMBER && op[1].nref == 1 &&
+                             round(op[0].value) >= 1 && round(op[0].value) <= TOTAL_LOCAL_PARAMETERS);
+               break;
+            }
+            case Instruction::PLAIN:
+               block.pure = !ins.flush; // m2 or m30 finishes the program
+               break;
+            case Instruction::CALL: case Instruction::ENTER: case Instruction::LEAVE: case Instruction::END:
+               block.pure = false;
+               break;
+            default: // other o-word commands
+               for(unsigned int i=0; i<ins.count && block.pure; ++i)
+                  block.pure = _ReadsLocals(_operands[ins.first + i], block.reads);
+         }
+      }
+      if(block.pure && _debug_level > 1)
+         cout << "Pure sub in line " << block.start_line << endl;
+   }
+
+   // 'repeat' loops which don't change anything and don't depend on anything changing
+   for(auto& block: _blocks){
+      if(block.type != CodeBlock::REPEAT)
+         continue;
+      block.steady = true;
+      size_t last = _line_start[block.end_line] - 1; // 'endrepeat' itself
+      for(size_t pc=_line_start[block.start_line + 1]; pc<last && block.steady; ++pc){
+         switch(_bytecode[pc].code){
+            case Instruction::TEXT: case Instruction::VALUE: case Instruction::MESSAGE:
+            case Instruction::OUTPUT: case Instruction::FLUSH:
+            case Instruction::IF: case Instruction::ELSEIF: case Instruction::ELSE:
+               break;
+            case Instruction::PLAIN:
+               block.steady = !_bytecode[pc].flush; // m2 or m30 finishes the program
+               break;
+            default:
+               block.steady = false;
+         }
+      }
+   }
+
+   // long if-elseif chains may jump straight to the matching branch
+   for(size_t i=0; i<_bytecode.size(); ++i)
+      if(_bytecode[i].code == Instruction::IF && _controls[_bytecode[i].data].block != NO_BLOCK)
+         _BuildJumpTable(i);
+}
+
+
+/////////  B u i l d J u m p T a b l e  /////////
+// <pc> is the 'if' instruction which starts the chain
+// every 'elseif' line must contain nothing else but the condition [#n EQ constant],
+//  so skipping them doesn't change the output
+template<class Number>
+void BasicProgram<Number>::_BuildJumpTable(size_t pc)
+{
+   Control& control = _controls[_bytecode[pc].data];
+   const CodeBlock& block = _blocks[control.block];
+   if(block.mid_line.size() < MIN_JUMP_TABLE_BRANCHES - 1)
+      return;
+
+   JumpTable table;
+   double constant;
+   if(!_IsEqualityTest(_bytecode[pc], table.parameter, constant))
+      return;
+   table.other = control.exit;
+
+   for(size_t i=0; i<block.mid_line.size(); ++i){
+      size_t start = _line_start[block.mid_line[i]];
+      const Instruction& mid = _bytecode[start];
+      if(mid.code == Instruction::ELSE && i == block.mid_line.size() - 1){
+         table.other = start; // 'else' line is executed as usual
+         break;
+      }
+      unsigned int parameter;
+      if(mid.code != Instruction::ELSEIF || _line_start[block.mid_line[i] + 1] != start + 1 ||
+         !_IsEqualityTest(mid, parameter, constant) || parameter != table.parameter)
+            return;
+      table.branches.insert(make_pair(constant, start + 1)); // the first one wins, same as in the chain
+   }
+
+   control.table = static_cast<unsigned int>(_jump_tables.size());
+   _jump_tables.push_back(table);
+   if(_debug_level > 0)
+      cout << "Jump table for o-block in line " << block.start_line << " with " <<
+               table.branches.size() << " branches on #" << table.parameter << endl;
+}
+
+
+/////////  I s E q u a l i t y T e s t  /////////
+// checks if the only argument is [#n EQ constant] (or [constant EQ #n])
+// the constant must be an integer, so no more than one of them may match the parameter
+template<class Number>
+bool BasicProgram<Number>::_IsEqualityTest(const Instruction& ins, unsigned int& parameter, double& constant) const
+{
+   if(ins.count != 1)
+      return false;
+   const Operand& operand = _operands[ins.first];
+   if(operand.type != Operand::EXPRESSION || operand.count != 4)
+      return false;
+
+   const Operation* op = &_operations[operand.first];
+   if(op[3].code != Operation::EQ)
+      return false;
+   double index;
+   if(op[0].code == Operation::NUMBER && op[1].code == Operation::PARAMETER && op[2].code == Operation::NUMBER)
+      index = op[0].value, constant = op[2].value; // [#n EQ constant]
+   else if(op[0].code == Operation::NUMBER && op[1].code == Operation::NUMBER && op[2].code == Operation::PARAMETER)
+      constant = op[0].value, index = op[1].value; // [constant EQ #n]
+   else
+      return false;
+   const Operation& param = (op[1].code == Operation::PARAMETER)? op[1]: op[2];
+   if(param.nref != 1 || index < 1 || index > TOTAL_CNC_PARAMETERS || index != floor(index) ||
+      constant != floor(constant) || fabs(constant) > 1e15)
+         return false;
+   parameter = static_cast<unsigned int>(index);
+   return true;
+}
+
+
+/////////  R e a d P a r a m e t e r s  /////////
+// the numbers of the parameters read by the operand are added to <params>
+// false if any of the numbers is computed, e.g. #[#1 + 1], or a named parameter is read
+template<class Number>
+bool BasicProgram<Number>::_ReadParameters(const Operand& operand, vector<unsigned int>& params) const
+{
+   const Operation* op = &_operations[operand.first];
+   for(unsigned int i=0; i<operand.count; ++i){
+      if(op[i].code == Operation::NAMED || op[i].code == Operation::DEFINED)
+         return false;
+      if(op[i].code != Operation::PARAMETER)
+         continue;
+      if(i == 0 || op[i].nref != 1 || op[i-1].code != Operation::NUMBER)
+         return false;
+      double index = round(op[i-1].value);
+      if(index < 1 || index > TOTAL_PARAMETERS)
+         return false;
+      params.push_back(static_cast<unsigned int>(index));
+   }
+   return true;
+}
+
+
+/////////  R e a d s L o c a l s  /////////
+// checks that the operand reads nothing but the local parameters with constant numbers
+// the bits of these parameters are added to <reads>
+template<class Number>
+bool BasicProgram<Number>::_ReadsLocals(const Operand& operand, unsigned int& reads) const
+{
+   vector<unsigned int> params;
+   if(!_ReadParameters(operand, params))
+      return false;
+   for(auto number: params){
+      if(number > TOTAL_LOCAL_PARAMETERS)
+         return false;
+      reads |= 1u << (number - 1);
+   }
+   return true;
+}
+
+
+///////  C o m p i l e T e x t  ///////
+// splits g-code line or message into literal text and values, starting from the token <t>
+// the text following '=' is the value to assign, which is read back from the output,
+//  the assignments are performed only as the last step (LinuxCNC requirement)
+// <expressions> enables expressions in brackets (not allowed in messages)
+template<class Number>
+void BasicProgram<Number>::_CompileText(size_t t, bool expressions, int precision)
+{
+   size_t start = _bytecode.size();
+   bool assignments = false;
+   size_t text_start = 0, text_end = 0; // literal text waiting to be added (in the lexeme)
+   try{
+      while(t < _tokens.size()){
+         unsigned int value;
+         if(_tokens[t].type == Token::PARAMETER)
+            value = _CompileOperand(t, expressions);
+         else if(_tokens[t].type == Token::OPEN && expressions){
+            // is this expression a function argument? e.g. abs[..]
+            size_t name_len = 0;
+            unsigned int native = 0;
+            Function func = (t > 0)? _FindFunction(_tokens[t-1], name_len, &native): NO_FUNCTION;
+            text_end -= name_len;
+            size_t first = _operations.size();
+            _CompileExpression(t, func, native);
+            value = _AddOperand(Operand::EXPRESSION, first);
+         }
+         else{
+            if(text_end == text_start)
+               text_start = _tokens[t].start;
+            text_end = _tokens[t].start + _tokens[t].len;
+            ++t;
+            continue;
+         }
+
+         if(text_end > text_start){
+            _AddInstruction(Instruction::TEXT, _AddLiteral(_lexeme.substr(text_start, text_end - text_start)));
+            text_start = text_end = 0;
+         }
+         const Operand& operand = _operands[value];
+         if(t < _tokens.size() && _tokens[t].type == Token::ASSIGN && operand.type == Operand::PARAMETER){
+            _AddInstruction(Instruction::ASSIGN, value);
+            assignments = true;
+            ++t; // the value to assign starts after the '=' character
+         }
+         else if(operand.count == 1 && _operations[operand.first].code == Operation::NUMBER){
+            string str; // constant expression, the text is known already
+            _FormatValue(_constants[_operations[operand.first].nref], precision, str);
+            _AddInstruction(Instruction::TEXT, _AddLiteral(str));
+         }
+         else // substitute parameter or expression with its' value string
+            _AddInstruction(Instruction::VALUE, precision, value);
+      }
+   }
+   catch(ErrorMsg& err){
+      _bytecode.resize(start);
+      _AddError(err);
+      return;
+   }
+
+   if(text_end > text_start)
+      _AddInstruction(Instruction::TEXT, _AddLiteral(_lexeme.substr(text_start, text_end - text_start)));
+   if(assignments)
+      _AddInstruction(Instruction::COMMIT);
+
+   // join the neighbour pieces of text
+   size_t last = start;
+   for(size_t i=start; i<_bytecode.size(); ++i){
+      if(i > start && _bytecode[i].code == Instruction::TEXT && _bytecode[last-1].code == Instruction::TEXT)
+         _literals[_bytecode[last-1].data] += _literals[_bytecode[i].data];
+      else
+         _bytecode[last++] = _bytecode[i];
+   }
+   _bytecode.resize(last);
+}
+
+
+///////  I s O p e r a n d  ///////
+// check if parameter (#..) or expression ([..] or function) starts at the token <t>
+template<class Number>
+bool BasicProgram<Number>::_IsOperand(size_t t, size_t end, bool expressions)
+{
+   if(t >= end)
+      return false;
+   if(_tokens[t].type == Token::PARAMETER)
+      return true;
+   if(!expressions)
+      return false;
+   if(_tokens[t].type == Token::OPEN)
+      return true;
+
+   size_t name_len;
+   return _FindFunction(_tokens[t], name_len) != NO_FUNCTION && name_len == _tokens[t].len &&
+          t+1 < end && _tokens[t+1].type == Token::OPEN;
+}
+
+
+///////  C o m p i l e O p e r a n d  ///////
+// parameter (#.. or #[..]) or expression ([..] or function) starting at the token <t>
+// <t> is moved after the operand
+template<class Number>
+unsigned int BasicProgram<Number>::_CompileOperand(size_t& t, bool expressions)
+{
+   size_t first = _operations.size();
+   Operand::Type type = (_tokens[t].type == Token::PARAMETER)? Operand::PARAMETER: Operand::EXPRESSION;
+   _CompilePrimary(t, _tokens.size(), expressions);
+   return _AddOperand(type, first);
+}
+
+
+///////  C o m p i l e E x p r e s s i o n  ///////
+// the expression of the host is compiled after the loaded program and moved out of it
+// the text can go without the outer brackets, e.g. "#1 * 2"
+template<class Number>
+void BasicProgram<Number>::CompileExpression(const string& text, CompiledExpression& expression)
+{
+   size_t operations_size = _operations.size();
+   size_t constants_size = _constants.size();
+   LineNumber current_line = _current_line;
+   try{
+      _current_line = 0; // not a program line
+      _Tokenize("[" + text + "]", false);
+      for(const auto& token: _tokens)
+         if(token.type == Token::NAME)
+            throw ErrorMsg(this, "Named parameters are not supported in the expressions of the host");
+      size_t t = 0;
+      _CompileExpression(t, NO_FUNCTION);
+      if(t < _tokens.size())
+         throw ErrorMsg(this, "Unexpected text after the expression");
+      _FoldOperations(operations_size);
+   }
+   catch(ErrorMsg&){
+      _operations.resize(operations_size);
+      _constants.resize(constants_size);
+      _current_line = current_line;
+      throw;
+   }
+
+   expression.text = text;
+   expression.operations.assign(_operations.begin() + operations_size, _operations.end());
+   expression.constants.clear();
+   for(auto& op: expression.operations){
+      if(op.code == Operation::NUMBER){
+         expression.constants.push_back(_constants[op.nref]);
+         op.nref = static_cast<unsigned int>(expression.constants.size() - 1);
+      }
+   }
+   _operations.resize(operations_size);
+   _constants.resize(constants_size);
+   _current_line = current_line;
+
+   // the values never take more places on the stack than the operations
+   if(_stack.capacity() < expression.operations.size())
+      _stack.reserve(expression.operations.size());
+   if(_debug_level > 1)
+      cout << "Expression of the host '" << text << "': " << expression.operations.size() << " operation(s)" << endl;
+}
+
+
+///////  A d d O p e r a n d  ///////
+// the operand consists of all operations from <first> up to the last one
+template<class Number>
+unsigned int BasicProgram<Number>::_AddOperand(Operand::Type type, size_t first)
+{
+   _FoldOperations(first);
+   Operand operand = {type, static_cast<unsigned int>(first), static_cast<unsigned int>(_operations.size() - first)};
+   _operands.push_back(operand);
+   return static_cast<unsigned int>(_operands.size() - 1);
+}
+
+
+////////  F o l d O p e r a t i o n s  ////////
+// calculates at load time all parts of the expression (starting from operation <first>),
+//  which don't depend on parameters
+// the same operations are evaluated in the same order, so the results are identical
+template<class Number>
+void BasicProgram<Number>::_FoldOperations(size_t first)
+{
+   vector<pair<size_t, bool>> values; // values on the stack: the first operation and if it's constant
+   size_t last = first; // the end of the folded operations
+   for(size_t i=first; i<_operations.size(); ++i){
+      const Operation op = _operations[i];
+      _operations[last++] = op;
+
+      pair<size_t, bool> value(last - 1, op.code != Operation::PARAMETER && op.code != Operation::NAMED &&
+                                         op.code != Operation::DEFINED);
+      for(size_t args = _CountArguments(op); args > 0; --args){
+         value.first = values.back().first;
+         value.second = value.second && values.back().second;
+         values.pop_back();
+      }
+      if(value.second && op.code != Operation::NUMBER){
+         try{
+            Number result = _Evaluate(value.first, last);
+            Operation number = {Operation::NUMBER, NO_FUNCTION, static_cast<unsigned int>(_constants.size()),
+                                Numeric::ToDouble(result)};
+            _constants.push_back(result);
+            last = value.first;
+            _operations[last++] = number;
+         }
+         catch(ErrorMsg&){ // leave it for the run time
+            value.second = false;
+         }
+      }
+      values.push_back(value);
+   }
+   _operations.resize(last);
+}
+
+
+////////  C o u n t A r g u m e n t s  ////////
+// number of values the operation takes from the stack
+template<class Number>
+size_t BasicProgram<Number>::_CountArguments(const Operation& op) const
+{
+   if(op.code == Operation::NUMBER || op.code == Operation::NAMED || op.code == Operation::DEFINED)
+      return 0;
+   if(op.code == Operation::FUNCTION && op.func == NATIVE)
+      return _natives[op.nref].arity;
+   if(op.code == Operation::PARAMETER || op.code == Operation::NEGATE ||
+      (op.code == Operation::FUNCTION && op.func != ATAN))
+         return 1;
+   return 2;
+}
+
+
+/////////  H o i s t I n v a r i a n t s  /////////
+// values inside the loops, which depend only on the parameters not changed by the loop,
+//  are calculated once per loop entry
+// the loop must not call subroutines or assign parameters by calculated numbers
+template<class Number>
+void BasicProgram<Number>::_HoistInvariants()
+{
+   vector<unsigned int> loops;
+   for(unsigned int b=0; b<_blocks.size(); ++b)
+      if(_blocks[b].type == CodeBlock::WHILE || _blocks[b].type == CodeBlock::DO || _blocks[b].type == CodeBlock::REPEAT)
+         loops.push_back(b);
+   sort(loops.begin(), loops.end(), [this](unsigned int a, unsigned int b){
+      return _blocks[a].start_line < _blocks[b].start_line;
+   });
+
+   // the innermost loop of every line (inner loops start later)
+   vector<unsigned int> innermost(_code.size(), NO_BLOCK);
+   for(auto b: loops){
+      // 'while' condition is checked on every iteration, 'repeat' and 'do' lines are not
+      LineNumber from = _blocks[b].start_line + ((_blocks[b].type == CodeBlock::WHILE)? 0: 1);
+      for(LineNumber line=from; line<_blocks[b].end_line; ++line)
+         innermost[line] = b;
+   }
+
+   for(auto b: loops){
+      const CodeBlock& block = _blocks[b];
+      size_t first = _line_start[block.start_line], last = _line_start[block.end_line];
+
+      // which parameters are changed inside the loop?
+      vector<bool> assigned(TOTAL_PARAMETERS + 1, false);
+      bool suitable = true;
+      for(size_t pc=first; pc<last && suitable; ++pc){
+         const Instruction& ins = _bytecode[pc];
+         if(ins.code == Instruction::SUB || ins.code == Instruction::CALL || ins.code == Instruction::RETURN)
+            suitable = false;
+         else if(ins.code == Instruction::ENTER || ins.code == Instruction::LEAVE){ // inlined sub
+            for(auto i: _inline_calls[ins.data].locals)
+               assigned[i + 1] = true;
+            assigned[RETURN_VALUE_PARAMETER] = true;
+         }
+         else if(ins.code == Instruction::ASSIGN){
+            const Operand& target = _operands[ins.data];
+            const Operation* op = &_operations[target.first];
+            if(target.count == 2 && op[0].code == Operation::NUMBER && op[1].nref == 1 &&
+               op[0].value >= 0.5 && op[0].value < TOTAL_PARAMETERS + 0.5)
+                  assigned[static_cast<size_t>(round(op[0].value))] = true;
+            else
+               suitable = false;
+         }
+      }
+      if(!suitable)
+         continue;
+
+      for(LineNumber line=block.start_line; line<block.end_line; ++line){
+         if(innermost[line] != b)
+            continue;
+         for(size_t pc=_line_start[line]; pc<_line_start[line+1]; ++pc){
+            const Instruction& ins = _bytecode[pc];
+            if(ins.code == Instruction::VALUE)
+               _HoistOperand(ins.first, b, assigned);
+            else if(ins.code >= Instruction::ENTER && ins.code != Instruction::END)
+               for(unsigned int i=0; i<ins.count; ++i)
+                  _HoistOperand(ins.first + i, b, assigned);
+         }
+      }
+   }
+}
+
+
+/////////  H o i s t O p e r a n d  /////////
+// the largest invariant parts of the expression are placed between CACHED and STORE operations
+// the operand gets the new copy of its' operations
+template<class Number>
+void BasicProgram<Number>::_HoistOperand(unsigned int operand, unsigned int block, const vector<bool>& assigned)
+{
+   if(_operands[operand].type != Operand::EXPRESSION)
+      return;
+   const size_t start = _operands[operand].first, end = start + _operands[operand].count;
+
+   // values on the stack: the operations, which produce it, are they invariant and worth caching?
+   typedef struct {size_t first, last; bool invariant, worth;} Value;
+   vector<Value> values;
+   vector<pair<size_t, size_t>> hoisted; // ranges of operations to cache
+   for(size_t i=start; i<end; ++i){
+      const Operation& op = _operations[i];
+      Value value = {i, i, op.code != Operation::NAMED && op.code != Operation::DEFINED, // not tracked by the loop
+                     op.code != Operation::NUMBER && op.code != Operation::PARAMETER};
+      if(op.code == Operation::PARAMETER){ // only simple references with the known number, like #5
+         const Operation& index = _operations[i-1];
+         value.invariant = op.nref == 1 && values.back().first == i-1 && index.code == Operation::NUMBER &&
+                           index.value >= 0.5 && index.value < TOTAL_PARAMETERS + 0.5 &&
+                           !assigned[static_cast<size_t>(round(index.value))];
+      }
+      size_t args = _CountArguments(op);
+      vector<Value> arguments(values.end() - args, values.end());
+      values.resize(values.size() - args);
+      for(const auto& arg: arguments){
+         value.first = min(value.first, arg.first);
+         value.invariant = value.invariant && arg.invariant;
+         value.worth = value.worth || arg.worth;
+      }
+      if(!value.invariant) // the invariant arguments are the largest parts
+         for(const auto& arg: arguments)
+            if(arg.invariant && arg.worth)
+               hoisted.push_back(make_pair(arg.first, arg.last));
+      values.push_back(value);
+   }
+   if(values.back().invariant && values.back().worth)
+      hoisted.push_back(make_pair(start, end - 1));
+   if(hoisted.empty())
+      return;
+
+   // copy the operations with the cache ones inserted
+   sort(hoisted.begin(), hoisted.end());
+   size_t first = _operations.size();
+   auto range = hoisted.begin();
+   for(size_t i=start; i<end; ++i){
+      if(range != hoisted.end() && i == range->first)
+         _AddOperation(Operation::CACHED, 0.0, static_cast<unsigned int>(_caches.size()));
+      Operation op = _operations[i];
+      _operations.push_back(op);
+      if(range != hoisted.end() && i == range->second){
+         _AddOperation(Operation::STORE, 0.0, static_cast<unsigned int>(_caches.size()));
+         Cache cache = {block, _operations.size() - 1, Number(), 0};
+         _caches.push_back(cache);
+         ++range;
+      }
+   }
+   _operands[operand].first = static_cast<unsigned int>(first);
+   _operands[operand].count = static_cast<unsigned int>(_operations.size() - first);
+   if(_debug_level > 1)
+      cout << "Hoisted " << hoisted.size() << " value(s) out of the loop in line " << _blocks[block].start_line << endl;
+}
+
+
+///////  A d d O p e r a t i o n  ///////
+template<class Number>
+void BasicProgram<Number>::_AddOperation(Operation::Code code, double value, unsigned int nref, Function func)
+{
+   if(code == Operation::NUMBER){ // the constant is converted once
+      nref = static_cast<unsigned int>(_constants.size());
+      _constants.push_back(Numeric::FromDouble(value));
+   }
+   Operation operation = {code, func, nref, value};
+   _operations.push_back(operation);
+}
+
+
+///////  C o m p i l e E x p r e s s i o n  ///////
+// <t> should point to the opening bracket, it is moved after the closing one
+// <func> is the function to apply to the expression (its name is not included)
+// <native> is the index of NATIVE function, its' arguments follow each other: name[..][..]
+template<class Number>
+void BasicProgram<Number>::_CompileExpression(size_t& t, Function func, unsigned int native)
+{
+   // find corresponding closing bracket
+   size_t end = t + 1;
+   for(int bracket_cnt = 0; ; ++end){
+      if(end >= _tokens.size())
+         throw ErrorMsg(this, "No closing bracket for expression");
+      if(_tokens[end].type == Token::OPEN) // found internal sub-expression
+         ++bracket_cnt;
+      else if(_tokens[end].type == Token::CLOSE && --bracket_cnt < 0)
+         break;
+   }
+   if(_debug_level > 2)
+      cout << "Expr to compile: " << _lexeme.substr(_tokens[t].start, _tokens[end].start - _tokens[t].start + 1) << endl;
+
+   if(++t == end) // nothing inside the brackets
+      throw ErrorMsg(this, "Ill-formed expression");
+   if(func == EXISTS){ // the argument is the named parameter itself, not its' value
+      if(end != t + 2 || _tokens[t].type != Token::PARAMETER || _tokens[t+1].type != Token::NAME)
+         throw ErrorMsg(this, "Ill-formed EXISTS expression");
+      _AddOperation(Operation::DEFINED, 0.0, _NamedSlot(_lexeme.substr(_tokens[t+1].start, _tokens[t+1].len)));
+      t = end + 1;
+      return;
+   }
+   _CompileBinary(t, end, 1);
+   t = end + 1; // after the closing bracket
+
+   if(func == ATAN){ // special case in LinuxCNC
+      if(t+1 >= _tokens.size() || _tokens[t].type != Token::OPERATOR || _tokens[t].op != Operation::DIVIDE ||
+         _tokens[t+1].type != Token::OPEN) // double argument expression
+            throw ErrorMsg(this, "Ill-formed ATAN expression");
+      ++t;
+      _CompileExpression(t, NO_FUNCTION);
+   }
+   if(func == NATIVE){
+      for(unsigned int arg=1; arg<_natives[native].arity; ++arg){
+         if(t >= _tokens.size() || _tokens[t].type != Token::OPEN)
+            throw ErrorMsg(this, "Function %s expects %d arguments", _natives[native].name.c_str(), _natives[native].arity);
+         _CompileExpression(t, NO_FUNCTION);
+      }
+   }
+   if(func != NO_FUNCTION)
+      _AddOperation(Operation::FUNCTION, 0.0, native, func);
+}
+
+
+///////  C o m p i l e B i n a r y  ///////
+// precedence climbing: operators with the same precedence are processed left-to-right
+// compiles operands and operators with at least <precedence> until the token <end>
+template<class Number>
+void BasicProgram<Number>::_CompileBinary(size_t& t, size_t end, int precedence)
+{
+   _CompileUnary(t, end);
+   while(t < end){
+      if(_tokens[t].type != Token::OPERATOR){
+         if(_tokens[t].type == Token::ASSIGN)
+            throw ErrorMsg(this, "Assignments are not allowed inside expressions");
+         throw ErrorMsg(this, "Unexpected character after the value");
+      }
+      Operation::Code code = _tokens[t].op;
+      int op_precedence = _Precedence(code);
+      if(op_precedence < precedence)
+         return; // to be processed by the caller
+      ++t;
+      _CompileBinary(t, end, op_precedence + 1);
+      _AddOperation(code);
+   }
+}
+
+
+///////  C o m p i l e U n a r y  ///////
+// sign is applied directly to the operand which follows
+template<class Number>
+void BasicProgram<Number>::_CompileUnary(size_t& t, size_t end)
+{
+   if(t < end && _tokens[t].type == Token::OPERATOR){
+      if(_tokens[t].op == Operation::ADD){ // ignore positive sign
+         _CompileUnary(++t, end);
+         return;
+      }
+      if(_tokens[t].op == Operation::SUBTRACT){ // invert value with the negative sign
+         _CompileUnary(++t, end);
+         _AddOperation(Operation::NEGATE);
+         return;
+      }
+   }
+   _CompilePrimary(t, end, true);
+}
+
+
+///////  C o m p i l e P r i m a r y  ///////
+// immediate value, parameter, expression in brackets or function
+// <expressions> enables expressions in brackets (not allowed in messages)
+template<class Number>
+void BasicProgram<Number>::_CompilePrimary(size_t& t, size_t end, bool expressions)
+{
+   if(t >= end)
+      throw ErrorMsg(this, "Empty operand");
+
+   const Token& token = _tokens[t];
+   if(token.type == Token::PARAMETER){
+      // process recursive parameter referencing (aka ###..)
+      unsigned int nref = 0; // number of "#" as recursive parameters
+      for(; t < end && _tokens[t].type == Token::PARAMETER; ++t)
+         ++nref;
+
+      // named parameter: its' value is the index of the remaining references
+      if(t < end && _tokens[t].type == Token::NAME){
+         _AddOperation(Operation::NAMED, 0.0, _NamedSlot(_lexeme.substr(_tokens[t].start, _tokens[t].len)));
+         ++t;
+         if(nref > 1)
+            _AddOperation(Operation::PARAMETER, 0.0, nref - 1);
+         return;
+      }
+
+      // parameter index is a number or an expression
+      if(t < end && _tokens[t].type == Token::NUMBER && _lexeme[_tokens[t].start] != '.')
+         _AddOperation(Operation::NUMBER, _tokens[t++].value);
+      else if(_IsOperand(t, end, expressions))
+         _CompilePrimary(t, end, expressions);
+      else
+         throw ErrorMsg(this, "Error in parameter index");
+      _AddOperation(Operation::PARAMETER, 0.0, nref);
+      return;
+   }
+
+   if(token.type == Token::NUMBER){
+      _AddOperation(Operation::NUMBER, token.value);
+      ++t;
+      return;
+   }
+
+   if(expressions){
+      if(token.type == Token::OPEN){
+         _CompileExpression(t, NO_FUNCTION);
+         return;
+      }
+      if(_IsOperand(t, end, expressions)){ // function
+         size_t name_len;
+         unsigned int native = 0;
+         Function func = _FindFunction(_tokens[t++], name_len, &native);
+         _CompileExpression(t, func, native);
+         return;
+      }
+   }
+   throw ErrorMsg(this, "Unexpected operand");
+}
+
+
+///////  N a m e d S l o t  ///////
+// slot of the named parameter in the current scope, the new one is added for the first use
+template<class Number>
+unsigned int BasicProgram<Number>::_NamedSlot(const string& name)
+{
+   bool global = (name[0] == '_');
+   unsigned int block = global? NO_BLOCK: _compiling_sub;
+   string key = global? name: name + '>' + to_string(block); // '>' can't be a part of the name
+   auto id = _named_ids.find(key);
+   if(id != _named_ids.end())
+      return id->second;
+
+   unsigned int slot = static_cast<unsigned int>(_named.size());
+   NamedParameter param = {name, block, global};
+   _named.push_back(param);
+   _named_ids[key] = slot;
+   _named_values.push_back(Number());
+   _named_defined.push_back(0);
+   if(block != NO_BLOCK)
+      _blocks[block].named.push_back(slot);
+   if(_debug_level > 1)
+      cout << "Named parameter #<" << name << "> in slot " << slot << endl;
+   return slot;
+}
+
+
+///////  F i n d S l o t  ///////
+// slot of the global named parameter, NO_SLOT if the program doesn't use it
+template<class Number>
+unsigned int BasicProgram<Number>::_FindSlot(const string& name) const
+{
+   auto id = _named_ids.find(name);
+   return (id != _named_ids.end())? id->second: NO_SLOT;
+}
+
+
+///////  P r e c e d e n c e  ///////
+// of the binary operator
+template<class Number>
+int BasicProgram<Number>::_Precedence(Operation::Code code) const
+{
+   switch(code){
+      case Operation::AND: case Operation::OR: case Operation::XOR:
+         return 1;
+      case Operation::EQ: case Operation::NE: case Operation::LT:
+      case Operation::LE: case Operation::GT: case Operation::GE:
+         return 2;
+      case Operation::ADD: case Operation::SUBTRACT:
+         return 3;
+      case Operation::MULTIPLY: case Operation::DIVIDE: case Operation::MODULO:
+         return 4;
+      case Operation::POWER:
+         return 5;
+      default:
+         return 0;
+   }
+}
+
+
+//////////  A d d E r r o r  //////////
+// the error is thrown only when (and if) the line is executed
+template<class Number>
+void BasicProgram<Number>::_AddError(const ErrorMsg& err)
+{
+   string text(err.what());
+   size_t pos = text.find("): "); // skip the line number, it is added again at run time
+   if(pos != string::npos)
+      text.erase(0, pos+3);
+   if(_debug_level > 0)
+      cout << "Postponed error in line " << _current_line << ": " << text << endl;
+   _AddInstruction(Instruction::ERROR, _AddLiteral(text));
+}
+
+
+template class gsharp::BasicProgram<double>;
+template class gsharp::BasicProgram<float>;
+template class gsharp::BasicProgram<gsharp::Fixed>;
@@ -0,0 +1,516 @@
+/*
+ *  Copyright 2016, Night Road Software (https://github.com/nrsoft)
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are
+ *  met:
+ *
+ *      * Redistributions of source code must retain the above copyright
+ *  notice, this list of conditions and the following disclaimer.
+ *      * Redistributions in binary form must reproduce the above
+ *  copyright notice, this list of conditions and the following disclaimer
+ *  in the documentation and/or other materials provided with the
+ *  distribution.
+ *      * Neither the name of "Night Road Software" nor the names of its
+ *  contributors may be used to endorse or promote products derived from
+ *  this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <cstdio>
+#include <clocale>
+#include <ostream>
+#include <sstream>
+#include <set>
+#include "gsharp_program.h"
+#include "gsharp_except.h"
+
+using namespace std;
+using namespace gsharp;
+
+namespace
+{
+
+// double constant for the emitted code, the same value after compilation
+string EmitNumber(double value)
+{
+   if(std::isnan(value))
+      return signbit(value)? "(-std::numeric_limits<double>::quiet_NaN())": "std::numeric_limits<double>::quiet_NaN()";
+   if(std::isinf(value))
+      return (value < 0)? "(-std::numeric_limits<double>::infinity())": "std::numeric_limits<double>::infinity()";
+   char buf[32];
+   snprintf(buf, sizeof(buf), "%.17g", value);
+   string str(buf);
+   string point = localeconv()->decimal_point; // C++ code, whatever the locale is
+   size_t pos = str.find(point);
+   if(point != "." && pos != string::npos)
+      str.replace(pos, point.size(), ".");
+   if(str.find_first_of(".e") == string::npos)
+      str += ".0"; // not an integer
+   return signbit(value)? "(" + str + ")": str;
+}
+
+// string constant for the emitted code
+string EmitLiteral(const string& text)
+{
+   string str("\"");
+   for(unsigned char c: text){
+      if(c == '"' || c == '\\'){
+         str += '\\';
+         str += c;
+      }
+      else if(c < ' ' || c > '~'){
+         char buf[8];
+         snprintf(buf, sizeof(buf), "\\%03o", c);
+         str += buf;
+      }
+      else
+         str += c;
+   }
+   return str + '"';
+}
+
+} // namespace
+
+
+///////////  E m i t  C p p  ///////////
+// every instruction becomes a case of the switch by the program counter, so the execution
+//  can continue from any of them on the next Step(), while the jumps known at load time are direct
+// long programs are split into several functions (by lines), otherwise they take ages to compile
+// the caches, the replay of steady loops and the remembered sub calls are not used:
+//  they don't change the output of the program
+// the named parameters and the host subs are not supported by the runtime
+template<class Number>
+void BasicProgram<Number>::EmitCpp(ostream& out, const string& name) const
+{
+   if(!_named.empty())
+      throw ErrorMsg(this, "Named parameter #<%s> is not supported by the emitted code", _named[0].name.c_str());
+   for(const auto& control: _controls)
+      if(control.native != NO_NATIVE)
+         throw ErrorMsg(this, "Sub %d of the host is not supported by the emitted code", control.number);
+
+   // the first instruction of every function
+   vector<size_t> parts(1, 0);
+   for(auto start: _line_start)
+      if(start - parts.back() >= EMIT_FUNCTION_SIZE)
+         parts.push_back(start);
+   parts.push_back(_bytecode.size());
+
+   out << "// generated from G# program by g#2g, do not edit\n";
+   out << "#include <limits>\n";
+   out << "#include <algorithm>\n";
+   out << "#include \"gsharp_runtime.h\"\n\n";
+   out << "class " << name << ": public gsharp::runtime::Machine\n{\npublic:\n";
+   out << "   " << name << "(): Machine(" << _program_start << ", " << _program_end << ", " << _blocks.size() << ")\n   {\n";
+   for(const auto& ins: _bytecode)
+      if(ins.code == Instruction::PLAIN)
+         out << "      _AddPlain(" << EmitLiteral(_literals[ins.first]) << ");\n";
+   out << "   }\n\nprotected:\n";
+
+   // the function with the current instruction is called until the line is ready
+   size_t total = parts.size() - 1;
+   out << "   virtual bool _Run(std::string& line, gsharp::ExtraInfo& extra)\n   {\n";
+   out << "      static const size_t ends[] = {";
+   for(size_t k=1; k<=total; ++k)
+      out << ((k > 1)? ", ": "") << parts[k];
+   out << "};\n";
+   out << "      static Status (" << name << "::* const parts[])(std::string&, gsharp::ExtraInfo&) = {";
+   for(size_t k=0; k<total; ++k)
+      out << ((k > 0)? ", ": "") << "&" << name << "::_Run" << k;
+   out << "};\n";
+   out << "      for(;;){\n";
+   out << "         Status status = (this->*parts[std::upper_bound(ends, ends + " << total << ", _pc) - ends])(line, extra);\n";
+   out << "         if(status != DISPATCH)\n";
+   out << "            return status == LINE_READY;\n";
+   out << "      }\n   }\n";
+
+   size_t plain = 0;
+   for(size_t k=0; k<total; ++k){
+      // the code of every instruction, the direct jumps are collected on the way
+      set<size_t> labels;
+      vector<string> code;
+      for(size_t pc=parts[k]; pc<parts[k+1]; ++pc){
+         ostringstream ss;
+         unsigned int temp = 0;
+         _EmitInstruction(pc, plain, parts[k], parts[k+1], ss, temp, labels);
+         code.push_back(ss.str());
+         if(_bytecode[pc].code == Instruction::PLAIN)
+            ++plain;
+      }
+
+      out << "\n   // instructions " << parts[k] << "-" << (parts[k+1] - 1) << "\n";
+      out << "   Status _Run" << k << "(std::string& line, gsharp::ExtraInfo& extra)\n   {\n";
+      out << "      for(;;){\n         switch(_pc){\n";
+      for(size_t pc=parts[k]; pc<parts[k+1]; ++pc){
+         out << "         case " << pc << ":";
+         if(labels.count(pc))
+            out << " L_" << pc << ":";
+         out << "{\n";
+         if(_bytecode[pc].line != 0)
+            out << "            _line = " << _bytecode[pc].line << ";\n";
+         out << code[pc - parts[k]] << "         }\n";
+      }
+      out << "            _pc = " << parts[k+1] << ";\n";
+      out << "            return DISPATCH;\n";
+      out << "         default:\n            return DISPATCH;\n";
+      out << "         }\n      }\n   }\n";
+   }
+   out << "};\n\n";
+   out << "#ifdef GSHARP_MAIN\n";
+   out << "int main(int argc, char* argv[])\n{\n";
+   out << "   return gsharp::runtime::Main<" << name << ">(argc, argv);\n}\n";
+   out << "#endif // GSHARP_MAIN\n";
+}
+
+
+///////////  E m i t  I n s t r u c t i o n  ///////////
+// the code of the instruction <pc>, <plain> is the index of the plain line
+// the function contains instructions [<first>, <last>), the targets of the direct jumps are added to <labels>
+template<class Number>
+void BasicProgram<Number>::_EmitInstruction(size_t pc, size_t plain, size_t first, size_t last, ostream& out,
+                                            unsigned int& temp, set<size_t>& labels) const
+{
+   static const char* names[] = {"sub", "call", "return", "if", "elseif", "else",
+                                 "while", "endwhile", "repeat", "endrepeat", "break", "continue", "do"};
+   const string indent(12, ' ');
+   const Instruction& ins = _bytecode[pc];
+
+   // direct jump inside this function, otherwise through _Run()
+   // <flush>: returns to the caller if there are messages on this line
+   bool flush_used = false;
+   auto jump = [&](size_t target, bool flush){
+      if(flush){
+         flush_used = true;
+         return "{_pc = " + to_string(target) + "; goto F_" + to_string(pc) + ";}";
+      }
+      if(target < first || target >= last)
+         return "{_pc = " + to_string(target) + "; return DISPATCH;}";
+      labels.insert(target);
+      return "goto L_" + to_string(target) + ";";
+   };
+
+   if(ins.code == Instruction::VALUE || ins.code == Instruction::COMMIT || ins.code == Instruction::ERROR ||
+      ins.code == Instruction::ENTER || ins.code == Instruction::LEAVE || ins.code >= Instruction::SUB)
+      out << indent << "_pc = " << (pc + 1) << "; // the next Step() continues here after an error\n";
+   switch(ins.code){
+      case Instruction::TEXT:
+         out << indent << "_output += " << EmitLiteral(_literals[ins.data]) << ";\n";
+         return;
+
+      case Instruction::VALUE:{
+         const Operand& op = _operands[ins.first];
+         string value = _EmitExpression(op.first, op.first + op.count, out, temp);
+         out << indent << "_Value(" << value << ", " << ins.data << ");\n";
+         return;
+      }
+
+      case Instruction::ASSIGN:
+         out << indent << "_Assign();\n";
+         return;
+
+      case Instruction::COMMIT:{
+         // the assignments of this line, in the same order
+         vector<unsigned int> targets;
+         for(size_t i=pc; i>0 && _bytecode[i-1].line == ins.line && _bytecode[i-1].code != Instruction::COMMIT; --i)
+            if(_bytecode[i-1].code == Instruction::ASSIGN)
+               targets.insert(targets.begin(), _bytecode[i-1].data);
+         // after an error the line is continued without the assignments made before
+         if(!targets.empty())
+            out << indent << "size_t skipped = " << targets.size() << " - _pending.size();\n";
+         for(size_t i=0; i<targets.size(); ++i){
+            out << indent << "if(skipped <= " << i << "){\n";
+            out << indent << "   double value = _Pending(" << i << " - skipped);\n";
+            ostringstream ss;
+            string target = _EmitTarget(_operands[targets[i]], ss, temp);
+            out << ss.str() << indent << "   " << target << " = value;\n";
+            out << indent << "}\n";
+         }
+         out << indent << "_Commit();\n";
+         return;
+      }
+
+      case Instruction::MESSAGE:
+         out << indent << "_Message(extra, " << ins.data << ");\n";
+         return;
+
+      case Instruction::BLOCK_DELETE:
+         out << indent << "if(_block_delete) " << jump(ins.data + 1, false) << "\n";
+         return;
+
+      case Instruction::OUTPUT:
+         out << indent << "if(_Output(line, extra, " << (pc + 1) << ")) return LINE_READY;\n";
+         out << indent << "if(_pc != " << (pc + 1) << ") continue;\n";
+         return;
+
+      case Instruction::PLAIN:
+         out << indent << "_pc = " << (ins.flush? _program_end: pc + 1) << ";\n";
+         out << indent << "line = _formatted[" << plain << "];\n";
+         out << indent << "return LINE_READY;\n";
+         return;
+
+      case Instruction::FLUSH:
+         out << indent << "if(extra.FirstNonEmpty()){_pc = " << (pc + 1) << "; line.clear(); return LINE_READY;}\n";
+         return;
+
+      case Instruction::ERROR:
+         out << indent << "_Throw(\"%s\", " << EmitLiteral(_literals[ins.data]) << ");\n";
+         return;
+
+      case Instruction::ENTER:{
+         const InlineCall& call = _inline_calls[ins.data];
+         _EmitArguments(ins, out, temp);
+         out << indent << "_CheckStack(" << call.number << ");\n";
+         for(auto i: call.locals)
+            out << indent << "_saved_locals[" << i << "] = _locals[" << i << "];\n";
+         for(unsigned int i=0; i<ins.count && i<TOTAL_LOCAL_PARAMETERS; ++i)
+            out << indent << "_locals[" << i << "] = a" << i << ";\n";
+         if(ins.flush)
+            out << indent << "if(extra.FirstNonEmpty()){_pc = " << (pc + 1) << "; line.clear(); return LINE_READY;}\n";
+         return;
+      }
+
+      case Instruction::LEAVE:
+         _EmitArguments(ins, out, temp);
+         if(ins.count > 0)
+            out << indent << "_params[" << (RETURN_VALUE_PARAMETER - 1) << "] = a0;\n";
+         for(auto i: _inline_calls[ins.data].locals)
+            out << indent << "_locals[" << i << "] = _saved_locals[" << i << "];\n";
+         if(ins.flush)
+            out << indent << "if(extra.FirstNonEmpty()){_pc = " << (pc + 1) << "; line.clear(); return LINE_READY;}\n";
+         return;
+
+      case Instruction::END:
+         out << indent << "_pc = " << pc << ";\n";
+         out << indent << "line.clear();\n";
+         out << indent << "return PROGRAM_END;\n";
+         return;
+
+      default: // o-word commands
+         break;
+   }
+
+   const Control& control = _controls[ins.data];
+   if(control.block == NO_BLOCK){
+      out << indent << "_Throw(\"O-block number %d is not found\", " << control.number << ");\n";
+      return;
+   }
+   const CodeBlock& block = _blocks[control.block];
+   const string run_times = "_run_times[" + to_string(control.block) + "]";
+
+   switch(ins.code){
+      case Instruction::SUB:
+      case Instruction::BREAK:
+         out << indent << jump(control.exit, ins.flush) << "\n";
+         break;
+      case Instruction::CONTINUE:
+      case Instruction::ENDWHILE:
+         out << indent << jump(control.jump, ins.flush) << "\n";
+         break;
+      case Instruction::DO:
+         break;
+      case Instruction::ENDREPEAT:
+         out << indent << "if(--" << run_times << " > 0) " << jump(control.jump, ins.flush) << "\n";
+         break;
+      case Instruction::ELSE:
+         out << indent << "if(" << run_times << " != 0) " << jump(control.exit, ins.flush) << "\n";
+         break;
+
+      default:
+         _EmitArguments(ins, out, temp);
+         if(ins.code == Instruction::CALL){
+            if(block.type != CodeBlock::SUB){
+               out << indent << "_Throw(\"Cannot find sub %d to call\", " << control.number << ");\n";
+               return;
+            }
+            out << indent << "_CheckStack(" << control.number << ");\n";
+            out << indent << "_PushFrame(" << _line_start[ins.line + 1] << ", " << control.locals << "u);\n";
+            for(unsigned int i=0; i<ins.count && i<TOTAL_LOCAL_PARAMETERS; ++i)
+               out << indent << "_locals[" << i << "] = a" << i << ";\n";
+            out << indent << jump(control.jump, ins.flush) << "\n";
+            break;
+         }
+         if(ins.code == Instruction::RETURN){
+            if(ins.count > 0)
+               out << indent << "_params[" << (RETURN_VALUE_PARAMETER - 1) << "] = a0;\n";
+            out << indent << "_PopFrame(" << control.number << ");\n";
+            if(ins.flush)
+               out << indent << "if(extra.FirstNonEmpty()){line.clear(); return LINE_READY;}\n";
+            out << indent << "continue;\n";
+            return;
+         }
+         if(ins.count == 0){
+            out << indent << "_Throw(\"No arguments specified for '%s' command\", \"" << names[ins.code - Instruction::SUB] << "\");\n";
+            return;
+         }
+         if(ins.code == Instruction::REPEAT)
+            out << indent << run_times << " = static_cast<int>(a0);\n";
+         else if(ins.code == Instruction::WHILE){
+            out << indent << "if(a0 == 0.0) " << jump(control.exit, ins.flush) << "\n";
+            out << indent << jump(control.jump, ins.flush) << "\n";
+         }
+         else if(ins.code == Instruction::IF){ // the jump table selects the same branch as the conditions
+            out << indent << run_times << " = (a0 != 0.0)? 1: 0;\n";
+            out << indent << "if(a0 == 0.0) " << jump(control.jump, ins.flush) << "\n";
+         }
+         else if(ins.code == Instruction::ELSEIF){
+            out << indent << "if(" << run_times << " != 0) " << jump(control.exit, ins.flush) << "\n";
+            out << indent << run_times << " = (a0 != 0.0)? 1: 0;\n";
+            out << indent << "if(a0 == 0.0) " << jump(control.jump, ins.flush) << "\n";
+         }
+         break;
+   }
+
+   if(ins.flush){
+      out << indent << "_pc = " << (pc + 1) << ";\n";
+      if(flush_used)
+         out << indent.substr(3) << "F_" << pc << ":\n";
+      out << indent << "if(extra.FirstNonEmpty()){line.clear(); return LINE_READY;}\n";
+      out << indent << "continue;\n";
+   }
+}
+
+
+///////////  E m i t  A r g u m e n t s  ///////////
+// o-word command arguments, the values are placed in a0, a1, ...
+template<class Number>
+void BasicProgram<Number>::_EmitArguments(const Instruction& ins, ostream& out, unsigned int& temp) const
+{
+   for(unsigned int i=0; i<ins.count; ++i){
+      const Operand& op = _operands[ins.first + i];
+      string value = _EmitExpression(op.first, op.first + op.count, out, temp);
+      out << "            double a" << i << " = " << value << ";\n";
+   }
+}
+
+
+///////////  E m i t  E x p r e s s i o n  ///////////
+// operations in range [first, last) as C++ expression
+// the operations, which may throw, are placed into temporary variables in the order of evaluation
+template<class Number>
+string BasicProgram<Number>::_EmitExpression(size_t first, size_t last, ostream& out, unsigned int& temp) const
+{
+   // known parameter number: its value is accessed directly
+   typedef struct
+   {
+      string code;
+      bool constant;
+      double value;
+   } Term;
+   vector<Term> stack;
+   auto store = [&](const string& code){
+      string name = "t" + to_string(temp++);
+      out << "            double " << name << " = " << code << ";\n";
+      return name;
+   };
+
+   for(size_t i=first; i<last; ++i){
+      const Operation& op = _operations[i];
+      if(op.code == Operation::NUMBER){
+         stack.push_back(Term{EmitNumber(op.value), true, op.value});
+         continue;
+      }
+      if(op.code == Operation::CACHED || op.code == Operation::STORE)
+         continue; // always calculated
+      Term& lhs = stack[stack.size() - ((op.code > Operation::NEGATE && op.code < Operation::FUNCTION)? 2: 1)];
+      const string rhs = stack.back().code;
+      string code;
+      switch(op.code){
+         case Operation::PARAMETER:
+            for(unsigned int nref = op.nref; nref > 0; --nref){
+               size_t idx = lhs.constant? static_cast<size_t>(round(lhs.value)): 0;
+               if(lhs.constant && idx > 0 && idx <= TOTAL_PARAMETERS)
+                  lhs.code = ((idx <= TOTAL_LOCAL_PARAMETERS)? "_locals[": "_params[") + to_string(idx - 1) + "]";
+               else
+                  lhs.code = store("_Param(" + lhs.code + ")");
+               lhs.constant = false;
+            }
+            continue;
+         case Operation::NEGATE:
+            lhs.code = "(-" + lhs.code + ")";
+            lhs.value = -lhs.value;
+            continue;
+         case Operation::FUNCTION:
+            switch(op.func){
+               case ATAN:
+                  stack.pop_back();
+                  stack.back().code = "_Atan(" + stack.back().code + ", " + rhs + ")";
+                  stack.back().constant = false;
+                  continue;
+               case ACOS: code = store("_Acos(" + rhs + ")"); break;
+               case ASIN: code = store("_Asin(" + rhs + ")"); break;
+               case SQRT: code = store("_Sqrt(" + rhs + ")"); break;
+               case EXP:  code = store("_Exp(" + rhs + ")"); break;
+               case ROUND: code = "std::round(" + rhs + ")"; break;
+               case ABS:  code = "std::fabs(" + rhs + ")"; break;
+               case COS:  code = "_Cos(" + rhs + ")"; break;
+               case FIX:  code = "std::floor(" + rhs + ")"; break;
+               case FUP:  code = "std::ceil(" + rhs + ")"; break;
+               case SIN:  code = "_Sin(" + rhs + ")"; break;
+               case TAN:  code = "_Tan(" + rhs + ")"; break;
+               case LN:   code = "std::log(" + rhs + ")"; break;
+               case NATIVE:
+                  throw ErrorMsg(this, "Function %s is not supported by the emitted code", _natives[op.nref].name.c_str());
+               default:   code = rhs; break;
+            }
+            lhs.code = code;
+            lhs.constant = false;
+            continue;
+
+         case Operation::ADD:      code = "(" + lhs.code + " + " + rhs + ")"; break;
+         case Operation::SUBTRACT: code = "(" + lhs.code + " - " + rhs + ")"; break;
+         case Operation::MULTIPLY: code = "(" + lhs.code + " * " + rhs + ")"; break;
+         case Operation::DIVIDE:   code = "(" + lhs.code + " / " + rhs + ")"; break;
+         case Operation::MODULO:   code = "std::fmod(" + lhs.code + ", " + rhs + ")"; break;
+         case Operation::POWER:    code = "std::pow(" + lhs.code + ", " + rhs + ")"; break;
+
+         case Operation::EQ: code = "_Bool(std::fabs(" + lhs.code + " - " + rhs + ") < " + EmitNumber(TOLERANCE_EQUAL) + ")"; break;
+         case Operation::NE: code = "_Bool(std::fabs(" + lhs.code + " - " + rhs + ") >= " + EmitNumber(TOLERANCE_EQUAL) + ")"; break;
+         case Operation::LT: code = "_Bool(" + lhs.code + " < " + rhs + ")"; break;
+         case Operation::LE: code = "_Bool(" + lhs.code + " <= " + rhs + ")"; break;
+         case Operation::GT: code = "_Bool(" + lhs.code + " > " + rhs + ")"; break;
+         case Operation::GE: code = "_Bool(" + lhs.code + " >= " + rhs + ")"; break;
+
+         case Operation::AND: code = "_Bool(" + lhs.code + " != 0.0 && " + rhs + " != 0.0)"; break;
+         case Operation::OR:  code = "_Bool(" + lhs.code + " != 0.0 || " + rhs + " != 0.0)"; break;
+         case Operation::XOR: code = "_Bool((" + lhs.code + " != 0.0) != (" + rhs + " != 0.0))"; break;
+         default: break;
+      }
+      lhs.code = code;
+      lhs.constant = false;
+      stack.pop_back(); // binary operation: the result replaces the left operand
+   }
+   return stack.back().code;
+}
+
+
+///////////  E m i t  T a r g e t  ///////////
+// the parameter to assign, all its references except the last one are unwound
+template<class Number>
+string BasicProgram<Number>::_EmitTarget(const Operand& target, ostream& out, unsigned int& temp) const
+{
+   const Operation& param = _operations[target.first + target.count - 1];
+   const Operation& index = _operations[target.first];
+   if(target.count == 2 && index.code == Operation::NUMBER && param.nref == 1){
+      size_t idx = static_cast<size_t>(round(index.value));
+      if(idx > 0 && idx <= TOTAL_PARAMETERS)
+         return ((idx <= TOTAL_LOCAL_PARAMETERS)? "_locals[": "_params[") + to_string(idx - 1) + "]";
+   }
+   string value = _EmitExpression(target.first, target.first + target.count - 1, out, temp);
+   return "_Target(" + value + ", " + to_string(param.nref) + ")";
+}
+
+
+template class gsharp::BasicProgram<double>;
+template class gsharp::BasicProgram<float>;
+template class gsharp::BasicProgram<gsharp::Fixed>;
@@ -46,7 +46,8 @@ class ErrorMsg: public exception
 {
 public:
 //TODO: convert interface to C++ streaming style (from old C 'printf' style)?
-   ErrorMsg(const Program* p, const char* fmt, ...)
+   template<class Number>
+   ErrorMsg(const BasicProgram<Number>* p, const char* fmt, ...)
    {
       va_list args;
       va_start(args, fmt);
@@ -0,0 +1,302 @@
+/*
+ *  Copyright 2016, Night Road Software (https://github.com/nrsoft)
+ *  All rights reserved.
+ *  
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are
+ *  met:
+ *  
+ *      * Redistributions of source code must retain the above copyright
+ *  notice, this list of conditions and the following disclaimer.
+ *      * Redistributions in binary form must reproduce the above
+ *  copyright notice, this list of conditions and the following disclaimer
+ *  in the documentation and/or other materials provided with the
+ *  distribution.
+ *      * Neither the name of "Night Road Software" nor the names of its
+ *  contributors may be used to endorse or promote products derived from
+ *  this software without specific prior written permission.
+ *  
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <iostream>
+#include "gsharp_program.h"
+#include "gsharp_except.h"
+
+using namespace std;
+using namespace gsharp;
+
+
+// memory taken by the lines of the native call kept in the journal
+template<class Call>
+inline size_t CallBytes(const Call& call)
+{
+   size_t bytes = sizeof(Call);
+   for(const auto& step: call.steps)
+      bytes += sizeof(step) + step.line.capacity();
+   return bytes;
+}
+
+
+/////////  S e t  J o u r n a l  S i z e  /////////
+// the replay or the recording in progress is cancelled, the steps continue as usual
+template<class Number>
+void BasicProgram<Number>::SetJournalSize(size_t bytes)
+{
+   _journal.size = bytes;
+   _ClearJournal();
+   _cache_reset = ++_clock;
+   _Configure();
+}
+
+
+/////////  S t e p  B a c k  /////////
+// the steps of the journal are undone one by one, otherwise the latest checkpoint before them is restored
+//  and the rest is executed again (recorded to the journal)
+template<class Number>
+void BasicProgram<Number>::StepBack(size_t steps)
+{
+   if(_journal.size == 0)
+      throw ErrorMsg(this, "The journal of the steps is disabled");
+
+   auto& checkpoints = _journal.checkpoints;
+   if(steps <= _journal.steps.size()){
+      for(; steps > 0; --steps)
+         _UndoStep();
+   }
+   else{
+      size_t target = (steps <= _steps)? _steps - steps: 0;
+      size_t found = checkpoints.size();
+      while(found > 0 && checkpoints[found-1].first > target)
+         --found;
+      if(steps > _steps || found == 0)
+         throw ErrorMsg(this, "Cannot step back %d steps, the journal has started later", static_cast<int>(steps));
+      checkpoints.resize(found);
+      _RestoreState(*checkpoints.back().second);
+      _journal.steps.clear();
+      _journal.writes.clear();
+      _journal.frames.clear();
+      _journal.calls.clear();
+      _journal.bytes = 0;
+      _Seek(target - _steps, true);
+   }
+   while(!checkpoints.empty() && checkpoints.back().first > _steps)
+      checkpoints.pop_back(); // the program may take another way from here
+   _cache_reset = ++_clock; // the loop-invariant values may be calculated later
+   if(_debug_level > 1)
+      cout << "Stepped back to line " << _last_used_line << endl;
+}
+
+
+/////////  S t a r t  J o u r n a l  S t e p  /////////
+// the replay or the recording of the call, which has started before the journal, can't be undone
+// the checkpoints are taken every <interval> steps, every second one is dropped when there are too many
+template<class Number>
+void BasicProgram<Number>::_StartJournalStep()
+{
+   _journal.recording = (_replay.mode == Replay::NONE && _memo.mode != SubMemo::RECORDING);
+   if(!_journal.recording){
+      _ClearJournal();
+      return;
+   }
+
+   auto& checkpoints = _journal.checkpoints;
+   if(checkpoints.empty() || _steps >= checkpoints.back().first + _journal.interval){
+      if(checkpoints.size() == JOURNAL_CHECKPOINTS){
+         for(size_t i=1; 2*i < checkpoints.size(); ++i)
+            checkpoints[i] = move(checkpoints[2*i]);
+         checkpoints.resize((checkpoints.size() + 1) / 2);
+         _journal.interval *= 2;
+      }
+      checkpoints.emplace_back(_steps, make_shared<ExecutionState>());
+      _SaveState(*checkpoints.back().second);
+   }
+
+   JournalStep step = {_pc, _last_used_line, _loop_back, _memo.mode == SubMemo::SERVING, _memo.served, _memo.next, 0};
+   _journal.steps.push_back(step);
+   _journal.bytes += sizeof(JournalStep);
+}
+
+
+/////////  J o u r n a l  /////////
+// called before the write (after the push of the frame), keeps the value to restore by StepBack()
+template<class Number>
+void BasicProgram<Number>::_Journal(typename JournalWrite::Kind kind, unsigned int index)
+{
+   JournalWrite write = {kind, index, Number(), 0};
+   switch(kind){
+      case JournalWrite::GLOBAL:
+         write.value = _params[index];
+         break;
+      case JournalWrite::LOCAL:
+         write.value = _local_params[index];
+         break;
+      case JournalWrite::SAVED_LOCAL:
+         write.value = _saved_locals[index];
+         break;
+      case JournalWrite::NAMED: // the value is assigned together with the flag
+         _Journal(JournalWrite::DEFINED, index);
+         write.value = _named_values[index];
+         break;
+      case JournalWrite::DEFINED:
+         write.value = _named_defined[index]? Number(1): Number();
+         break;
+      case JournalWrite::RUN_TIMES:
+         write.run_times = _blocks[index].run_times;
+         break;
+      case JournalWrite::FRAME_VALUE:
+         write.value = _frame_values[index];
+         break;
+      case JournalWrite::PUSH:
+         break;
+      case JournalWrite::POP:{ // the return restores the parameters and drops the values of the frame
+         const Frame& frame = _frames.back();
+         unsigned int saved = frame.saved;
+         for(unsigned int i=0; saved != 0; ++i, saved >>= 1)
+            if(saved & 1)
+               _Journal(JournalWrite::LOCAL, i);
+         if(frame.block != NO_BLOCK)
+            for(auto slot: _blocks[frame.block].named)
+               _Journal(JournalWrite::NAMED, slot);
+         for(size_t pos=frame.values; pos<_frame_values.size(); ++pos)
+            _Journal(JournalWrite::FRAME_VALUE, static_cast<unsigned int>(pos));
+         write.index = static_cast<unsigned int>(_frame_values.size() - frame.values);
+         _journal.frames.push_back(frame);
+         _journal.bytes += sizeof(Frame);
+         break;
+      }
+      case JournalWrite::NATIVE_CALL:
+         _journal.bytes += CallBytes(_native_call);
+         _journal.calls.push_back(move(_native_call));
+         break;
+   }
+   _journal.writes.push_back(write);
+   _journal.bytes += sizeof(JournalWrite);
+   ++_journal.steps.back().writes;
+}
+
+
+/////////  U n d o  S t e p  /////////
+// the writes are undone in the reverse order
+template<class Number>
+void BasicProgram<Number>::_UndoStep()
+{
+   const JournalStep& step = _journal.steps.back();
+   for(size_t w=0; w<step.writes; ++w){
+      const JournalWrite& write = _journal.writes.back();
+      switch(write.kind){
+         case JournalWrite::GLOBAL:
+            _params.Ref(write.index) = write.value;
+            break;
+         case JournalWrite::LOCAL:
+            _local_params[write.index] = write.value;
+            break;
+         case JournalWrite::SAVED_LOCAL:
+            _saved_locals[write.index] = write.value;
+            break;
+         case JournalWrite::NAMED:
+            _named_values[write.index] = write.value;
+            break;
+         case JournalWrite::DEFINED:
+            _named_defined[write.index] = (write.value != Number())? 1: 0;
+            break;
+         case JournalWrite::RUN_TIMES:
+            _blocks[write.index].run_times = write.run_times;
+            break;
+         case JournalWrite::FRAME_VALUE:
+            _frame_values[write.index] = write.value;
+            break;
+         case JournalWrite::PUSH:
+            _frame_values.resize(_frames.back().values);
+            _frames.pop_back();
+            break;
+         case JournalWrite::POP:
+            _frames.push_back(_journal.frames.back());
+            _frame_values.resize(_frames.back().values + write.index); // the values follow
+            _journal.frames.pop_back();
+            _journal.bytes -= sizeof(Frame);
+            break;
+         case JournalWrite::NATIVE_CALL:
+            _journal.bytes -= CallBytes(_journal.calls.back());
+            _native_call = move(_journal.calls.back());
+            _journal.calls.pop_back();
+            break;
+      }
+      _journal.writes.pop_back();
+      _journal.bytes -= sizeof(JournalWrite);
+   }
+
+   _pc = step.pc;
+   _last_used_line = step.last_used_line;
+   _loop_back = step.loop_back;
+   _memo.mode = step.serving? SubMemo::SERVING: SubMemo::NONE;
+   _memo.served = step.served;
+   _memo.next = step.next;
+   _journal.steps.pop_back();
+   _journal.bytes -= sizeof(JournalStep);
+   --_steps;
+}
+
+
+/////////  T r i m  J o u r n a l  /////////
+// drops the oldest steps once the journal takes more than its' size, a quarter of it at once,
+//  so the rest of the steps is moved to the front rarely
+template<class Number>
+void BasicProgram<Number>::_TrimJournal()
+{
+   if(_journal.bytes <= _journal.size)
+      return;
+   size_t steps = 0, writes = 0, frames = 0, calls = 0;
+   while(_journal.bytes > _journal.size - _journal.size / 4 && steps < _journal.steps.size()){
+      for(size_t w=_journal.steps[steps].writes; w>0; --w, ++writes){
+         if(_journal.writes[writes].kind == JournalWrite::POP){
+            ++frames;
+            _journal.bytes -= sizeof(Frame);
+         }
+         else if(_journal.writes[writes].kind == JournalWrite::NATIVE_CALL)
+            _journal.bytes -= CallBytes(_journal.calls[calls++]);
+         _journal.bytes -= sizeof(JournalWrite);
+      }
+      ++steps;
+      _journal.bytes -= sizeof(JournalStep);
+   }
+   _journal.steps.erase(_journal.steps.begin(), _journal.steps.begin() + steps);
+   _journal.writes.erase(_journal.writes.begin(), _journal.writes.begin() + writes);
+   _journal.frames.erase(_journal.frames.begin(), _journal.frames.begin() + frames);
+   _journal.calls.erase(_journal.calls.begin(), _journal.calls.begin() + calls);
+}
+
+
+/////////  C l e a r  J o u r n a l  /////////
+template<class Number>
+void BasicProgram<Number>::_ClearJournal()
+{
+   if(_journal.size == 0){ // disabled: the memory goes back
+      vector<JournalStep>().swap(_journal.steps);
+      vector<JournalWrite>().swap(_journal.writes);
+      vector<Frame>().swap(_journal.frames);
+      vector<SubCall>().swap(_journal.calls);
+   }
+   _journal.steps.clear();
+   _journal.writes.clear();
+   _journal.frames.clear();
+   _journal.calls.clear();
+   _journal.checkpoints.clear();
+   _journal.bytes = 0;
+   _journal.recording = false;
+   _journal.interval = JOURNAL_INTERVAL;
+}
+
+
+template class gsharp::BasicProgram<double>;
+template class gsharp::BasicProgram<float>;
+template class gsharp::BasicProgram<gsharp::Fixed>;
@@ -0,0 +1,110 @@
+/*
+ *  Copyright 2016, Night Road Software (https://github.com/nrsoft)
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are
+ *  met:
+ *
+ *      * Redistributions of source code must retain the above copyright
+ *  notice, this list of conditions and the following disclaimer.
+ *      * Redistributions in binary form must reproduce the above
+ *  copyright notice, this list of conditions and the following disclaimer
+ *  in the documentation and/or other materials provided with the
+ *  distribution.
+ *      * Neither the name of "Night Road Software" nor the names of its
+ *  contributors may be used to endorse or promote products derived from
+ *  this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <cstdint>
+#include <algorithm>
+#include "gsharp_memory.h"
+
+using namespace std;
+using namespace gsharp;
+
+
+const size_t MonotonicArena::DEFAULT_CHUNK_SIZE;
+
+
+//////  c o n s t r u c t o r  ///////
+MonotonicArena::MonotonicArena(MemoryResource* upstream, size_t chunk_size)
+{
+   _upstream = upstream;
+   _chunk_size = _next_size = max(chunk_size, sizeof(Chunk));
+   _first_size = 0;
+   _chunks = nullptr;
+   _current = nullptr;
+   _left = 0;
+   _size = 0;
+}
+
+
+MonotonicArena::MonotonicArena(const MonotonicArena& other): MemoryResource()
+{
+   _upstream = other._upstream;
+   _chunk_size = _next_size = other._chunk_size;
+   _first_size = 0;
+   _chunks = nullptr;
+   _current = nullptr;
+   _left = 0;
+   _size = 0;
+}
+
+
+/////////  A l l o c a t e  /////////
+void* MonotonicArena::Allocate(size_t bytes, size_t alignment)
+{
+   size_t pad = (alignment - reinterpret_cast<uintptr_t>(_current) % alignment) % alignment;
+   if(_current == nullptr || pad + bytes > _left){
+      // new chunk, big enough for any alignment
+      bool sized = (_chunks == nullptr && _first_size > 0); // given to Release(), the next ones grow as usual
+      size_t size = max(sized? _first_size: _next_size, sizeof(Chunk) + bytes + alignment);
+      void* memory = (_upstream != nullptr)? _upstream->Allocate(size, alignof(Chunk)): ::operator new(size);
+      Chunk* chunk = static_cast<Chunk*>(memory);
+      chunk->next = _chunks;
+      chunk->size = size;
+      _chunks = chunk;
+      _current = reinterpret_cast<char*>(chunk) + sizeof(Chunk);
+      _left = size - sizeof(Chunk);
+      _size += size;
+      if(!sized)
+         _next_size = size * 2;
+      pad = (alignment - reinterpret_cast<uintptr_t>(_current) % alignment) % alignment;
+   }
+   void* ptr = _current + pad;
+   _current += pad + bytes;
+   _left -= pad + bytes;
+   return ptr;
+}
+
+
+/////////  R e l e a s e  /////////
+void MonotonicArena::Release(size_t first_chunk)
+{
+   while(_chunks != nullptr){
+      Chunk* chunk = _chunks;
+      _chunks = chunk->next;
+      if(_upstream != nullptr)
+         _upstream->Deallocate(chunk, chunk->size, alignof(Chunk));
+      else
+         ::operator delete(chunk);
+   }
+   _next_size = _chunk_size;
+   _first_size = first_chunk;
+   _current = nullptr;
+   _left = 0;
+   _size = 0;
+}
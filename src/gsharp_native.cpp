@@ -0,0 +1,161 @@
+/*
+ *  Copyright 2016, Night Road Software (https://github.com/nrsoft)
+ *  All rights reserved.
+ *  
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are
+ *  met:
+ *  
+ *      * Redistributions of source code must retain the above copyright
+ *  notice, this list of conditions and the following disclaimer.
+ *      * Redistributions in binary form must reproduce the above
+ *  copyright notice, this list of conditions and the following disclaimer
+ *  in the documentation and/or other materials provided with the
+ *  distribution.
+ *      * Neither the name of "Night Road Software" nor the names of its
+ *  contributors may be used to endorse or promote products derived from
+ *  this software without specific prior written permission.
+ *  
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <iostream>
+#include <exception>
+#include "gsharp_program.h"
+#include "gsharp_except.h"
+
+using namespace std;
+using namespace gsharp;
+
+
+/////////  R e g i s t e r S u b  /////////
+// the handler is resolved by the o-number when the program is loaded, the loaded program keeps the previous one
+template<class Number>
+void BasicProgram<Number>::RegisterSub(ONumber number, const SubHandler& handler)
+{
+   if(!handler){
+      _sub_handler_ids.erase(number);
+      return;
+   }
+   _sub_handler_ids[number] = static_cast<unsigned int>(_sub_handlers.size());
+   _sub_handlers.push_back(handler);
+}
+
+
+/////////  C a l l N a t i v e S u b  /////////
+// runs the handler at once, its' lines are served by the next steps the same way as the remembered sub call
+// the local parameters are preserved as for the interpreted sub, the arguments are in _arguments
+template<class Number>
+void BasicProgram<Number>::_CallNativeSub(const Instruction& ins, const Control& control)
+{
+   if(_frames.size() >= _stack_depth)
+      throw ErrorMsg(this, "Stack overflow calling sub %d", control.number);
+   size_t return_pc = _line_start[ins.line + 1];
+   _PushFrame(return_pc, (1u << TOTAL_LOCAL_PARAMETERS) - 1, NO_BLOCK);
+   size_t to_copy = min(_arguments.size(), _local_params.size());
+   for(size_t i=0; i<to_copy; ++i){
+      if(_journal.recording)
+         _Journal(JournalWrite::LOCAL, static_cast<unsigned int>(i));
+      _local_params[i] = _arguments[i];
+   }
+
+   if(_journal.recording)
+      _Journal(JournalWrite::NATIVE_CALL); // its' lines may be served again after StepBack()
+   SubCall& call = _native_call;
+   call.steps.clear();
+   call.extra.Clear();
+   call.return_line = ins.line;
+   call.has_value = false;
+   call.value = Number();
+   NativeSubCall native(*this, return_pc);
+   try{
+      _sub_handlers[control.native](native);
+   }
+   catch(ErrorMsg&){
+      _PopFrame();
+      throw;
+   }
+   catch(exception& e){
+      _PopFrame();
+      throw ErrorMsg(this, "Sub %d: %s", control.number, e.what());
+   }
+   _PopFrame(); // continues after the call
+
+   _memo.mode = SubMemo::SERVING;
+   _memo.served = &_native_call;
+   _memo.next = 0;
+   if(_debug_level > 1)
+      cout << "Serving " << call.steps.size() << " step(s) of the host sub " << control.number << endl;
+}
+
+
+/////////  N a t i v e S u b C a l l  /////////
+template<class Number>
+unsigned int BasicProgram<Number>::NativeSubCall::Arguments() const
+{
+   return static_cast<unsigned int>(_program._arguments.size());
+}
+
+
+template<class Number>
+Number BasicProgram<Number>::NativeSubCall::Argument(unsigned int index) const
+{
+   return (index < _program._arguments.size())? _program._arguments[index]: Number();
+}
+
+
+template<class Number>
+double BasicProgram<Number>::NativeSubCall::GetParam(unsigned int number) const
+{
+   return _program.GetParam(number);
+}
+
+
+template<class Number>
+void BasicProgram<Number>::NativeSubCall::SetParam(unsigned int number, double value)
+{
+   if(_program._journal.recording && number > 0 && number <= TOTAL_CNC_PARAMETERS)
+      _program._Journal((number <= TOTAL_LOCAL_PARAMETERS)? JournalWrite::LOCAL: JournalWrite::GLOBAL, number-1);
+   _program.SetParam(number, value);
+}
+
+
+template<class Number>
+void BasicProgram<Number>::NativeSubCall::Output(const string& line)
+{
+   SubCall& call = _program._native_call;
+   ReplayStep step = {line, call.extra, call.return_line, _return_pc};
+   _program._Normalize(step.line);
+   _program._FormatPretty(step.line);
+   call.steps.push_back(move(step));
+   call.extra.Clear();
+}
+
+
+template<class Number>
+void BasicProgram<Number>::NativeSubCall::Message(ExtraInfo::Type type, const string& text)
+{
+   _program._native_call.extra.Assign(type, text);
+}
+
+
+template<class Number>
+void BasicProgram<Number>::NativeSubCall::Return(Number value)
+{
+   _program._native_call.has_value = true;
+   _program._native_call.value = value;
+}
+
+
+template class gsharp::BasicProgram<double>;
+template class gsharp::BasicProgram<float>;
+template class gsharp::BasicProgram<gsharp::Fixed>;
@@ -0,0 +1,539 @@
+/*
+ *  Copyright 2016, Night Road Software (https://github.com/nrsoft)
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are
+ *  met:
+ *
+ *      * Redistributions of source code must retain the above copyright
+ *  notice, this list of conditions and the following disclaimer.
+ *      * Redistributions in binary form must reproduce the above
+ *  copyright notice, this list of conditions and the following disclaimer
+ *  in the documentation and/or other materials provided with the
+ *  distribution.
+ *      * Neither the name of "Night Road Software" nor the names of its
+ *  contributors may be used to endorse or promote products derived from
+ *  this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <string>
+#include <algorithm>
+#include "gsharp_number.h"
+
+using namespace std;
+using namespace gsharp;
+
+
+const int Fixed::FRACTION_BITS;
+const int64_t Fixed::ONE;
+const int64_t Fixed::MAX_RAW;
+const int64_t Fixed::NAN_RAW;
+
+namespace
+{
+
+// the transcendental functions are evaluated with 60 fraction bits and rounded to 32 at the end
+const int INNER_BITS = 60;
+const int64_t INNER_ONE = INT64_C(1) << INNER_BITS;
+const int64_t LN2_INNER = INT64_C(799144290325165979);
+const int64_t SQRT2_INNER = INT64_C(1630477228166597777);
+const int64_t CORDIC_GAIN_INNER = INT64_C(700114967507363239); // 1/K of 32 rotations
+
+// atan(2^-i) in degrees, 32.32
+const int CORDIC_STEPS = 32;
+const int64_t CORDIC_ANGLES[CORDIC_STEPS] = {
+   INT64_C(193273528320), INT64_C(114096026022), INT64_C(60285206653), INT64_C(30601712202),
+   INT64_C(15360239180), INT64_C(7687607525), INT64_C(3844741810), INT64_C(1922488225),
+   INT64_C(961258780), INT64_C(480631223), INT64_C(240315841), INT64_C(120157949),
+   INT64_C(60078978), INT64_C(30039490), INT64_C(15019745), INT64_C(7509872),
+   INT64_C(3754936), INT64_C(1877468), INT64_C(938734), INT64_C(469367),
+   INT64_C(234684), INT64_C(117342), INT64_C(58671), INT64_C(29335),
+   INT64_C(14668), INT64_C(7334), INT64_C(3667), INT64_C(1833),
+   INT64_C(917), INT64_C(458), INT64_C(229), INT64_C(115)
+};
+
+// exp() of larger arguments saturates, of smaller ones is below the resolution
+const int64_t EXP_MAX_RAW = INT64_C(92288378626); // ln(2^31)
+const int64_t EXP_MIN_RAW = INT64_C(-98242467570); // ln(2^-33)
+
+inline uint64_t Magnitude(int64_t raw)
+{
+   return (raw < 0)? 0 - static_cast<uint64_t>(raw): static_cast<uint64_t>(raw);
+}
+
+inline int64_t Signed(uint64_t magnitude, bool negative)
+{
+   return negative? -static_cast<int64_t>(magnitude): static_cast<int64_t>(magnitude);
+}
+
+/////////  M u l  S h i f t  ////////
+// (a * b) >> shift, rounded to nearest; false if the result doesn't fit into 63 bits
+bool MulShift(uint64_t a, uint64_t b, int shift, uint64_t& result)
+{
+#ifdef __SIZEOF_INT128__
+   unsigned __int128 product = static_cast<unsigned __int128>(a) * b;
+   product += static_cast<unsigned __int128>(1) << (shift - 1);
+   product >>= shift;
+   if(product > static_cast<uint64_t>(INT64_MAX))
+      return false;
+   result = static_cast<uint64_t>(product);
+#else
+   // 64x64 bit product from 32-bit halves
+   uint64_t a_lo = a & 0xFFFFFFFF, a_hi = a >> 32;
+   uint64_t b_lo = b & 0xFFFFFFFF, b_hi = b >> 32;
+   uint64_t ll = a_lo * b_lo, lh = a_lo * b_hi, hl = a_hi * b_lo, hh = a_hi * b_hi;
+   uint64_t middle = (ll >> 32) + (lh & 0xFFFFFFFF) + (hl & 0xFFFFFFFF);
+   uint64_t lo = (middle << 32) | (ll & 0xFFFFFFFF);
+   uint64_t hi = hh + (lh >> 32) + (hl >> 32) + (middle >> 32);
+   // rounding
+   uint64_t half = UINT64_C(1) << (shift - 1);
+   lo += half;
+   if(lo < half)
+      ++hi;
+   if((hi >> shift) != 0)
+      return false;
+   result = (hi << (64 - shift)) | (lo >> shift);
+   if(result > static_cast<uint64_t>(INT64_MAX))
+      return false;
+#endif
+   return true;
+}
+
+/////////  D i v  S h i f t  ////////
+// (a << shift) / b, rounded to nearest; false if the result doesn't fit into 63 bits
+bool DivShift(uint64_t a, uint64_t b, int shift, uint64_t& result)
+{
+#ifdef __SIZEOF_INT128__
+   unsigned __int128 dividend = static_cast<unsigned __int128>(a) << shift;
+   unsigned __int128 quotient = dividend / b;
+   uint64_t remainder = static_cast<uint64_t>(dividend % b);
+   if(remainder >= b - remainder)
+      ++quotient;
+   if(quotient > static_cast<uint64_t>(INT64_MAX))
+      return false;
+   result = static_cast<uint64_t>(quotient);
+#else
+   uint64_t hi = a >> (64 - shift), lo = a << shift;
+   if(hi >= b)
+      return false;
+   // long division, the remainder starts with the high part
+   uint64_t remainder = hi, quotient = 0;
+   for(int i=63; i>=0; --i){
+      uint64_t carry = remainder >> 63;
+      remainder = (remainder << 1) | ((lo >> i) & 1);
+      quotient <<= 1;
+      if(carry || remainder >= b){
+         remainder -= b;
+         quotient |= 1;
+      }
+   }
+   if(remainder >= b - remainder){
+      if(quotient == UINT64_MAX)
+         return false;
+      ++quotient;
+   }
+   if(quotient > static_cast<uint64_t>(INT64_MAX))
+      return false;
+   result = quotient;
+#endif
+   return true;
+}
+
+// signed product with the given number of fraction bits, saturated
+inline int64_t Multiply(int64_t a, int64_t b, int bits)
+{
+   uint64_t result;
+   if(!MulShift(Magnitude(a), Magnitude(b), bits, result))
+      result = Fixed::MAX_RAW;
+   return Signed(result, (a < 0) != (b < 0));
+}
+
+// rounds the inner value to 32.32
+inline int64_t Outer(int64_t inner)
+{
+   const int shift = INNER_BITS - Fixed::FRACTION_BITS;
+   return Signed((Magnitude(inner) + (UINT64_C(1) << (shift - 1))) >> shift, inner < 0);
+}
+
+/////////  S i n e  ////////
+// CORDIC rotation of the angle in degrees (32.32) within [-90, 90], returns the inner value
+int64_t Sine(int64_t angle)
+{
+   int64_t x = CORDIC_GAIN_INNER, y = 0;
+   for(int i=0; i<CORDIC_STEPS; ++i){
+      int64_t dx = x >> i, dy = y >> i;
+      if(angle >= 0){
+         x -= dy;
+         y += dx;
+         angle -= CORDIC_ANGLES[i];
+      }
+      else{
+         x += dy;
+         y -= dx;
+         angle += CORDIC_ANGLES[i];
+      }
+   }
+   return y;
+}
+
+} // namespace
+
+
+/////////  F i x e d  ////////
+Fixed::Fixed(double value)
+{
+   if(value != value)
+      _raw = NAN_RAW;
+   else if(value >= 2147483648.0)
+      _raw = MAX_RAW;
+   else if(value <= -2147483648.0)
+      _raw = -MAX_RAW;
+   else
+      _raw = llround(ldexp(value, FRACTION_BITS));
+}
+
+Fixed::operator double() const
+{
+   if(IsNan())
+      return numeric_limits<double>::quiet_NaN();
+   if(_raw == MAX_RAW)
+      return numeric_limits<double>::infinity();
+   if(_raw == -MAX_RAW)
+      return -numeric_limits<double>::infinity();
+   return ldexp(static_cast<double>(_raw), -FRACTION_BITS);
+}
+
+Fixed Fixed::operator*(Fixed rhs) const
+{
+   if(IsNan() || rhs.IsNan())
+      return FromRaw(NAN_RAW);
+   return FromRaw(Multiply(_raw, rhs._raw, FRACTION_BITS));
+}
+
+Fixed Fixed::operator/(Fixed rhs) const
+{
+   if(IsNan() || rhs.IsNan() || (rhs._raw == 0 && _raw == 0))
+      return FromRaw(NAN_RAW);
+   bool negative = (_raw < 0) != (rhs._raw < 0);
+   uint64_t result;
+   if(rhs._raw == 0 || !DivShift(Magnitude(_raw), Magnitude(rhs._raw), FRACTION_BITS, result))
+      result = MAX_RAW;
+   return FromRaw(Signed(result, negative));
+}
+
+
+/////////  N u m e r i c < F i x e d >  ////////
+// round half away from zero, same as std::round()
+Fixed Numeric<Fixed>::Round(Fixed arg)
+{
+   if(arg.IsNan())
+      return arg;
+   uint64_t magnitude = (Magnitude(arg.Raw()) + Fixed::ONE / 2) & ~static_cast<uint64_t>(Fixed::ONE - 1);
+   if(magnitude > static_cast<uint64_t>(Fixed::MAX_RAW))
+      magnitude = Fixed::MAX_RAW;
+   return Fixed::FromRaw(Signed(magnitude, arg.Raw() < 0));
+}
+
+Fixed Numeric<Fixed>::Floor(Fixed arg)
+{
+   if(arg.IsNan() || arg.Raw() < -Fixed::MAX_RAW + Fixed::ONE)
+      return arg;
+   return Fixed::FromRaw(arg.Raw() & ~(Fixed::ONE - 1));
+}
+
+Fixed Numeric<Fixed>::Ceil(Fixed arg)
+{
+   return -Floor(-arg);
+}
+
+// digit by digit square root of raw * 2^32, two bits at a time
+Fixed Numeric<Fixed>::Sqrt(Fixed arg)
+{
+   if(arg.IsNan() || arg.Raw() < 0)
+      return Fixed::FromRaw(Fixed::NAN_RAW);
+   uint64_t value = arg.Raw(), root = 0, remainder = 0;
+   for(int i=47; i>=0; --i){
+      // bits 2i+1 and 2i of value << 32
+      int position = 2 * i - Fixed::FRACTION_BITS;
+      uint64_t pair = (position >= 0)? (value >> position) & 3: 0;
+      remainder = (remainder << 2) | pair;
+      uint64_t trial = (root << 2) | 1;
+      root <<= 1;
+      if(remainder >= trial){
+         remainder -= trial;
+         root |= 1;
+      }
+   }
+   if(remainder > root)
+      ++root;
+   return Fixed::FromRaw(root);
+}
+
+// exp(x) = 2^k * exp(r), where |r| <= ln(2)/2 and exp(r) is the Taylor series
+Fixed Numeric<Fixed>::Exp(Fixed arg)
+{
+   if(arg.IsNan())
+      return arg;
+   int64_t x = arg.Raw();
+   if(x > EXP_MAX_RAW)
+      return Fixed::FromRaw(Fixed::MAX_RAW);
+   if(x < EXP_MIN_RAW)
+      return Fixed();
+   int64_t ln2 = Outer(LN2_INNER);
+   int k = static_cast<int>((x + ((x < 0)? -ln2 / 2: ln2 / 2)) / ln2);
+   // the exact remainder is small, wrapping of the intermediate values doesn't matter
+   uint64_t r_bits = (static_cast<uint64_t>(x) << (INNER_BITS - Fixed::FRACTION_BITS)) - static_cast<uint64_t>(k) * LN2_INNER;
+   int64_t r = static_cast<int64_t>(r_bits);
+   int64_t sum = INNER_ONE, term = INNER_ONE;
+   for(int n=1; term!=0; ++n){
+      term = Multiply(term, r, INNER_BITS) / n;
+      sum += term;
+   }
+   // scale by 2^k and round to 32.32
+   int shift = INNER_BITS - Fixed::FRACTION_BITS - k;
+   if(shift > 0)
+      return Fixed::FromRaw((sum + (INT64_C(1) << (shift - 1))) >> shift);
+   if(sum > (Fixed::MAX_RAW >> -shift))
+      return Fixed::FromRaw(Fixed::MAX_RAW);
+   return Fixed::FromRaw(sum << -shift);
+}
+
+// ln(x) = e * ln(2) + ln(m), where m is in [sqrt(2)/2, sqrt(2)) and ln(m) = 2 * atanh((m-1)/(m+1))
+Fixed Numeric<Fixed>::Ln(Fixed arg)
+{
+   int64_t x = arg.Raw();
+   if(arg.IsNan() || x < 0)
+      return Fixed::FromRaw(Fixed::NAN_RAW);
+   if(x == 0)
+      return Fixed::FromRaw(-Fixed::MAX_RAW);
+   if(x == Fixed::MAX_RAW)
+      return arg;
+   // normalize
+   int top = 62;
+   while(((x >> top) & 1) == 0)
+      --top;
+   int64_t m = (top <= INNER_BITS)? x << (INNER_BITS - top): x >> (top - INNER_BITS);
+   int e = top - Fixed::FRACTION_BITS;
+   if(m > SQRT2_INNER){
+      m = (m + 1) >> 1;
+      ++e;
+   }
+   // atanh series
+   uint64_t z = 0;
+   DivShift(Magnitude(m - INNER_ONE), m + INNER_ONE, INNER_BITS, z);
+   int64_t z2 = Multiply(z, z, INNER_BITS), term = z, sum = z;
+   for(int n=3; term!=0; n+=2){
+      term = Multiply(term, z2, INNER_BITS);
+      sum += term / n;
+   }
+   int64_t ln_m = Outer(Signed(2 * sum, m < INNER_ONE));
+   uint64_t e_ln2;
+   MulShift(Magnitude(e), LN2_INNER, INNER_BITS - Fixed::FRACTION_BITS, e_ln2);
+   return Fixed::FromRaw(Signed(e_ln2, e < 0) + ln_m);
+}
+
+// same as fmod(): the result has the sign of the dividend
+Fixed Numeric<Fixed>::Mod(Fixed lhs, Fixed rhs)
+{
+   if(lhs.IsNan() || rhs.IsNan() || rhs.Raw() == 0)
+      return Fixed::FromRaw(Fixed::NAN_RAW);
+   return Fixed::FromRaw(lhs.Raw() % rhs.Raw());
+}
+
+// same as pow(): integer exponents are exact multiplications, negative base requires them
+Fixed Numeric<Fixed>::Pow(Fixed lhs, Fixed rhs)
+{
+   if(rhs.Raw() == 0 || lhs.Raw() == Fixed::ONE)
+      return Fixed(1);
+   if(lhs.IsNan() || rhs.IsNan())
+      return Fixed::FromRaw(Fixed::NAN_RAW);
+   if((rhs.Raw() & (Fixed::ONE - 1)) == 0){
+      uint64_t n = Magnitude(rhs.Raw()) >> Fixed::FRACTION_BITS;
+      Fixed result(1), base = lhs;
+      while(n != 0){
+         if(n & 1)
+            result = result * base;
+         n >>= 1;
+         if(n != 0)
+            base = base * base;
+      }
+      return (rhs.Raw() < 0)? Fixed(1) / result: result;
+   }
+   if(lhs.Raw() > 0)
+      return Exp(rhs * Ln(lhs));
+   if(lhs.Raw() == 0)
+      return Fixed::FromRaw((rhs.Raw() > 0)? 0: Fixed::MAX_RAW);
+   return Fixed::FromRaw(Fixed::NAN_RAW);
+}
+
+// the angle is reduced to [-90, 90], multiples of 90 degrees are exact
+Fixed Numeric<Fixed>::Sin(Fixed arg)
+{
+   if(arg.IsNan())
+      return arg;
+   const int64_t right = 90 * Fixed::ONE;
+   int64_t angle = arg.Raw() % (4 * right);
+   if(angle < 0)
+      angle += 4 * right;
+   if(angle > right && angle <= 3 * right)
+      angle = 2 * right - angle;
+   else if(angle > 3 * right)
+      angle -= 4 * right;
+   if(angle == 0)
+      return Fixed();
+   if(angle == right || angle == -right)
+      return Fixed((angle > 0)? 1: -1);
+   return Fixed::FromRaw(Outer(Sine(angle)));
+}
+
+Fixed Numeric<Fixed>::Cos(Fixed arg)
+{
+   if(arg.IsNan())
+      return arg;
+   // shifted before the saturation, the angle is reduced anyway
+   const int64_t right = 90 * Fixed::ONE;
+   int64_t angle = arg.Raw() % (4 * right);
+   return Sin(Fixed::FromRaw(angle + right));
+}
+
+Fixed Numeric<Fixed>::Tan(Fixed arg)
+{
+   return Sin(arg) / Cos(arg);
+}
+
+Fixed Numeric<Fixed>::Asin(Fixed arg)
+{
+   return Atan(arg, Sqrt(Fixed(1) - arg * arg));
+}
+
+Fixed Numeric<Fixed>::Acos(Fixed arg)
+{
+   return Atan(Sqrt(Fixed(1) - arg * arg), arg);
+}
+
+// CORDIC vectoring, the left half-plane is turned by 180 degrees first
+Fixed Numeric<Fixed>::Atan(Fixed y, Fixed x)
+{
+   if(y.IsNan() || x.IsNan())
+      return Fixed::FromRaw(Fixed::NAN_RAW);
+   int64_t vx = x.Raw(), vy = y.Raw(), angle = 0;
+   if(vx == 0 && vy == 0)
+      return Fixed();
+   if(vx < 0){
+      angle = (vy >= 0)? 180 * Fixed::ONE: -180 * Fixed::ONE;
+      vx = -vx;
+      vy = -vy;
+   }
+   // scale the vector to about 2^58 for the precision, the gain of the rotations stays below 2^63
+   uint64_t magnitude = max(Magnitude(vx), Magnitude(vy));
+   while(magnitude < (UINT64_C(1) << 58)){
+      magnitude <<= 1;
+      vx *= 2;
+      vy *= 2;
+   }
+   while(magnitude >= (UINT64_C(1) << 59)){
+      magnitude >>= 1;
+      vx /= 2;
+      vy /= 2;
+   }
+   for(int i=0; i<CORDIC_STEPS; ++i){
+      int64_t dx = vx >> i, dy = vy >> i;
+      if(vy > 0){
+         vx += dy;
+         vy -= dx;
+         angle += CORDIC_ANGLES[i];
+      }
+      else{
+         vx -= dy;
+         vy += dx;
+         angle -= CORDIC_ANGLES[i];
+      }
+   }
+   return Fixed::FromRaw(angle);
+}
+
+// exact decimal digits of the value, the last one is rounded half to even (same as printf)
+int Numeric<Fixed>::Print(Fixed value, int precision, char* buf, size_t size)
+{
+   if(value.IsNan())
+      return snprintf(buf, size, "nan");
+   if(value.Raw() == Fixed::MAX_RAW)
+      return snprintf(buf, size, "inf");
+   if(value.Raw() == -Fixed::MAX_RAW)
+      return snprintf(buf, size, "-inf");
+   if(precision < 0)
+      precision = 6;
+   uint64_t magnitude = Magnitude(value.Raw());
+   uint64_t integer = magnitude >> Fixed::FRACTION_BITS;
+   uint64_t fraction = magnitude & (Fixed::ONE - 1);
+   // the fraction is exhausted after 32 digits
+   string decimals(precision, '0');
+   for(int i=0; i<precision && fraction!=0; ++i){
+      fraction *= 10;
+      decimals[i] = '0' + static_cast<char>(fraction >> Fixed::FRACTION_BITS);
+      fraction &= Fixed::ONE - 1;
+   }
+   const uint64_t half = Fixed::ONE / 2;
+   int last = (precision > 0)? decimals[precision - 1] - '0': static_cast<int>(integer & 1);
+   if(fraction > half || (fraction == half && (last & 1))){
+      int i = precision - 1;
+      for(; i>=0 && decimals[i]=='9'; --i)
+         decimals[i] = '0';
+      if(i >= 0)
+         ++decimals[i];
+      else
+         ++integer;
+   }
+   return snprintf(buf, size, "%s%llu%s%s", (value.Raw() < 0)? "-": "", static_cast<unsigned long long>(integer),
+                   (precision > 0)? ".": "", decimals.c_str());
+}
+
+// plain decimal numbers are converted exactly, the rest (exponent, inf, nan) through strtod()
+Fixed Numeric<Fixed>::Parse(const char* str, char** end)
+{
+   const char* p = str;
+   while(*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r' || *p == '\f' || *p == '\v') // the spaces of the "C" locale
+      ++p;
+   bool negative = (*p == '-');
+   if(*p == '-' || *p == '+')
+      ++p;
+   bool digits = false, overflow = false;
+   uint64_t integer = 0;
+   for(; '0' <= *p && *p <= '9'; ++p){
+      digits = true;
+      integer = integer * 10 + (*p - '0');
+      if(integer >= (UINT64_C(1) << 31)){
+         overflow = true;
+         integer = 0;
+      }
+   }
+   uint64_t decimals = 0, scale = 1;
+   if(*p == '.'){
+      for(++p; '0' <= *p && *p <= '9'; ++p){
+         digits = true;
+         if(scale < UINT64_C(1000000000000000000)){
+            decimals = decimals * 10 + (*p - '0');
+            scale *= 10;
+         }
+      }
+   }
+   if(!digits || overflow || *p == 'e' || *p == 'E' || *p == 'x' || *p == 'X')
+      return Fixed(ParseDecimal(str, end, strtod));
+   uint64_t fraction = 0;
+   DivShift(decimals, scale, Fixed::FRACTION_BITS, fraction);
+   if(end)
+      *end = const_cast<char*>(p);
+   return Fixed::FromRaw(Signed((integer << Fixed::FRACTION_BITS) + fraction, negative));
+}
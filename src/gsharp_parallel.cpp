@@ -0,0 +1,292 @@
+/*
+ *  Copyright 2016, Night Road Software (https://github.com/nrsoft)
+ *  All rights reserved.
+ *
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are
+ *  met:
+ *
+ *      * Redistributions of source code must retain the above copyright
+ *  notice, this list of conditions and the following disclaimer.
+ *      * Redistributions in binary form must reproduce the above
+ *  copyright notice, this list of conditions and the following disclaimer
+ *  in the documentation and/or other materials provided with the
+ *  distribution.
+ *      * Neither the name of "Night Road Software" nor the names of its
+ *  contributors may be used to endorse or promote products derived from
+ *  this software without specific prior written permission.
+ *
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <iostream>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include "gsharp_program.h"
+#include "gsharp_except.h"
+
+using namespace std;
+using namespace gsharp;
+
+
+/////////////  R u n  /////////////
+// the main program is split into straight regions (lines without o-words) and the rest,
+//  which is executed as usual by this instance (o-blocks, calls, etc.)
+// the regions, which don't read the parameters assigned by the previous ones, are given to the workers
+template<class Number>
+void BasicProgram<Number>::Run(const StepHandler& handler, unsigned int threads)
+{
+   if(threads == 0)
+      threads = max(1u, thread::hardware_concurrency());
+   vector<Region> regions;
+   if(threads > 1)
+      _FindRegions(regions);
+   // the workers don't record their writes: the steps of Run() are not kept in the journal
+   size_t journal = _journal.size;
+   _journal.size = 0;
+   _ClearJournal();
+
+   vector<BasicProgram> workers;
+   if(!regions.empty()){
+      // each worker keeps its own copy of the compiled program, the source code and the remembered calls are not needed
+      ArenaVector<ArenaString> code;
+      list<SubCall> calls;
+      map<vector<Number>, typename list<SubCall>::iterator> index;
+      code.swap(_code);
+      calls.swap(_sub_calls);
+      index.swap(_sub_index);
+      workers.reserve(threads);
+      for(unsigned int i=0; i<threads; ++i){
+         workers.push_back(*this);
+         workers.back().DebugLevel(0); // messages from the threads would be mixed
+      }
+      code.swap(_code);
+      calls.swap(_sub_calls);
+      index.swap(_sub_index);
+      if(_debug_level > 0)
+         cout << "Running " << regions.size() << " region(s) with " << threads << " workers" << endl;
+   }
+
+   auto next = lower_bound(regions.begin(), regions.end(), _pc,
+                           [](const Region& region, size_t pc){return region.first < pc;}) - regions.begin();
+   try{
+      for(size_t r=next; ; ){
+         if(r < regions.size() && _pc == regions[r].first && _frames.empty() &&
+            _replay.mode == Replay::NONE && _memo.mode == SubMemo::NONE){
+               r = _RunRegions(regions, r, workers, handler);
+               continue;
+         }
+         while(r < regions.size() && regions[r].first <= _pc)
+            ++r; // started inside the region, it's executed as usual
+         if(!_RunUntil((r < regions.size())? regions[r].first: _program_end, handler))
+            break; // the end of the program
+      }
+   }
+   catch(...){ // or the exception of the handler
+      _journal.size = journal;
+      throw;
+   }
+   _journal.size = journal;
+}
+
+
+/////////  F i n d R e g i o n s  /////////
+// straight regions of the main program, no longer than PARALLEL_REGION_SIZE instructions (unless it's a single line)
+// the lines of the o-blocks, o-word lines and the lines with computed parameter numbers are not included
+template<class Number>
+void BasicProgram<Number>::_FindRegions(vector<Region>& regions) const
+{
+   LineNumber lines = static_cast<LineNumber>(_line_start.size() - 2); // incl. the end of the program
+   vector<bool> inside(lines + 2, false);
+   for(const auto& block: _blocks)
+      for(LineNumber n=block.start_line; n<block.end_line; ++n)
+         inside[n] = true;
+
+   Region region = {0, 0, vector<unsigned int>(), vector<unsigned int>()};
+   auto finish = [&](){
+      if(region.last > region.first){
+         for(auto params: {&region.reads, &region.writes}){
+            sort(params->begin(), params->end());
+            params->erase(unique(params->begin(), params->end()), params->end());
+         }
+         regions.push_back(region);
+      }
+      region.first = region.last = 0;
+      region.reads.clear();
+      region.writes.clear();
+   };
+
+   vector<unsigned int> reads, writes;
+   for(LineNumber n=1; n<=lines; ++n){
+      bool straight = (!inside[n] && _line_start[n] >= _program_start);
+      reads.clear();
+      writes.clear();
+      for(size_t pc=_line_start[n]; straight && pc<_line_start[n + 1]; ++pc){
+         const Instruction& ins = _bytecode[pc];
+         switch(ins.code){
+            case Instruction::TEXT: case Instruction::COMMIT: case Instruction::MESSAGE: case Instruction::BLOCK_DELETE:
+            case Instruction::OUTPUT: case Instruction::PLAIN: case Instruction::FLUSH: case Instruction::ERROR:
+               break;
+            case Instruction::VALUE:
+               straight = _ReadParameters(_operands[ins.first], reads);
+               break;
+            case Instruction::ASSIGN:{
+               const Operand& target = _operands[ins.data];
+               const Operation* op = &_operations[target.first];
+               double index = round(op[0].value);
+               straight = (target.count == 2 && op[0].code == Operation::NUMBER && op[1].nref == 1 &&
+                           index >= 1 && index <= TOTAL_PARAMETERS);
+               if(straight)
+                  writes.push_back(static_cast<unsigned int>(index));
+               break;
+            }
+            default: // o-words and the end of the program
+               straight = false;
+         }
+      }
+
+      if(!straight || _line_start[n + 1] - region.first > PARALLEL_REGION_SIZE)
+         finish();
+      if(straight){
+         if(region.last == region.first)
+            region.first = _line_start[n];
+         region.last = _line_start[n + 1];
+         region.reads.insert(region.reads.end(), reads.begin(), reads.end());
+         region.writes.insert(region.writes.end(), writes.begin(), writes.end());
+      }
+   }
+   finish();
+}
+
+
+/////////  R u n U n t i l  /////////
+// steps through the program as usual until the instruction <stop> is reached
+// false if the program has finished instead
+template<class Number>
+bool BasicProgram<Number>::_RunUntil(size_t stop, const StepHandler& handler)
+{
+   Instruction saved = _bytecode[stop];
+   Instruction end = {Instruction::END, false, 0, 0, 0, 0}; // doesn't change the last used line
+   _bytecode[stop] = end;
+   string line;
+   ExtraInfo extra;
+   try{
+      while(Step(line, extra))
+         handler(line, extra);
+   }
+   catch(...){
+      _bytecode[stop] = saved;
+      throw;
+   }
+   _bytecode[stop] = saved;
+   return (_pc == stop && stop != _program_end);
+}
+
+
+/////////  R u n R e g i o n s  /////////
+// gives the regions starting from <next> to the workers and passes their steps in the program order
+// the regions run together must not read the parameters assigned by the previous ones
+// returns the region to continue with
+template<class Number>
+size_t BasicProgram<Number>::_RunRegions(const vector<Region>& regions, size_t next, vector<BasicProgram>& workers,
+                                        const StepHandler& handler)
+{
+   vector<bool> assigned(TOTAL_PARAMETERS + 1, false);
+   size_t end = next;
+   for(; end < regions.size() && end - next < workers.size() * PARALLEL_WAVE_REGIONS; ++end){
+      const Region& region = regions[end];
+      if(end > next && region.first != regions[end - 1].last)
+         break; // some other lines are in between
+      if(any_of(region.reads.begin(), region.reads.end(), [&](unsigned int number){return assigned[number];}))
+         break; // depends on the previous region
+      for(auto number: region.writes)
+         assigned[number] = true;
+   }
+
+   vector<vector<Number>> inputs(end - next);
+   for(size_t i=next; i<end; ++i)
+      for(auto number: regions[i].reads)
+         inputs[i - next].push_back(_Param(number));
+
+   vector<RegionResult> results(end - next);
+   atomic<size_t> task(next);
+   auto work = [&](BasicProgram* worker){
+      for(size_t i=task++; i<end; i=task++)
+         worker->_RunRegion(regions[i], inputs[i - next], results[i - next]);
+   };
+   vector<thread> threads;
+   for(size_t i=1; i<workers.size() && i<end-next; ++i)
+      threads.push_back(thread(work, &workers[i]));
+   work(&workers[0]);
+   for(auto& t: threads)
+      t.join();
+
+   // same result as if the regions have been executed one by one
+   for(size_t i=next; i<end; ++i){
+      RegionResult& result = results[i - next];
+      if(result.error || result.pc != regions[i].last){
+         // m2, m30 or the error: the worker's values of the assignments after it are not the ones of the program,
+         //  the region runs again here, so the steps, the values and the exception are the same as of Step()
+         _pc = regions[i].first;
+         if(!_RunUntil(regions[i].last, handler))
+            return regions.size();
+         return i + 1;
+      }
+      for(auto& step: result.steps){
+         _last_used_line = step.line_number;
+         handler(step.line, step.extra);
+      }
+      for(size_t w=0; w<regions[i].writes.size(); ++w)
+         _ParamRef(regions[i].writes[w]) = result.values[w];
+      _last_used_line = result.last_line;
+      _pc = result.pc;
+   }
+   return end;
+}
+
+
+/////////  R u n R e g i o n  /////////
+// executed by the worker: steps through the region, starting with the values of the parameters it reads
+template<class Number>
+void BasicProgram<Number>::_RunRegion(const Region& region, const vector<Number>& inputs, RegionResult& result)
+{
+   for(size_t i=0; i<region.reads.size(); ++i)
+      _ParamRef(region.reads[i]) = inputs[i];
+   _pc = region.first;
+
+   Instruction saved = _bytecode[region.last];
+   Instruction end = {Instruction::END, false, 0, 0, 0, 0};
+   _bytecode[region.last] = end;
+   string line;
+   ExtraInfo extra;
+   try{
+      while(Step(line, extra)){
+         ReplayStep step = {move(line), move(extra), _last_used_line, _pc};
+         result.steps.push_back(move(step));
+      }
+   }
+   catch(...){
+      result.error = current_exception(); // the region runs again in the program order, see _RunRegions()
+   }
+   _bytecode[region.last] = saved;
+
+   result.pc = _pc;
+   result.last_line = _last_used_line;
+   for(auto number: region.writes)
+      result.values.push_back(_Param(number));
+}
+
+
+template class gsharp::BasicProgram<double>;
+template class gsharp::BasicProgram<float>;
+template class gsharp::BasicProgram<gsharp::Fixed>;
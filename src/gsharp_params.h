@@ -0,0 +1,165 @@
+/*
+ *  Copyright 2016, Night Road Software (https://github.com/nrsoft)
+ *  All rights reserved.
+ *  
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are
+ *  met:
+ *  
+ *      * Redistributions of source code must retain the above copyright
+ *  notice, this list of conditions and the following disclaimer.
+ *      * Redistributions in binary form must reproduce the above
+ *  copyright notice, this list of conditions and the following disclaimer
+ *  in the documentation and/or other materials provided with the
+ *  distribution.
+ *      * Neither the name of "Night Road Software" nor the names of its
+ *  contributors may be used to endorse or promote products derived from
+ *  this software without specific prior written permission.
+ *  
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ *  *********************************************************************
+ *
+ *  Storage of the global parameters, see BasicProgram in "gsharp_program.h"
+ *
+ *  ParameterPages:  the parameters are split into pages, the page takes the memory
+ *                   on the first write, the pages which are not written read as zeros
+ *                   the snapshot shares the pages, which are copied on the next write
+ */
+#ifndef GSHARP_PARAMS_H_INCLUDED
+#define GSHARP_PARAMS_H_INCLUDED
+
+#include <cstddef>
+#include <array>
+#include <vector>
+#include <memory>
+
+namespace gsharp
+{
+
+/////////  class  P a r a m e t e r P a g e s  ////////
+// the pages written since the last Clear() are dirty, Clear() zeroes only them
+// the memory of the page is kept until the destruction, so the next writes don't allocate it again
+// the copy is independent, Share() makes the snapshot (e.g. the checkpoint of the program)
+template<class Number, std::size_t SIZE>
+class ParameterPages
+{
+public:
+   const static std::size_t PAGE_SIZE = 64;
+   const static std::size_t PAGES = (SIZE + PAGE_SIZE - 1) / PAGE_SIZE;
+
+   ParameterPages() {_pages.fill(_Zero()); _state.fill(CLEAN);}
+   ParameterPages(const ParameterPages& other): ParameterPages() {*this = other;}
+   ParameterPages& operator=(const ParameterPages& other);
+
+   // the pages which are not written point to the common page of zeros
+   inline const Number& operator[](std::size_t index) const {return (*_pages[index / PAGE_SIZE])[index % PAGE_SIZE];}
+   // to assign the value
+   inline Number& Ref(std::size_t index)
+   {
+      std::size_t page = index / PAGE_SIZE;
+      if(_state[page] != WRITABLE)
+         _Touch(page);
+      return (*_pages[page])[index % PAGE_SIZE];
+   }
+
+   void Clear(); // all values are zero
+   void Share(ParameterPages& snapshot); // <snapshot> gets the same values without copying them
+   std::size_t Pages() const; // with the memory
+
+private:
+   typedef std::array<Number, PAGE_SIZE> Page;
+   enum State: unsigned char {
+      CLEAN,         // zero values
+      SHARED,        // dirty, the page may be used by the snapshot
+      WRITABLE       // dirty, the page belongs only to this one
+   };
+
+   static inline const std::shared_ptr<Page>& _Zero() {static std::shared_ptr<Page> zero(new Page()); return zero;} // never written
+   void _Touch(std::size_t page);
+
+   std::array<std::shared_ptr<Page>, PAGES> _pages;
+   std::array<State, PAGES> _state;
+   std::vector<unsigned int> _touched; // dirty pages
+};
+
+
+template<class Number, std::size_t SIZE>
+ParameterPages<Number, SIZE>& ParameterPages<Number, SIZE>::operator=(const ParameterPages& other)
+{
+   if(this == &other)
+      return *this;
+   Clear();
+   for(auto page: other._touched){
+      _Touch(page);
+      *_pages[page] = *other._pages[page];
+   }
+   return *this;
+}
+
+
+template<class Number, std::size_t SIZE>
+void ParameterPages<Number, SIZE>::Clear()
+{
+   for(auto page: _touched){
+      if(_pages[page].use_count() == 1)
+         _pages[page]->fill(Number());
+      else // the snapshot keeps the values
+         _pages[page] = _Zero();
+      _state[page] = CLEAN;
+   }
+   _touched.clear();
+}
+
+
+template<class Number, std::size_t SIZE>
+void ParameterPages<Number, SIZE>::Share(ParameterPages& snapshot)
+{
+   if(this == &snapshot)
+      return;
+   snapshot._pages = _pages;
+   snapshot._touched = _touched;
+   for(std::size_t page=0; page<PAGES; ++page){
+      if(_state[page] == WRITABLE)
+         _state[page] = SHARED;
+      snapshot._state[page] = _state[page];
+   }
+}
+
+
+template<class Number, std::size_t SIZE>
+std::size_t ParameterPages<Number, SIZE>::Pages() const
+{
+   std::size_t count = 0;
+   for(const auto& page: _pages)
+      if(page != _Zero())
+         ++count;
+   return count;
+}
+
+
+template<class Number, std::size_t SIZE>
+void ParameterPages<Number, SIZE>::_Touch(std::size_t page)
+{
+   if(_pages[page] == _Zero())
+      _pages[page].reset(new Page());
+   else if(_pages[page].use_count() > 1) // shared with the snapshot
+      _pages[page].reset(new Page(*_pages[page]));
+   if(_state[page] == CLEAN)
+      _touched.push_back(static_cast<unsigned int>(page));
+   _state[page] = WRITABLE;
+}
+
+} // namespace gsharp
+
+#endif // GSHARP_PARAMS_H_INCLUDED
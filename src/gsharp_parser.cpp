@@ -29,8 +29,6 @@
  *  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 #include <iostream>
-#include <sstream>
-#include <iomanip>
 #include <algorithm>
 #include "gsharp_program.h"
 #include "gsharp_except.h"
@@ -39,22 +37,109 @@ using namespace std;
 using namespace gsharp;
 
 
+namespace
+{
+
+// ASCII character classes, independent from the current locale
+enum CharClass: unsigned char {OTHER_CHAR, SPACE_CHAR, LETTER_CHAR, DIGIT_CHAR, FORBIDDEN_CHAR};
+
+struct CharTable
+{
+   CharClass type[256];
+   char lower[256];
+   char upper[256];
+
+   CharTable()
+   {
+      for(int c=0; c<256; ++c){
+         type[c] = OTHER_CHAR;
+         lower[c] = upper[c] = static_cast<char>(c);
+      }
+      for(const char* c=" \t\n\v\f\r"; *c; ++c)
+         type[static_cast<unsigned char>(*c)] = SPACE_CHAR;
+      for(const char* c="%&|^@~!<>{}()$?,\"`':;_"; *c; ++c) // not allowed outside comments
+         type[static_cast<unsigned char>(*c)] = FORBIDDEN_CHAR;
+      for(int c='0'; c<='9'; ++c)
+         type[c] = DIGIT_CHAR;
+      for(int c='a'; c<='z'; ++c){
+         type[c] = type[c-'a'+'A'] = LETTER_CHAR;
+         lower[c-'a'+'A'] = static_cast<char>(c);
+         upper[c] = static_cast<char>(c-'a'+'A');
+      }
+   }
+
+   inline bool IsDigit(char c) const {return type[static_cast<unsigned char>(c)] == DIGIT_CHAR;}
+   inline bool IsLetter(char c) const {return type[static_cast<unsigned char>(c)] == LETTER_CHAR;}
+};
+
+const CharTable chars;
+
+// keywords converted to operators, longer ones are checked first
+const struct
+{
+   const char* name;
+   Operation::Code code;
+} keywords[] = {
+   {"mod", Operation::MODULO}, {"and", Operation::AND}, {"xor", Operation::XOR}, {"or", Operation::OR},
+   {"eq", Operation::EQ}, {"ne", Operation::NE}, {"gt", Operation::GT}, {"ge", Operation::GE},
+   {"lt", Operation::LT}, {"le", Operation::LE}
+};
+
+// built-in functions of the expressions, see _FindFunction()
+const unordered_map<string, Function> builtins = {
+   {"exists", EXISTS}, {"round", ROUND}, {"acos", ACOS}, {"asin", ASIN}, {"sqrt", SQRT}, {"atan", ATAN},
+   {"abs", ABS}, {"cos", COS}, {"fix", FIX}, {"fup", FUP}, {"sin", SIN}, {"tan", TAN}, {"exp", EXP}, {"ln", LN}
+};
+const size_t LONGEST_BUILTIN = 6; // "exists"
+
+} // namespace
+
+
 ///////  P a r s e L i n e  ///////
 // for test cases only: the main parser is in Step() function
-const string Program::_ParseLine(const string& line, int precision)
+template<class Number>
+const string BasicProgram<Number>::_ParseLine(const string& line, int precision)
 {
-   string str(line);
    if(_debug_level > 0)
-      cout << "Initial line to parse: " << str << endl;
-   _current_internal_param = INTERNAL_PARAMETERS_START-1;
-
-   _ProcessComments(str, &_extra);
-   _PrepareLine(str);
-   _RemoveNword(str);
-   _SimplifyOperators(str);
-   _CalculateExpressions(str);
-   _ResolveParameters(str, precision);
-   _FormatPretty(str);
+      cout << "Initial line to parse: " << line << endl;
+
+   // compile the line after the end of the program and run it once
+   size_t bytecode_size = _bytecode.size();
+   size_t operands_size = _operands.size();
+   size_t operations_size = _operations.size();
+   size_t constants_size = _constants.size();
+   size_t literals_size = _literals.size();
+   size_t pc = _pc;
+
+   LineNumber current_line = _current_line;
+   LineNumber last_used_line = _last_used_line;
+
+   string str;
+   try{
+      _pc = bytecode_size;
+      _current_line = 0; // not a program line
+      _CompileLine(line, precision, false);
+      _AddInstruction(Instruction::END);
+      _Run(str, _extra);
+   }
+   catch(ErrorMsg& err){
+      _bytecode.resize(bytecode_size);
+      _operands.resize(operands_size);
+      _operations.resize(operations_size);
+      _constants.resize(constants_size);
+      _literals.resize(literals_size);
+      _pc = pc;
+      _current_line = current_line;
+      throw err;
+   }
+   _bytecode.resize(bytecode_size);
+   _operands.resize(operands_size);
+   _operations.resize(operations_size);
+   _constants.resize(constants_size);
+   _literals.resize(literals_size);
+   _pc = pc;
+   _current_line = current_line;
+   _last_used_line = last_used_line;
 
    if(_debug_level > 0)
       cout << "Final parsed line: " << str << endl;
@@ -64,9 +149,10 @@ const string Program::_ParseLine(const string& line, int precision)
 
 //////  P r o c e s s C o m m e n t s  //////
 // finds and removes comments from the input line
-// if comments have specific command, execute them
+// if comments have specific command, collect them in the order of appearance
 // comments may have a pair of brackets () inside, but not just a single non-matching bracket
-void Program::_ProcessComments(string& line, ExtraInfo* extra)
+template<class Number>
+void BasicProgram<Number>::_ProcessComments(string& line, vector<pair<ExtraInfo::Type, string>>* active)
 {
    while(1){
       // search for comments
@@ -103,32 +189,22 @@ void Program::_ProcessComments(string& line, ExtraInfo* extra)
       // remove comment from the line
       line.erase(pos, len);
 
-      // process commands in the comment, if present
-      if(extra){
-         string active(comment.size(), '\0'); // convert to lowercase for comparison
-         ::transform(comment.begin(), comment.end(), active.begin(), ::tolower);
+      // collect commands in the comment, if present
+      if(active){
+         string lower(comment.size(), '\0'); // convert to lowercase for comparison
+         for(size_t i=0; i<comment.size(); ++i)
+            lower[i] = chars.lower[static_cast<unsigned char>(comment[i])];
          if(_debug_level > 2)
-            cout << "Checking for active comment in: " << active << endl;
-
-         if(active.compare(0, 4, "msg,") == 0){
-            comment = comment.substr(4); // extract the message
-            extra->Assign(ExtraInfo::MSG, comment);
-         }
-         else if(active.compare(0, 6, "print,") == 0){
-            comment = comment.substr(6);
-            _ResolveParameters(comment);
-            extra->Assign(ExtraInfo::PRN, comment);
-         }
-         else if(active.compare(0, 6, "debug,") == 0){
-            comment = comment.substr(6);
-            _ResolveParameters(comment);
-            extra->Assign(ExtraInfo::DBG, comment);
-         }
-         else if(active.compare(0, 4, "log,") == 0){
-            comment = comment.substr(4);
-            _ResolveParameters(comment);
-            extra->Assign(ExtraInfo::LOG, comment);
-         }
+            cout << "Checking for active comment in: " << lower << endl;
+
+         if(lower.compare(0, 4, "msg,") == 0)
+            active->push_back(make_pair(ExtraInfo::MSG, comment.substr(4)));
+         else if(lower.compare(0, 6, "print,") == 0)
+            active->push_back(make_pair(ExtraInfo::PRN, comment.substr(6)));
+         else if(lower.compare(0, 6, "debug,") == 0)
+            active->push_back(make_pair(ExtraInfo::DBG, comment.substr(6)));
+         else if(lower.compare(0, 4, "log,") == 0)
+            active->push_back(make_pair(ExtraInfo::LOG, comment.substr(4)));
       }
    }
 
@@ -137,599 +213,437 @@ void Program::_ProcessComments(string& line, ExtraInfo* extra)
 }
 
 
-///////  P r e p a r e L i n e  ///////
-void Program::_PrepareLine(string& str)
+//////////  T o k e n i z e  //////////
+// single scan through the line (without comments), the result is in _tokens
+// whitespaces are skipped, letters converted to lowercase, keywords (mod, eq, ..) to operators
+// at the start of the line: 'block delete' is detected, N-word removed,
+//  O-word with its command is read if <control> is set
+// <raw> is used for messages: text is kept as it is, only parameters and assignments are found
+template<class Number>
+void BasicProgram<Number>::_Tokenize(const string& line, bool control, bool raw)
 {
-   // check for not-allowed symbols outside comments
-   if(str.find_first_of("%&|^@~!<>{}()$?,\"`':;_") != string::npos)
-      throw ErrorMsg(this, "Unexpected character");
-
-   // remove whitespaces and convert to lowercase
-   str.erase(remove_if(str.begin(), str.end(), ::isspace), str.end());
-   transform(str.begin(), str.end(), str.begin(), ::tolower);
-   if(_block_delete && !str.empty() && str[0] == '/'){
-      if(_debug_level > 2)
-         cout << "Str has 'block_delete' character: " << str << endl;
-      str.clear(); // ignore the string completely
+   _tokens.clear();
+   _lexeme.clear(); // the text of all tokens
+
+   // position of the next significant character
+   auto next = [&](size_t i) -> size_t{
+      if(raw)
+         return i;
+      for(; i < line.size(); ++i){
+         CharClass type = chars.type[static_cast<unsigned char>(line[i])];
+         if(type == FORBIDDEN_CHAR)
+            throw ErrorMsg(this, "Unexpected character");
+         if(type != SPACE_CHAR)
+            break;
+      }
+      return i;
+   };
+   // character at the position (lowercase), '\0' at the end of the line
+   auto at = [&](size_t i) -> char{
+      if(i >= line.size())
+         return '\0';
+      return (raw)? line[i]: chars.lower[static_cast<unsigned char>(line[i])];
+   };
+
+   size_t pos = next(0);
+   char c = at(pos);
+   // move to the next character, adding the current one to the lexeme
+   auto advance = [&](){
+      _lexeme += c;
+      pos = next(pos + 1);
+      c = at(pos);
+   };
+   auto add = [&](Token::Type type, size_t start){
+      Token token = {type, Operation::NUMBER, static_cast<unsigned int>(start),
+                     static_cast<unsigned int>(_lexeme.size() - start), 0.0};
+      _tokens.push_back(token);
+   };
+   // decimal number with optional exponent
+   auto number = [&](){
+      size_t start = _lexeme.size();
+      while(chars.IsDigit(c))
+         advance();
+      if(c == '.'){
+         advance();
+         while(chars.IsDigit(c))
+            advance();
+      }
+      if(c == 'e'){
+         size_t i = next(pos + 1);
+         if(at(i) == '+' || at(i) == '-')
+            i = next(i + 1);
+         if(chars.IsDigit(at(i))){
+            advance(); // 'e'
+            if(c == '+' || c == '-')
+               advance();
+            while(chars.IsDigit(c))
+               advance();
+         }
+      }
+      add(Token::NUMBER, start);
+      _tokens.back().value = ParseDecimal(_lexeme.c_str() + start, nullptr, strtod);
+   };
+
+   // beginning of the line
+   if(!raw && c == '/'){ // the line may be skipped at run time
+      advance();
+      add(Token::BLOCK_DELETE, 0);
    }
-   if(_debug_level > 1)
-      cout << "Str prepared for processing: " << str << endl;
-}
-
-
-///////  R e m o v e N w o r d  ///////
-// N-word is expected only in the beginning of the line
-void Program::_RemoveNword(string& str)
-{
-   if(str.empty() || str[0] != 'n') return; // no N-word in front
-   if(str.size() <= 1 || !::isdigit(str[1]))
-      throw ErrorMsg(this, "Ill-formed N-word");
-   size_t pos = str.find_first_not_of("0123456789", 1);
-   str = str.substr((pos!=string::npos)? pos: str.size());
-}
-
-
-////////  R e a d O w o r d  ////////
-// O-word is expected only in the beginning of the line, after N-word has been removed
-// the whole o-word with the number and command is removed from the input string on exit
-bool Program::_ReadOword(string& str, ONumber& number, string& command)
-{
-   if(str.empty() || str[0] != 'o') return false; // no O-word in front
-   if(str.size() <= 1 || !::isdigit(str[1]))
-      throw ErrorMsg(this, "Ill-formed O-word");
-
-   size_t pos1;
-   number = ::stoul(str.substr(1), &pos1);
-   ++pos1; // pos1 was counted from the begiining of the number, has to be from 'o'
-   if(_debug_level > 2)
-      cout << "O-number = " << number << endl;
-   size_t pos2 = str.find_first_not_of("abcdefghijklmnopqrstuvwxyz", pos1);
-   command = str.substr(pos1, (pos2!=string::npos)? pos2-pos1: string::npos);
-   if(_debug_level > 2)
-      cout << "O-command [" << pos1 << "," << ((pos2!=string::npos)? pos2: str.size()) <<
-              "]: '" << command << "'" << endl;
-   str = str.substr((pos2!=string::npos)? pos2: str.size()); // extract remaining part
-   return true;
-}
-
-
-///////  R e p l a c e S i n g l e O p e r a t o r  ///////
-// replace multi-character operator with the single-character one
-void Program::_ReplaceSingleOperator(string& line, const string& operation, char replacement)
-{
-   size_t pos = 0;
-   while(pos != string::npos){
-      pos = line.find(operation, pos);
-      if(pos != string::npos)
-         line.replace(pos, operation.length(), 1, replacement);
+   else if(!raw){
+      if(c == 'n'){ // N-word is removed completely
+         pos = next(pos + 1);
+         c = at(pos);
+         if(!chars.IsDigit(c))
+            throw ErrorMsg(this, "Ill-formed N-word");
+         while(chars.IsDigit(c)){
+            pos = next(pos + 1);
+            c = at(pos);
+         }
+      }
+      if(control && c == 'o'){ // O-word: number and command
+         advance();
+         if(!chars.IsDigit(c))
+            throw ErrorMsg(this, "Ill-formed O-word");
+         while(chars.IsDigit(c))
+            advance();
+         add(Token::OWORD, 0);
+         _tokens.back().value = strtoul(_lexeme.c_str() + 1, nullptr, 10);
+         size_t start = _lexeme.size();
+         while(chars.IsLetter(c))
+            advance();
+         add(Token::COMMAND, start);
+         if(_debug_level > 2)
+            cout << "O-word: '" << _lexeme << "'" << endl;
+      }
    }
-}
-
-
-////////  S i m p l i f y O p e r a t o r s  ///////
-// replace all multi-character operators with single-character ones for simplicity
-void Program::_SimplifyOperators(string& line)
-{
-   _ReplaceSingleOperator(line, "mod", '%');
-   _ReplaceSingleOperator(line, "and", '&');
-   _ReplaceSingleOperator(line, "xor", '^');
-   _ReplaceSingleOperator(line, "or",  '|');
-   _ReplaceSingleOperator(line, "**",  '@'); // use as power symbol
-   _ReplaceSingleOperator(line, "eq",  '~');
-   _ReplaceSingleOperator(line, "ne",  '!');
-   _ReplaceSingleOperator(line, "gt",  '>');
-   _ReplaceSingleOperator(line, "ge",  '}');
-   _ReplaceSingleOperator(line, "lt",  '<');
-   _ReplaceSingleOperator(line, "le",  '{');
-   if(_debug_level > 1)
-      cout << "Str after simplifying operators: " << line << endl;
-}
-
-
-////////  P a r s e O p e r a n d  ////////
-// immediate value or parameter
-double Program::_ParseOperand(const string& expr)
-{
-   if(_debug_level > 2)
-      cout << "Expr to parse operand: " << expr << endl;
-
-   if(expr.empty())
-      throw ErrorMsg(this, "Empty operand");
-
-   if(expr[0] == '+') // ignore positive sign
-      return _ParseOperand(expr.substr(1));
-
-   if(expr[0] == '-') // invert value with the negative sign
-      return -_ParseOperand(expr.substr(1));
 
-   // check if this is a parameter
-   if(expr[0] == '#'){
-      size_t len;
-      double value = _ReadParameter(expr, 0, len);
-      if(len != expr.size()) // other characters present
-         throw ErrorMsg(this, "Unexpected character after the parameter");
-      return value;
+   while(pos < line.size()){
+      size_t start = _lexeme.size();
+      if(c == '#'){
+         size_t i = pos + 1; // '<' is not allowed otherwise, so the name is read here
+         while(!raw && i < line.size() && chars.type[static_cast<unsigned char>(line[i])] == SPACE_CHAR)
+            ++i;
+         if(i < line.size() && line[i] == '<'){ // named parameter, e.g. #<_tool_length>
+            _lexeme += c;
+            add(Token::PARAMETER, start);
+            size_t close = line.find('>', i);
+            if(close == string::npos)
+               throw ErrorMsg(this, "No closing '>' for the parameter name");
+            start = _lexeme.size();
+            for(++i; i<close; ++i) // case-insensitive, whitespaces are removed (LinuxCNC)
+               if(chars.type[static_cast<unsigned char>(line[i])] != SPACE_CHAR)
+                  _lexeme += chars.lower[static_cast<unsigned char>(line[i])];
+            if(_lexeme.size() == start)
+               throw ErrorMsg(this, "Empty parameter name");
+            add(Token::NAME, start);
+            pos = next(close + 1);
+            c = at(pos);
+            continue;
+         }
+         advance();
+         add(Token::PARAMETER, start);
+         if(raw && chars.IsDigit(c)) // parameter index
+            number();
+      }
+      else if(c == '='){
+         advance();
+         add(Token::ASSIGN, start);
+      }
+      else if(raw){ // everything else is a text
+         advance();
+         if(!_tokens.empty() && _tokens.back().type == Token::TEXT)
+            ++_tokens.back().len;
+         else
+            add(Token::TEXT, start);
+      }
+      else if(chars.IsDigit(c) || (c == '.' && chars.IsDigit(at(next(pos + 1)))))
+         number();
+      else if(chars.IsLetter(c)){
+         // check for keywords
+         const Operation::Code* code = nullptr;
+         for(const auto& keyword: keywords){
+            const char* k = keyword.name;
+            for(size_t i = pos; *k != '\0' && at(i) == *k; ++k)
+               i = next(i + 1);
+            if(*k == '\0'){
+               code = &keyword.code;
+               for(k = keyword.name; *k != '\0'; ++k)
+                  advance();
+               break;
+            }
+         }
+         if(code){
+            add(Token::OPERATOR, start);
+            _tokens.back().op = *code;
+         }
+         else{ // letters of the same word
+            advance();
+            if(!_tokens.empty() && _tokens.back().type == Token::WORD)
+               ++_tokens.back().len;
+            else
+               add(Token::WORD, start);
+         }
+      }
+      else if(c == '+' || c == '-' || c == '*' || c == '/'){
+         Operation::Code code = (c == '+')? Operation::ADD: (c == '-')? Operation::SUBTRACT:
+                                (c == '*')? Operation::MULTIPLY: Operation::DIVIDE;
+         advance();
+         if(code == Operation::MULTIPLY && c == '*'){ // power
+            code = Operation::POWER;
+            advance();
+         }
+         add(Token::OPERATOR, start);
+         _tokens.back().op = code;
+      }
+      else if(c == '['){
+         advance();
+         add(Token::OPEN, start);
+      }
+      else if(c == ']'){
+         advance();
+         add(Token::CLOSE, start);
+      }
+      else{
+         advance();
+         add(Token::TEXT, start);
+      }
    }
 
-   if(!::isdigit(expr[0]) && expr[0] != '.') // should start with a decimal digit or decimal dot
-      throw ErrorMsg(this, "Unexpected operand");
-
-   // directly read the value
-   // read the parameter index
-   size_t last_pos;
-   double value = stod(expr, &last_pos);
-   if(last_pos != expr.size())
-      throw ErrorMsg(this, "Unexpected character after the value");
-
-   return value;
-}
-
-
-////////  P a r s e M u l t i p l i c a t i o n  ////////
-// operators: POW (@)
-double Program::_ParsePower(const string& expr)
-{
-   if(_debug_level > 2)
-      cout << "Expr to parse power: " << expr << endl;
-   size_t delimiter = expr.find_last_of('@'); // "last" to ensure left-to-right pocessing
-   if(delimiter != string::npos){
-      double lhs = _ParsePower(expr.substr(0, delimiter)); // may contain power ops
-      double rhs = _ParseOperand(expr.substr(delimiter+1)); // should not contain any power ops
-      // power
-      return pow(lhs, rhs);
-   }
-   return _ParseOperand(expr);
+   if(_debug_level > 1)
+      cout << "Line tokenized: '" << _lexeme << "' (" << _tokens.size() << " tokens)" << endl;
 }
 
 
-////////  P a r s e M u l t i p l i c a t i o n  ////////
-// operators: (*), (/), MOD (%)
-double Program::_ParseMultiplication(const string& expr)
+//////////  F i n d F u n c t i o n  //////////
+// check if the <word> preceding the opening bracket ends with the name of a function
+// the function name is not a part of the expression and must be removed by the caller
+// <native> receives the index of the native function
+template<class Number>
+Function BasicProgram<Number>::_FindFunction(const Token& word, size_t& name_len, unsigned int* native)
 {
-   if(_debug_level > 2)
-      cout << "Expr to parse multiplication: " << expr << endl;
-   size_t delimiter = expr.find_last_of("*/%"); // "last" to ensure left-to-right pocessing
-   if(delimiter != string::npos){
-      double lhs = _ParseMultiplication(expr.substr(0, delimiter)); // may contain mult ops
-      double rhs = _ParsePower(expr.substr(delimiter+1)); // should not contain any mult ops
-      if(expr[delimiter] == '*') // multiply
-         return lhs * rhs;
-      else if(expr[delimiter] == '/') // divide
-         return lhs / rhs;
-      // modulus on doubles
-      return fmod(lhs, rhs);
-   }
-   return _ParsePower(expr);
-}
-
+   name_len = 0;
+   if(word.type != Token::WORD) // not a character - not a function!
+      return NO_FUNCTION;
 
-////////  P a r s e S u m m a t i o n  ////////
-// operators: (+), (-)
-double Program::_ParseSummation(const string& expr)
-{
-   if(_debug_level > 2)
-      cout << "Expr to parse summation: " << expr << endl;
-   size_t delimiter = expr.find_last_of("+-"); // "last" to ensure left-to-right pocessing
-   if(delimiter != string::npos){
-      // check if it is unary plus or minus
-      if(delimiter > 0 && (::isdigit(expr[delimiter-1]) || expr[delimiter-1] == '.')){
-         // proceed with the binary operation
-         double lhs = _ParseSummation(expr.substr(0, delimiter)); // may contain summation ops
-         double rhs = _ParseMultiplication(expr.substr(delimiter+1)); // should not contain any sum ops
-         if(expr[delimiter] == '+') // add
-            return lhs + rhs;
-         // subtract
-         return lhs - rhs;
+   size_t end = word.start + word.len;
+   if(_debug_level > 1)
+      cout << "Check Fn before expr: " << _lexeme.substr(word.start, word.len) << endl;
+
+   // start with the longest possible function name to avoid detecting sin[] before asin[]
+   for(name_len = min(static_cast<size_t>(word.len), max(LONGEST_BUILTIN, _longest_native)); name_len > 0; --name_len){
+      string name = _lexeme.substr(end - name_len, name_len);
+      auto builtin = builtins.find(name);
+      if(builtin != builtins.end())
+         return builtin->second;
+      auto id = _native_ids.find(name);
+      if(id != _native_ids.end()){
+         if(native)
+            *native = id->second;
+         return NATIVE;
       }
-      // unary sign operation
-      if(_debug_level > 2)
-         cout << "Unary operand found in: " << expr << endl;
-      // replace the signed value with parameter
-      string str(expr);
-      size_t pos = str.find_first_not_of("0123456789.", delimiter+1);
-      size_t len = (pos == string::npos)? str.size()-delimiter: pos-delimiter;
-      if(_debug_level > 3)
-         cout << "Unary operand starts from pos " << delimiter << " with " << len << " chars" << endl;
-      double value = _ParseOperand(expr.substr(delimiter, len));
-      _ReplaceWithParameter(value, str, delimiter, len);
-      // continue evaluation
-      return _ParseSummation(str);
    }
-   return _ParseMultiplication(expr);
+   return NO_FUNCTION;
 }
 
 
-////////  P a r s e C o n d i t i o n a l  ////////
-// operators: EQ (~), NE (!), LT (<), LE ({), GE (}), GT (>)
-double Program::_ParseConditional(const string& expr)
+//////////  R e g i s t e r F u n c t i o n  //////////
+// the name must be found by _FindFunction() in the tokenized line: the letters of one word without keywords
+template<class Number>
+void BasicProgram<Number>::RegisterFunction(const string& name, unsigned int arity, const NativeFunction& function)
 {
-   if(_debug_level > 2)
-      cout << "Expr to parse conditional: " << expr << endl;
-   size_t delimiter = expr.find_last_of("~!{<>}"); // "last" to ensure left-to-right pocessing
-   if(delimiter != string::npos){
-      double lhs = _ParseConditional(expr.substr(0, delimiter)); // may contain other cond ops
-      double rhs = _ParseSummation(expr.substr(delimiter+1)); // should not contain any cond ops
-
-      // simple tolerance-based comparison may not be effective in all cases
-      //  but let's follow LinuxCNC approach for now
-      if(expr[delimiter] == '~') // eq
-         return (fabs(lhs - rhs) < TOLERANCE_EQUAL)? 1.0: 0.0;
-      else if(expr[delimiter] == '!') // ne
-         return (fabs(lhs - rhs) >= TOLERANCE_EQUAL)? 1.0: 0.0;
-      else if(expr[delimiter] == '{') // le
-         return (lhs <= rhs)? 1.0: 0.0;
-      else if(expr[delimiter] == '<') // lt
-         return (lhs < rhs)? 1.0: 0.0;
-      else if(expr[delimiter] == '>') // gt
-         return (lhs > rhs)? 1.0: 0.0;
-      // ge
-      return (lhs >= rhs)? 1.0: 0.0;
+   string lower(name.size(), '\0');
+   for(size_t i=0; i<name.size(); ++i){
+      if(!chars.IsLetter(name[i]))
+         throw ErrorMsg(this, "Function name '%s' must contain only letters", name.c_str());
+      lower[i] = chars.lower[static_cast<unsigned char>(name[i])];
    }
-   return _ParseSummation(expr);
+   if(lower.size() < 2) // single letters are g-code words
+      throw ErrorMsg(this, "Function name '%s' is too short", name.c_str());
+   if(builtins.find(lower) != builtins.end())
+      throw ErrorMsg(this, "Function '%s' is built-in", name.c_str());
+   for(const auto& keyword: keywords)
+      if(lower.find(keyword.name) != string::npos)
+         throw ErrorMsg(this, "Function name '%s' contains keyword '%s'", name.c_str(), keyword.name);
+   if(arity == 0 || arity > MAX_FUNCTION_ARGUMENTS)
+      throw ErrorMsg(this, "Function '%s' must have 1 to %d arguments", name.c_str(), MAX_FUNCTION_ARGUMENTS);
+   if(!function)
+      throw ErrorMsg(this, "Function '%s' is empty", name.c_str());
+
+   // the loaded program keeps calling the previous one with the same name
+   Native native = {lower, arity, function};
+   _native_ids[lower] = static_cast<unsigned int>(_natives.size());
+   _natives.push_back(native);
+   _longest_native = max(_longest_native, lower.size());
 }
 
 
-////////  P a r s e L o g i c a l  ////////
-// operators: AND (&), OR (|), XOR (^)
-double Program::_ParseLogical(const string& expr)
+//////////  A p p l y F u n c t i o n  //////////
+// <arg2> is used only by ATAN
+// angles are in degrees (RS274/NGC), see Numeric for the semantics of the other types
+template<class Number>
+Number BasicProgram<Number>::_ApplyFunction(Function func, Number arg, Number arg2)
 {
-   if(_debug_level > 2)
-      cout << "Expr to parse logical: " << expr << endl;
-   size_t delimiter = expr.find_last_of("&|^"); // "last" to ensure left-to-right pocessing
-   if(delimiter != string::npos){
-      double lhs = _ParseLogical(expr.substr(0, delimiter)); // may contain logical ops
-      double rhs = _ParseConditional(expr.substr(delimiter+1)); // should not contain any logical ops
-      if(expr[delimiter] == '&') // and
-         return (lhs!=0.0 && rhs!=0.0)? 1.0: 0.0;
-      else if(expr[delimiter] == '|') // or
-         return (lhs!=0.0 || rhs!=0.0)? 1.0: 0.0;
-      // xor
-      return ((lhs!=0.0 && rhs==0.0) || (lhs==0.0 && rhs!=0.0))? 1.0: 0.0;
-   }
-   return _ParseConditional(expr);
-}
-
-
-///////  E v a l u a t e E x p r e s s i o n  ///////
-double Program::_EvaluateExpression(string& expr) // evaluate espression inside [.]
-{
-   // safety checks
-   if(expr.empty())
-      throw ErrorMsg(this, "Ill-formed expression");
-
-   // if there are internal expressions, process them
-   _CalculateExpressions(expr);
-
-   if(expr.find_first_of('=') != string::npos)
-      throw ErrorMsg(this, "Assignments are not allowed inside expressions");
-
-   if(_debug_level > 2)
-      cout << "Clean expr to parse: " << expr << endl;
-
-   // now there should be no other expressions inside <expr>, only operations and operands
-   return _ParseLogical(expr); // start parsing from logical operators
-}
-
-
-//////  C a l c u l a t e E x p r e s s i o n F r o m B r a c k e t  //////
-// <start> should point to the opening bracket (assumed, not checked)
-// the function finds the corresponding closing bracket and calculates the expression inside
-// <len> is set to the length of the expression, including brackets
-double Program::_CalculateExpressionFromBracket(const string& line, size_t start, size_t& len)
-{
-   // find corresponding closing bracket
-   len = 1;
-   for(int bracket_cnt = 0 ; bracket_cnt >= 0; ++len){
-      if(start+len >= line.size())
-         throw ErrorMsg(this, "No closing bracket for expression");
-      if(line[start+len] == '[') // found internal sub-expression
-         ++bracket_cnt;
-      if(line[start+len] == ']') // internal sub-expression ended
-         --bracket_cnt;
-   }
-
-   // evaluate expression inside the brackets
-   string expr = line.substr(start+1, len-2); // internal part of the expression
-   return _EvaluateExpression(expr);
-}
-
-
-//////  A p p l y A s F u n c t i o n A r g u m e n t  //////
-// check if this expression is a function argument ( e.g. abs[..] )
-//  then apply the function and use it as a single expression
-double Program::_ApplyAsFunctionArgument(double arg, const string& line, size_t& start, size_t& len)
-{
-   double result = arg; // default: no function
-   if(start == 0 || !::isalpha(line[start-1])) // not a character - not a function!
-      return arg;
-
-   size_t pos = start; // new start position
-   size_t last = start + len; // just after the closing bracket
-
-   if(_debug_level > 1)
-      cout << "Check Fn before expr: " << line.substr(start, len) << endl;
-
-   // start with the longest possible function name
-   if(start >= 5){
-      if(_debug_level > 2)
-         cout << "Fn5 to parse: " << line.substr(pos-5) << endl;
-      if(line.compare(pos-5, 5, "round") == 0){
-         result = round(arg);
-         pos -= 5; // new start position
-      }
-   }
-
-   // try 4 character function names first to avoid detecting sin() before asin()
-   if(pos == start && start >= 4){
-      pos -= 4;
-      if(_debug_level > 2)
-         cout << "Fn4 to parse: " << line.substr(pos) << endl;
-      if(line.compare(pos, 4, "acos") == 0){
-         if(arg < -1.0 || arg > 1.0)
+   Number result = arg;
+   switch(func){
+      case ROUND:
+         result = Numeric::Round(arg);
+         break;
+      case ACOS:
+         if(arg < Number(-1) || arg > Number(1))
             throw ErrorMsg(this, "Out of range ACOS argument");
-         result = _degrees(acos(arg)); // output in degrees (RS274/NGC)
-      }
-      else if(line.compare(pos, 4, "asin") == 0){
-         if(arg < -1.0 || arg > 1.0)
+         result = Numeric::Acos(arg);
+         break;
+      case ASIN:
+         if(arg < Number(-1) || arg > Number(1))
             throw ErrorMsg(this, "Out of range ASIN argument");
-         result = _degrees(asin(arg)); // output in degrees (RS274/NGC)
-      }
-      else if(line.compare(pos, 4, "sqrt") == 0){
-         if(arg < 0.0)
+         result = Numeric::Asin(arg);
+         break;
+      case SQRT:
+         if(arg < Number())
             throw ErrorMsg(this, "Negative SQRT argument");
-         result = sqrt(arg);
-      }
-      else if(line.compare(pos, 4, "atan") == 0){ // special case in LinuxCNC
-      if(_debug_level > 3)
-         cout << "Last Fn char: '" << line[last] << "' then: '" << line[last+1] << "'" << endl;
-         if(line[last] != '/' || line[last+1] != '[') // double argument expression
-            throw ErrorMsg(this, "Ill-formed ATAN expression");
-         if(_debug_level > 1)
-            cout << "ATAN second expr to parse: " << line.substr(last+1) << endl;
-         size_t arg2_len;
-         double arg2 = _CalculateExpressionFromBracket(line, last+1, arg2_len);
-         result = _degrees(atan2(arg, arg2)); // output in degrees (RS274/NGC)
-         last += arg2_len + 1; // adjust the last element
-      }
-      else
-         pos += 4; // if no function found, restore original position
-   }
-
-   // 3-character functions
-   if(pos == start && start >= 3){
-      pos -= 3;
-      if(_debug_level > 2)
-         cout << "Fn3 to parse: " << line.substr(pos) << endl;
-      if(line.compare(pos, 3, "abs") == 0)
-         result = fabs(arg);
-      else if(line.compare(pos, 3, "cos") == 0)
-         result = cos(_radians(arg)); // argument in degrees (RS274/NGC)
-      else if(line.compare(pos, 3, "fix") == 0)
-         result = floor(arg);
-      else if(line.compare(pos, 3, "fup") == 0)
-         result = ceil(arg);
-      else if(line.compare(pos, 3, "sin") == 0)
-         result = sin(_radians(arg)); // argument in degrees (RS274/NGC)
-      else if(line.compare(pos, 3, "tan") == 0)
-         result = tan(_radians(arg)); // argument in degrees (RS274/NGC)
-      else if(line.compare(pos, 3, "exp") == 0){
-         result = exp(arg);
-         if(result == HUGE_VAL)
+         result = Numeric::Sqrt(arg);
+         break;
+      case ATAN:
+         result = Numeric::Atan(arg, arg2);
+         break;
+      case ABS:
+         result = Numeric::Abs(arg);
+         break;
+      case COS:
+         result = Numeric::Cos(arg);
+         break;
+      case FIX:
+         result = Numeric::Floor(arg);
+         break;
+      case FUP:
+         result = Numeric::Ceil(arg);
+         break;
+      case SIN:
+         result = Numeric::Sin(arg);
+         break;
+      case TAN:
+         result = Numeric::Tan(arg);
+         break;
+      case EXP:
+         result = Numeric::Exp(arg);
+         if(Numeric::IsHuge(result))
             throw ErrorMsg(this, "EXP argument is too big");
-      }
-      else
-         pos += 3; // restore original position
-   }
-
-   // 2-character functions
-   if(pos == start && start >= 2){
-      if(_debug_level > 2)
-         cout << "Fn2 to parse: " << line.substr(pos-2) << endl;
-      if(line.compare(pos-2, 2, "ln") == 0){
-         result = log(arg);
-         pos -= 2; // new start position
-      }
+         break;
+      case LN:
+         result = Numeric::Ln(arg);
+         break;
+      default:
+         break;
    }
-
-   start = pos;
-   if(_debug_level > 3)
-      cout << "Ended Fn with start pos: " << start << endl;
-   len = last - start; // adjust expression length accordingly
    return result;
 }
 
 
-///////  C a l c u l a t e E x p r e s s i o n s  ////////
-void Program::_CalculateExpressions(string& line, vector<double>* output)
+//////////  C a l l N a t i v e  //////////
+// the arguments on the stack are replaced with the result
+// the exceptions of the host function are reported with the line number
+template<class Number>
+void BasicProgram<Number>::_CallNative(unsigned int native)
 {
-   while(1){
-      // search for any (remaining) expressions
-      size_t expr_start = line.find_first_of('[');
-      if(expr_start == string::npos) // no expressions?
-         break; // then no changes to the input line, ready for parsing
-
-      size_t expr_len;
-      double result = _CalculateExpressionFromBracket(line, expr_start, expr_len);
-      if(_debug_level > 1)
-         cout << "Raw expr " << line.substr(expr_start, expr_len) << " = " << result << endl;
-
-      // is this expression a function argument? e.g. abs[..]
-      result = _ApplyAsFunctionArgument(result, line, expr_start, expr_len);
-      if(_debug_level > 1)
-         cout << "Expression: " << line.substr(expr_start, expr_len) << " equals " << result << endl;
-
-      // substitute expression with the internal parameter equal to the evaluated expression
-      _ReplaceWithParameter(result, line, expr_start, expr_len);
-
-      if(output != nullptr)
-         output->push_back(result); // only first order expressions
+   const Native& call = _natives[native];
+   size_t first = _stack.size() - call.arity;
+   Number result;
+   try{
+      result = call.function(&_stack[first]);
    }
-   if(_debug_level > 1)
-      cout << "Str after calculating expressions: " << line << endl;
+   catch(ErrorMsg&){
+      throw;
+   }
+   catch(exception& e){
+      throw ErrorMsg(this, "Function %s: %s", call.name.c_str(), e.what());
+   }
+   _stack.resize(first + 1);
+   _stack.back() = result;
 }
 
 
-///////  R e p l a c e  W i t h  P a r a m e t e r  ///////
-void Program::_ReplaceWithParameter(double value, string& line, size_t start, size_t len)
+////////  F o r m a t V a l u e  ////////
+// append the value to the string, using certain precision and removing trailing zeros
+template<class Number>
+void BasicProgram<Number>::_FormatValue(Number value, int precision, string& str)
 {
-   // #indices start from 1, while c++ arrays start from 0, so there is a unit diff
-   if(_debug_level > 1)
-      cout << "Saving value " << value << " into parameter #" << (_current_internal_param+1) << endl;
-   _params[_current_internal_param] = value;
-   line.replace(start, len, string("#") + to_string(++_current_internal_param));
-   if(_current_internal_param >= TOTAL_PARAMETERS)
-      throw ErrorMsg(this, "Max number of internal parameters reached");
+   if(Numeric::IsNegativeZero(value)) value = Number(); // explicit check for negative zero
+
+   char buf[400]; // enough for any double in fixed notation
+   int len = Numeric::Print(value, precision, buf, sizeof(buf)); // format up to precision
+   if(len >= static_cast<int>(sizeof(buf)))
+      len = sizeof(buf) - 1;
+   while(len > 0 && buf[len-1] == '0') // remove trailing zeros
+      --len;
+   if(len > 0 && buf[len-1] == '.') // decimal dot at the very end?
+      --len; // remove trailing dot
+   if(len == 0) // nothing left after removing all zeros and dots?
+      str += '0'; // this could be the only reason
+   else
+      str.append(buf, len);
 }
 
 
-////////  R e a d P a r a m e t e r  ////////
-// assumes that the "#" character is located at <pos>
-// updates the <len> of the whole parameter string (## and number)
-double Program::_ReadParameter(const string& line, size_t pos, size_t& len)
+/////////  F o r m a t  P r e t t y  ///////
+// insert spaces between digits and alpha characters
+// convert to upper case
+template<class Number>
+void BasicProgram<Number>::_FormatPretty(string& line)
 {
-   // process recursive parameter referencing (aka ###..)
-   int nref = 1; // number of "#" as recursive parameters
-   for(;pos + nref < line.size(); ++nref)
-      if(line[pos + nref] != '#')
-         break;
-
-   // expect a digit after the last '#'
-   if(!::isdigit(line[pos + nref]))
-      throw ErrorMsg(this, "Error in parameter index");
-
-   // read the parameter index
-   char* last_ptr;
-   double value = strtod(line.c_str() + pos + nref, &last_ptr);
-   len = last_ptr - (line.c_str() + pos); // length of the parameter string
-
-   // unwind references
-   for(;nref > 0; --nref){
-      size_t idx = static_cast<size_t>(round(value));
-      if(idx == 0 || idx > TOTAL_PARAMETERS)
-         throw ErrorMsg(this, "Parameter #%d does not exist", idx);
-      value = (idx <= TOTAL_LOCAL_PARAMETERS)? _local_params[idx-1]: _params[idx-1];
-   }
-
-   return value;
+   if(_format_pretty)
+      _InsertSpaces(line);
+   if(_convert_to_upper)
+      _ConvertToUpper(line);
 }
 
 
-////////  A s s i g n  P a r a m e t e r  ////////
-// assumes that the "#" character is located at <pos>
-// updates the <len> of the whole assignment string (##, number, '=' and the value)
-void Program::_AssignParameter(const string& line, size_t pos, size_t& len)
+/////////  I n s e r t  S p a c e s  ///////
+template<class Number>
+void BasicProgram<Number>::_InsertSpaces(string& line) const
 {
-   // process recursive parameter referencing (aka ###..)
-   int nref = 1; // number of "#" as recursive parameters
-   for(;pos + nref < line.size(); ++nref)
-      if(line[pos + nref] != '#')
-         break;
-
-   // expect a digit after the last '#'
-   if(!::isdigit(line[pos + nref]))
-      throw ErrorMsg(this, "Error in parameter index");
-
-   // read the parameter index
-//TODO: Replace with string-based coversion stod?
-   char* last_ptr;
-   double index = strtod(line.c_str() + pos + nref, &last_ptr);
-
-   // read the new parameter value
-   last_ptr++; // one after the '=' character
-   if(*last_ptr == '\0' || (!::isdigit(*last_ptr) && *last_ptr != '.' && *last_ptr != '-'))
-      throw ErrorMsg(this, "Error in the value to assign");
-   double new_value = strtod(last_ptr, &last_ptr);
-   len = last_ptr - (line.c_str() + pos); // length of the whole assignment expression
-
-   // unwind references
-   size_t idx;
-   for(;nref > 0; --nref){
-      idx = static_cast<size_t>(round(index));
-      if(idx == 0 || idx > TOTAL_PARAMETERS)
-         throw ErrorMsg(this, "Parameter #%d does not exist", idx);
-      index = (idx <= TOTAL_LOCAL_PARAMETERS)? _local_params[idx-1]: _params[idx-1];
+   for(size_t i=1; i<line.size(); ++i){
+      if(chars.IsDigit(line[i-1]) && chars.IsLetter(line[i]))
+         line.insert(i, 1, ' ');
    }
-   if(_debug_level > 0)
-      cout << "Assigning value " << new_value << " to parameter #" << idx << endl;
-
-   if(idx <= TOTAL_LOCAL_PARAMETERS)
-      _local_params[idx-1] = new_value;
-   else // global
-      _params[idx-1] = new_value;
 }
 
 
-////////  R e s o l v e P a r a m e t e r s  ////////
-// substitute parameters in the string with their values, using certain precision
-void Program::_ResolveParameters(string& line, int precision)
+/////////  N o r m a l i z e  ///////
+// the line given by the host: lowercase without whitespaces, same as the lexeme of the plain line
+template<class Number>
+void BasicProgram<Number>::_Normalize(string& line) const
 {
-   if(_debug_level > 1)
-      cout << "Str to resolve parameters: " << line << endl;
-
-   size_t len, pos = 0;
-   int assignments = 0;
-   while(1){
-      if(_debug_level > 3)
-         cout << "Searching for '#' in line '" << line << "' from pos " << pos << endl;
-      pos = line.find_first_of('#', pos);
-      if(pos == string::npos)
-         break; // finished
-
-      double value = _ReadParameter(line, pos, len);
-      if(value == -0.0) value = 0.0; // explicit check for negative zero
-
-      if(line[pos+len] == '=') // don't assign anything yet
-         ++assignments;
-      else{ // substitute parameter with its' value string
-         stringstream ss;
-         ss << fixed << setprecision(precision) << value; // format up to precision
-         string str = ss.str();
-         str.erase(str.find_last_not_of('0') + 1, string::npos); // remove trailing zeros
-         if(*str.rbegin() == '.') // decimal dot at the very end?
-            str.erase(str.size()-1); // remove trailing dot
-         if(str.empty()) // nothing left after removing all zeros and dots?
-            str = "0"; // this could be the only reason
-         // substitute parameter with value
-         if(_debug_level > 1)
-            cout << "Parameter " << line.substr(pos, len) << " is replaced by value " << str << endl;
-         line.replace(pos, len, str);
-         len = str.size(); // new length after replacement
-
-      }
-      pos += len;
-
-   }
-
-   if(_debug_level > 2)
-      cout << assignments << " parameter(s) to assign in line " << line << endl;
+   size_t last = 0;
+   for(char c: line)
+      if(chars.type[static_cast<unsigned char>(c)] != SPACE_CHAR)
+         line[last++] = chars.lower[static_cast<unsigned char>(c)];
+   line.resize(last);
+}
 
-   // assign parameters only as the last step (LinuxCNC requirement)
-   if(assignments > 0){
-      pos = 0;
-      while(1){ // redo the search
-         pos = line.find_first_of('#', pos);
-         if(pos == string::npos)
-            break;
 
-         _AssignParameter(line, pos, len);
-         line.erase(pos, len);
-      }
-   }
+/////////  C o n v e r t  T o  U p p e r  ///////
+template<class Number>
+void BasicProgram<Number>::_ConvertToUpper(string& line) const
+{
+   for(auto& c: line)
+      c = chars.upper[static_cast<unsigned char>(c)];
 }
 
 
-/////////  F o r m a t  P r e t t y  ///////
-// insert spaces between digits and alpha characters
-// convert to upper case
-void Program::_FormatPretty(string& line)
+///////  F o r m a t  P l a i n  L i n e s  ///////
+// plain lines are formatted at load time, refresh them when the settings change
+template<class Number>
+void BasicProgram<Number>::_FormatPlainLines()
 {
-   if(_format_pretty)
-      for(size_t i=1; i<line.size(); ++i){
-         if(::isdigit(line[i-1]) && ::isalpha(line[i]))
-            line.insert(i, 1, ' ');
+   for(const auto& ins: _bytecode){
+      if(ins.code == Instruction::PLAIN){
+         _literals[ins.data] = _literals[ins.first];
+         _FormatPretty(_literals[ins.data]);
       }
-
-   if(_convert_to_upper)
-      ::transform(line.begin(), line.end(), line.begin(), ::toupper);
+   }
 }
 
+
+template class gsharp::BasicProgram<double>;
+template class gsharp::BasicProgram<float>;
+template class gsharp::BasicProgram<gsharp::Fixed>;
@@ -38,354 +38,1158 @@ using namespace gsharp;
 using namespace std;
 
 
+template<class Number>
+const unsigned int BasicProgram<Number>::NO_BLOCK;
+template<class Number>
+const unsigned int BasicProgram<Number>::NO_TABLE;
+template<class Number>
+const unsigned int BasicProgram<Number>::NO_SLOT;
+template<class Number>
+const unsigned int BasicProgram<Number>::NO_NATIVE;
+
+
 //////  c o n s t r u c t o r  ///////
-Program::Program()
+template<class Number>
+BasicProgram<Number>::BasicProgram(MemoryResource* upstream): _arena(upstream)
 {
    _debug_level = 0;
+   _has_calls = false;
 
 //TODO: store/retrieve persistent parameters (check for early exceptions!)
-   _params.fill(0); // for now at the very start all are zero
+   // for now at the very start all are zero: no pages of _params are written
    _block_delete = USE_BLOCK_DELETE;
    _format_pretty = USE_PRETTY_FORMAT;
    _convert_to_upper = CONVERT_TO_UPPER;
+   _inline_subs = USE_INLINE_SUBS;
+   SetStackDepth(DEFAULT_STACK_LEVELS);
+   _sub_cache_size = DEFAULT_SUB_CACHE_SIZE;
    _percent_start = 0;
    _percent_stop = 0;
+   _longest_native = 0;
+   _clock = _cache_reset = 0;
+   _seeking = false;
+   _seek_line = 0;
+   _seek_hits = 0;
+   _journal.size = _journal.bytes = 0;
+   _journal.recording = false;
+   _journal.interval = JOURNAL_INTERVAL;
+   _steps = 0;
+   _Configure();
+   _Reset();
    Rewind();
 }
 
 
 /////////  R e w i n d  /////////
-void Program::Rewind()
+template<class Number>
+void BasicProgram<Number>::Rewind()
 {
+   _pc = _program_start;
    _current_line = 1;
    _last_used_line = 0;
-   _current_internal_param = INTERNAL_PARAMETERS_START-1;
-   _local_params.fill(0);
-   while(!_param_stack.empty())
-      _param_stack.pop();
-   while(!_return_stack.empty())
-      _return_stack.pop();
-   _percent_active = false;
+   _local_params.fill(Number());
+   for(size_t slot=0; slot<_named.size(); ++slot)
+      if(!_named[slot].global)
+         _named_defined[slot] = 0;
+   _frames.clear(); // the memory stays allocated
+   _frame_values.clear();
+   _output.clear();
+   _pending.clear();
+   _loop_back = false;
+   _cache_reset = ++_clock;
+   _replay.mode = Replay::NONE;
+   _memo.mode = SubMemo::NONE;
+   _steps = 0;
+   _ClearJournal();
+}
+
+
+//////////  R e s e t  //////////
+// removes the program code
+// <finish> adds the only instruction, so the empty program finishes straight away, its' few bytes are
+//  taken from the heap: the arena takes the memory only for the loaded program, <first_chunk> at first
+template<class Number>
+void BasicProgram<Number>::_Reset(bool finish, size_t first_chunk)
+{
+   // nothing is left in the arena, so its memory goes back at once
+   MemoryResource* resource = finish? nullptr: &_arena;
+   _Vacate(_code, resource);
+   _Vacate(_blocks, resource);
+   _Vacate(_block_ids, resource);
+   _Vacate(_controls, resource);
+   _Vacate(_jump_tables, resource);
+   _Vacate(_caches, resource);
+   _Vacate(_inline_calls, resource);
+   _Vacate(_named, resource);
+   _Vacate(_bytecode, resource);
+   _Vacate(_operands, resource);
+   _Vacate(_operations, resource);
+   _Vacate(_constants, resource);
+   _Vacate(_literals, resource);
+   _Vacate(_line_start, resource);
+   _arena.Release(first_chunk);
+
+   _code.emplace_back("you should not access line 0", _code.get_allocator()); // line numbers start from 1
+   _sub_calls.clear();
+   _sub_index.clear();
+   _named_ids.clear();
+   _named_values.clear();
+   _named_defined.clear();
+   _compiling_sub = NO_BLOCK;
+   _value_slot = _value_returned_slot = NO_SLOT;
+   _line_start.assign(1, 0);
+   _current_line = 0;
+   if(finish)
+      _AddInstruction(Instruction::END);
+   _program_start = _program_end = 0;
+}
+
+
+///////  C o n f i g u r e  ///////
+// selects the instantiation of _Run() for the current options, once they change (not on every step)
+// the debug output and the journal are only produced by the dynamic one, the seek has its' own
+template<class Number>
+void BasicProgram<Number>::_Configure()
+{
+   typedef bool (BasicProgram::*Runner)(string& line, ExtraInfo& extra);
+   static const Runner runners[8] = {
+      &BasicProgram::_Run<StaticPolicy<false, false, false, 0>>, &BasicProgram::_Run<StaticPolicy<false, false, true, 0>>,
+      &BasicProgram::_Run<StaticPolicy<false, true, false, 0>>, &BasicProgram::_Run<StaticPolicy<false, true, true, 0>>,
+      &BasicProgram::_Run<StaticPolicy<true, false, false, 0>>, &BasicProgram::_Run<StaticPolicy<true, false, true, 0>>,
+      &BasicProgram::_Run<StaticPolicy<true, true, false, 0>>, &BasicProgram::_Run<StaticPolicy<true, true, true, 0>>
+   };
+   if(_seeking)
+      _run = &BasicProgram::_Run<SilentPolicy>;
+   else if(_debug_level > 0 || _journal.size > 0)
+      _run = &BasicProgram::_Run<DynamicPolicy>;
+   else
+      _run = runners[(_block_delete? 4: 0) + (_format_pretty? 2: 0) + (_convert_to_upper? 1: 0)];
+}
+
+
+///////  E n a b l e  P r e t t y  F o r m a t  ///////
+template<class Number>
+void BasicProgram<Number>::EnablePrettyFormat(bool enable)
+{
+   if(_format_pretty != enable){
+      _format_pretty = enable;
+      _Configure();
+      _FormatPlainLines();
+      _cache_reset = ++_clock; // recorded output is not valid
+   }
+}
+
+
+///////  E n a b l e  C o n v e r t  T o  U p p e r  ///////
+template<class Number>
+void BasicProgram<Number>::EnableConvertToUpper(bool enable)
+{
+   if(_convert_to_upper != enable){
+      _convert_to_upper = enable;
+      _Configure();
+      _FormatPlainLines();
+      _cache_reset = ++_clock; // recorded output is not valid
+   }
+}
+
+
+//////////  C l e a r  ////////
+template<class Number>
+void BasicProgram<Number>::Clear()
+{
+   _params.Clear(); // only the pages written since the last time
+   for(size_t slot=0; slot<_named.size(); ++slot)
+      if(_named[slot].global)
+         _named_defined[slot] = 0;
+   _cache_reset = ++_clock;
+   _ClearJournal(); // the values before the steps are not valid
 }
 
 
 //////////  S e t  P a r a m  ////////
-void Program::SetParam(unsigned int number, double value)
+template<class Number>
+void BasicProgram<Number>::SetParam(unsigned int number, double value)
 {
    if(number == 0 || number > TOTAL_CNC_PARAMETERS)
       throw ErrorMsg(this, "Attempt to set unexisting parameter #%d", number);
 
-   if(number <= TOTAL_LOCAL_PARAMETERS)
-      _local_params[number-1] = value;
+   if(number <= TOTAL_LOCAL_PARAMETERS){
+      unsigned int bit = 1u << (number-1);
+      if(!_frames.empty() && (_frames.back().saved & bit) == 0){
+         // the sub doesn't change this one, but it must be restored after return anyway
+         Frame& frame = _frames.back();
+         size_t pos = frame.values;
+         for(unsigned int b=1; b<bit; b<<=1)
+            if(frame.saved & b)
+               ++pos;
+         _frame_values.insert(_frame_values.begin() + pos, _local_params[number-1]);
+         frame.saved |= bit;
+      }
+      _local_params[number-1] = Numeric::FromDouble(value);
+   }
    else
-      _params[number-1] = value;
+      _params.Ref(number-1) = Numeric::FromDouble(value);
+   _cache_reset = ++_clock; // loop-invariant values may depend on it
+}
+
+
+///////  S e t  S t a c k  D e p t h  ///////
+template<class Number>
+void BasicProgram<Number>::SetStackDepth(size_t levels)
+{
+   if(levels < _frames.size())
+      throw ErrorMsg(this, "Stack depth %d is less than the current one", static_cast<int>(levels));
+   _stack_depth = levels;
+   _ReserveStack();
 }
 
 
 //////////  G e t  P a r a m  ////////
-double Program::GetParam(unsigned int number) const
+template<class Number>
+double BasicProgram<Number>::GetParam(unsigned int number) const
 {
    if(number == 0 || number > TOTAL_CNC_PARAMETERS)
       throw ErrorMsg(this, "Attempt to read unexisting parameter #%d", number);
 
    if(number <= TOTAL_LOCAL_PARAMETERS)
-      return _local_params[number-1];
-   return _params[number-1];
+      return Numeric::ToDouble(_local_params[number-1]);
+   return Numeric::ToDouble(_params[number-1]);
 }
 
 
 ///////  G e t  S o u r c e  L i n e  ///////
-const string Program::GetSourceLine(LineNumber num) const
+template<class Number>
+const string BasicProgram<Number>::GetSourceLine(LineNumber num) const
 {
    if(num >= _code.size())
       throw ErrorMsg(this, "Attempt to read non-existing code line #%d", num);
-   return _code[num];
+   return string(_code[num].data(), _code[num].size());
 }
 
 
 /////////////  L o a d  ///////////
-void Program::Load(const string& code)
+// the program is compiled line by line into instructions
+template<class Number>
+void BasicProgram<Number>::Load(const string& code)
 {
-   // fresh restart
-   _code.clear();
-   _code.push_back("you should not access line 0"); // line numbers start from 1
+   // the global named parameters keep their values for the next program (by the name)
+   vector<pair<string, Number>> globals;
+   for(size_t slot=0; slot<_named.size(); ++slot)
+      if(_named[slot].global && _named_defined[slot])
+         globals.push_back(make_pair(_named[slot].name, _named_values[slot]));
+   auto restore = [&](){
+      for(const auto& global: globals){
+         unsigned int slot = _NamedSlot(global.first);
+         _named_values[slot] = global.second;
+         _named_defined[slot] = 1;
+      }
+   };
+
+   // fresh restart, the arena is sized for the program
+   _Reset(false, 1024 + code.size() * ARENA_BYTES_PER_CHAR);
    _current_line = 1; // starts from 1
-   _blocks.clear();
+   _has_calls = false; // the memory of the stack, once reserved, stays
+   _checkpoints.clear();
 
    _percent_start = 0;
    _percent_stop = 0;
 
-   // do analysis line by line
-   string line;
-   stringstream ss(code);
-   for(; getline(ss, line); ++_current_line){
-       _last_used_line = _current_line;
-      _code.push_back(line);
-
-      // prepare the string for processing
-      if(_debug_level > 0)
-         cout << "String to load: " << line << endl;
-
-      if(!line.empty() && line[0] == '%'){ // percent delimiter
-         if(_percent_start == 0)
-            _percent_start = _current_line;
-         else if(_percent_stop == 0)
-            _percent_stop = _current_line;
-         else //TODO: maybe allow many lines with %, but stop at the second instance?
-            throw ErrorMsg(this, "Two many '%%' characters");
-         continue;
-      }
+   try{
+      // do analysis line by line
+      string line;
+      stringstream ss(code);
+      for(; getline(ss, line); ++_current_line){
+          _last_used_line = _current_line;
+         _code.emplace_back(line.data(), line.size(), _code.get_allocator());
+         _line_start.push_back(_bytecode.size());
 
-      _ProcessComments(line); // remove comments
-      _PrepareLine(line); // whitespaces, lowcase
-      _RemoveNword(line);
+         // prepare the string for processing
+         if(_debug_level > 0)
+            cout << "String to load: " << line << endl;
 
-      if(line.empty())
-         continue;
-
-      // detect and process control lines (which starts with O-word)
-      ONumber o_num;
-      string cmd;
-      if(_ReadOword(line, o_num, cmd)){
-         if(_debug_level > 1)
-            cout << "Found o-word 'o" << o_num << "' with command: '" << cmd << "'" << endl;
-         // check if we have not used this o-number before
-         if(cmd != "call"){ // 'call' can appear anywhere, don't process it yet
-            if(_blocks.count(o_num) == 0){
-               // then create the new code block
-               CodeBlock block{CodeBlock::UNDEF, _current_line, vector<LineNumber>(), 0, 0};
-               if(cmd == "sub")
-                  block.type = CodeBlock::SUB;
-               else if(cmd == "if")
-                  block.type = CodeBlock::IF;
-               else if(cmd == "do")
-                  block.type = CodeBlock::DO;
-               else if(cmd == "while")
-                  block.type = CodeBlock::WHILE;
-               else if(cmd == "repeat")
-                  block.type = CodeBlock::REPEAT;
-               else if(cmd == "endsub" || cmd == "return" || cmd == "elseif" || cmd == "else" ||
-                       cmd == "endif" || cmd == "break" || cmd == "continue" ||
-                       cmd == "endwhile" || cmd == "endrepeat")
-                  throw ErrorMsg(this, "Unexpected o-code command '%s'", cmd.c_str());
-               else
-                  throw ErrorMsg(this, "Unrecognised o-code command '%s'", cmd.c_str());
-
-               pair<ONumber, CodeBlock> entry(o_num, block);
-               _blocks.insert(entry);
-               if(_debug_level > 0)
-                  cout << "Created o-block {" << block.start_line << "," <<
-                           block.end_line << "," << block.type << "}" << endl;
-            }
-            else{ // the block with this o-code already exists
-               CodeBlock& block = _blocks[o_num]; // the block with this o-code
-
-                // has the end line been already defined? shouldn't happen
-               if(block.end_line != 0 && cmd != "call") // but 'call' can appear anywhere
-                  throw ErrorMsg(this, "O-code block already finished in line %d", block.end_line-1);
-
-               if(cmd == "sub" || cmd == "if" || cmd == "do" || cmd == "repeat" ||
-                  (cmd == "while" && _blocks[o_num].type != CodeBlock::DO))
-                     throw ErrorMsg(this, "O-number %d is alredy used in line %d",
-                                    o_num, block.start_line);
-
-               // check if the command matches the corresponding block
-               if((cmd == "return" && block.type != CodeBlock::SUB) ||
-                  (cmd == "endsub" && block.type != CodeBlock::SUB) ||
-                  (cmd == "elseif" && block.type != CodeBlock::IF)  ||
-                  (cmd == "else"   && block.type != CodeBlock::IF)  ||
-                  (cmd == "endif"  && block.type != CodeBlock::IF)  ||
-                  (cmd == "while"  && block.type != CodeBlock::DO)  ||
-                  (cmd == "endwhile" && block.type != CodeBlock::WHILE) ||
-                  (cmd == "break" && block.type != CodeBlock::DO && block.type != CodeBlock::WHILE) ||
-                  (cmd == "continue" && block.type != CodeBlock::DO && block.type != CodeBlock::WHILE) ||
-                  (cmd == "endrepeat" && block.type != CodeBlock::REPEAT))
-                     throw ErrorMsg(this, "Unexpected command for o-code block %d", o_num);
-
-               if(cmd == "elseif" || cmd == "else")
-                  block.mid_line.push_back(_current_line);
-
-               // set the end line for this o-block
-               if(cmd == "endsub" || cmd == "endif" || cmd == "while" ||
-                  cmd == "endwhile" || cmd == "endrepeat"){
-                     block.end_line = _current_line + 1;
-               if(_debug_level > 0)
-                  cout << "Finished o-block {" << block.start_line << "," <<
-                           block.end_line << "," << block.type << "}" << endl;
-               }
+         if(!line.empty() && line[0] == '%'){ // percent delimiter
+            if(_percent_start == 0)
+               _percent_start = _current_line;
+            else if(_percent_stop == 0){
+               _percent_stop = _current_line;
+               _AddInstruction(Instruction::END); // the program finishes here
             }
+            else //TODO: maybe allow many lines with %, but stop at the second instance?
+               throw ErrorMsg(this, "Two many '%%' characters");
+            continue;
          }
+
+         _CompileLine(line, 3);
       }
+      // check if percent delimiters are formed correctly
+      if(_percent_start > 0 && _percent_stop <= _percent_start)
+         throw ErrorMsg(this, "No closing '%%' character");
+      if(_debug_level > 1)
+         cout << "Percent (%) demarcation lines from " << _percent_start << " to " << _percent_stop << endl;
+
+      // check if all blocks have been formed correctly
+      for(const auto& id: _block_ids)
+         if(_blocks[id.second].end_line == 0)
+            throw ErrorMsg(this, "o-block %d in line %d doesn't have the end", id.first, _blocks[id.second].start_line);
    }
-   // check if percent delimiters are formed correctly
-   if(_percent_start > 0 && _percent_stop <= _percent_start)
-      throw ErrorMsg(this, "No closing '%%' character");
-   if(_debug_level > 1)
-      cout << "Percent (%) demarcation lines from " << _percent_start << " to " << _percent_stop << endl;
+   catch(ErrorMsg& err){
+      _Reset(); // don't leave half-compiled program
+      restore();
+      Rewind();
+      throw err;
+   }
+
+   // end of the program after the last line
+   _current_line = static_cast<LineNumber>(_code.size() - 1);
+   _AddInstruction(Instruction::END);
+   // jumps beyond the last line (e.g. 'm2' or subroutine at the end) land here
+   _current_line = 0; // don't change the last used line
+   _line_start.push_back(_bytecode.size());
+   _program_end = _bytecode.size();
+   _AddInstruction(Instruction::END);
+
+   _ResolveControls();
+   _HoistInvariants();
+   restore();
+   for(const auto& ins: _bytecode)
+      if(ins.code == Instruction::CALL)
+         _has_calls = true;
+   _ReserveStack();
+   _value_slot = _FindSlot("_value");
+   _value_returned_slot = _FindSlot("_value_returned");
 
-   // check if all blocks have been formed correctly
-   for(auto it=_blocks.begin(); it != _blocks.end(); ++it)
-      if(it->second.end_line == 0)
-         throw ErrorMsg(this, "o-block %d in line %d doesn't have the end", it->first, it->second.start_line);
+   _program_start = (_percent_start > 0)? _line_start[_percent_start]: 0;
+   if(_debug_level > 0)
+      cout << "Compiled " << _bytecode.size() << " instructions" << endl;
 
    Rewind(); // prepare for the next steps
 }
 
 
 ///////////  S t e p  ///////////
-bool Program::Step(string& line, ExtraInfo& extra)
+template<class Number>
+bool BasicProgram<Number>::Step(string& line, ExtraInfo& extra)
 {
+   if(line.capacity() < LINE_BUFFER_SIZE) // it's swapped with the output under construction
+      line.reserve(LINE_BUFFER_SIZE);
+   if(_output.capacity() < LINE_BUFFER_SIZE) // the first step
+      _output.reserve(LINE_BUFFER_SIZE);
+   extra.Reserve(LINE_BUFFER_SIZE);
    extra.Clear();
-   while(_current_line < _code.size()){
-      _last_used_line = _current_line;
-      // program runs only within % delimiters, if they are present
-      if(_percent_start > 0){
-         if(_current_line == _percent_start){
-            _percent_active = true; // activate processing
-            ++_current_line;
-            continue;
+   _output.clear();
+   _pending.clear();
+   if(_journal.size > 0)
+      _StartJournalStep();
+   ++_steps;
+   bool result;
+   try{
+      // the replay may finish the loop and continue, even into the next one to record
+      if(_memo.mode == SubMemo::SERVING)
+         result = _ServeSubCall(line, extra);
+      else
+         result = (_replay.mode == Replay::REPLAYING)? _Replay(line, extra): _Run(line, extra);
+   }
+   catch(ErrorMsg&){
+      _replay.mode = Replay::NONE; // don't record the incomplete iteration
+      _memo.mode = SubMemo::NONE; // or the incomplete call
+      throw;
+   }
+   if(_replay.mode == Replay::RECORDING)
+      _RecordStep(line, extra);
+   if(_memo.mode == SubMemo::RECORDING)
+      _RecordSubStep(line, extra);
+   else if(_memo.mode == SubMemo::CALLED)
+      _memo.mode = SubMemo::RECORDING;
+   if(_journal.recording)
+      _TrimJournal();
+   return result;
+}
+
+
+///////////  R u n  ///////////
+// executes instructions until the next g-code line is ready
+// (or there are messages to deliver, or the program has finished)
+template<class Number>
+template<class Policy>
+bool BasicProgram<Number>::_Run(string& line, ExtraInfo& extra)
+{
+   while(1){
+      const Instruction& ins = _bytecode[_pc++];
+      if(Policy::Silent() && ins.line == _seek_line && _SeekHit(_pc - 1)){
+         --_pc; // the next step starts the line
+         line.clear();
+         return true;
+      }
+      if(ins.line != 0)
+         _last_used_line = ins.line;
+      if(Policy::Debug(3, _debug_level))
+         cout << "Instruction " << (_pc-1) << " (line " << ins.line << "): code " << static_cast<int>(ins.code) << endl;
+
+      switch(ins.code){
+         case Instruction::TEXT:
+            _output += _literals[ins.data];
+            break;
+
+         case Instruction::VALUE:
+            if(Policy::Silent() && _pending.empty() && !_output.empty()){
+               // the seek passes the axes to the modal state, the words which are not modal are not needed
+               Number value = _EvaluateOperand<Policy>(_operands[ins.first]);
+               if(!_modal.Word(_output.back(), Numeric::ToDouble(value), static_cast<int>(ins.data)))
+                  _FormatValue(value, ins.data, _output);
+            }
+            else
+               _FormatValue(_EvaluateOperand<Policy>(_operands[ins.first]), ins.data, _output);
+            break;
+
+         case Instruction::ASSIGN:
+            _output += '#'; // marks the assignment, same as in the source
+            _pending.push_back(make_pair(ins.data, _output.size()));
+            break;
+
+         case Instruction::COMMIT:{
+            // the values are read back from the output (LinuxCNC: assign as the last step)
+            _lengths.resize(_pending.size());
+            for(size_t i=0; i<_pending.size(); ++i){
+               const char* start = _output.c_str() + _pending[i].second;
+               if(*start == '\0' || ((*start < '0' || *start > '9') && *start != '.' && *start != '-'))
+                  throw ErrorMsg(this, "Error in the value to assign");
+               char* last_ptr;
+               Number value = Numeric::Parse(start, &last_ptr);
+               _lengths[i] = last_ptr - start;
+               _AssignOperand<Policy>(_operands[_pending[i].first], value);
+            }
+            // remove assignments from the output, starting from the end
+            for(size_t i=_pending.size(); i>0; --i)
+               _output.erase(_pending[i-1].second - 1, _lengths[i-1] + 1);
+            _pending.clear();
+            break;
          }
-         else if(_current_line == _percent_stop){
-            _current_line = static_cast<LineNumber>(_code.size()); // finished: move to the last line
-            continue;
+
+         case Instruction::MESSAGE:
+            extra.Assign(static_cast<ExtraInfo::Type>(ins.data), _output);
+            _output.clear();
+            if(Policy::Silent())
+               _modal.Discard(); // the values of the message
+            break;
+
+         case Instruction::BLOCK_DELETE:
+            if(Policy::BlockDelete(_block_delete))
+               _pc = ins.data + 1; // skip the line
+            break;
+
+         case Instruction::OUTPUT:
+            if(_output.compare(0, 2, "m2") == 0 || _output.compare(0, 3, "m30") == 0)
+               _pc = _program_end; // make it the last line
+            if(Policy::PrettyFormat(_format_pretty))
+               _InsertSpaces(_output);
+            if(Policy::ConvertToUpper(_convert_to_upper))
+               _ConvertToUpper(_output);
+            if(!_output.empty() || extra.FirstNonEmpty()){
+               line.swap(_output);
+               _output.clear();
+               return true; // G-code line is ready to go! (or active comment)
+            }
+            break;
+
+         case Instruction::PLAIN:
+            if(ins.flush)
+               _pc = _program_end; // m2 or m30
+            line = _literals[ins.data];
+            return true;
+
+         case Instruction::FLUSH:
+            if(extra.FirstNonEmpty()){ // there were messages to process
+               line.clear();
+               return true;
+            }
+            break;
+
+         case Instruction::ERROR:
+            throw ErrorMsg(this, "%s", _literals[ins.data].c_str());
+
+         case Instruction::ENTER:{ // same as 'call', but only the changed local parameters are preserved
+            const InlineCall& call = _inline_calls[ins.data];
+            _EvaluateArguments<Policy>(ins);
+            if(_frames.size() >= _stack_depth)
+               throw ErrorMsg(this, "Stack overflow calling sub %d", call.number);
+            for(auto i: call.locals){
+               if(Policy::Journal(_journal.recording))
+                  _Journal(JournalWrite::SAVED_LOCAL, i);
+               _saved_locals[i] = _local_params[i];
+            }
+            size_t to_copy = min(_arguments.size(), _local_params.size());
+            for(size_t i=0; i<to_copy; ++i){
+               if(Policy::Journal(_journal.recording))
+                  _Journal(JournalWrite::LOCAL, i);
+               _local_params[i] = _arguments[i];
+            }
+            if(ins.flush && extra.FirstNonEmpty()){
+               line.clear();
+               return true;
+            }
+            break;
          }
-         else if(!_percent_active){
-            ++_current_line; // skip non-active lines
-            continue;
+
+         case Instruction::LEAVE:
+            _EvaluateArguments<Policy>(ins);
+            _ReturnValue(!_arguments.empty(), _arguments.empty()? Number(): _arguments[0]);
+            for(auto i: _inline_calls[ins.data].locals){
+               if(Policy::Journal(_journal.recording))
+                  _Journal(JournalWrite::LOCAL, i);
+               _local_params[i] = _saved_locals[i];
+            }
+            if(ins.flush && extra.FirstNonEmpty()){
+               line.clear();
+               return true;
+            }
+            break;
+
+         case Instruction::END:
+            --_pc; // stay at the end
+            line.clear();
+            return false;
+
+         default:{ // o-word commands
+            bool recording = (_memo.mode == SubMemo::RECORDING);
+            _RunControl<Policy>(ins);
+            if(_memo.mode == SubMemo::RETURNED)
+               _StoreSubCall(extra); // the messages of the 'return' line belong to the call
+            if(ins.flush && extra.FirstNonEmpty()){
+               if(!recording && _memo.mode == SubMemo::RECORDING)
+                  _memo.mode = SubMemo::CALLED; // the messages of the 'call' line don't, the recording starts with the next step
+               line.clear();
+               return true;
+            }
+            if(_memo.mode == SubMemo::SERVING)
+               return _ServeSubCall(line, extra);
+            if(_replay.complete && _replay.mode == Replay::RECORDING && _StartReplay())
+               return _Replay(line, extra); // the first step of the second iteration
+            break;
          }
       }
+   }
+}
+
 
-      line = _code[_current_line];
-      if(_debug_level > 0)
-         cout << "Step to line (" << _current_line << "): " << line << endl;
+///////////  R u n  C o n t r o l  ///////////
+// flow control: o-word commands
+// without a jump the execution continues with the next line
+template<class Number>
+template<class Policy>
+void BasicProgram<Number>::_RunControl(const Instruction& ins)
+{
+   static const char* names[] = {"sub", "call", "return", "if", "elseif", "else",
+                                 "while", "endwhile", "repeat", "endrepeat", "break", "continue", "do"};
+   const Control& control = _controls[ins.data];
+   if(control.native != NO_NATIVE){ // 'call' of the sub registered by the host
+      _EvaluateArguments<Policy>(ins);
+      _CallNativeSub(ins, control);
+      return;
+   }
+   if(control.block == NO_BLOCK)
+      throw ErrorMsg(this, "O-block number %d is not found", control.number);
+   CodeBlock& block = _blocks[control.block]; // the block with this o-code
 
-      // standard operations before processing
-      _current_internal_param = INTERNAL_PARAMETERS_START-1;
-      _ProcessComments(line, &extra); // remove comments, check for commands
-      _PrepareLine(line); // whitespaces, lowcase
-      _RemoveNword(line);
+   // entering the loop: the values cached during the previous run are not valid anymore
+   if(ins.code == Instruction::DO || ins.code == Instruction::REPEAT ||
+      (ins.code == Instruction::WHILE && ins.line == block.start_line && !_loop_back))
+         block.entry = ++_clock;
+   _loop_back = false;
 
-      if(line.empty()){
-         ++_current_line;
-         if(extra.FirstNonEmpty()) // there were messages to process
-            return true;
-         continue;
-      }
+   if(Policy::Journal(_journal.recording) && (ins.code == Instruction::ENDREPEAT || ins.code == Instruction::REPEAT ||
+                                              ins.code == Instruction::IF || ins.code == Instruction::ELSEIF))
+      _Journal(JournalWrite::RUN_TIMES, control.block);
 
-      // detect and process control lines (which starts with O-word)
-      string cmd;
-      ONumber o_num;
-      if(_ReadOword(line, o_num, cmd)){ // flow control
-         LineNumber next_line = _current_line + 1;
-         if(_blocks.count(o_num) == 0)
-            throw ErrorMsg(this, "O-block number %d is not found", o_num);
-         CodeBlock& block = _blocks[o_num]; // the block with this o-code
-         // commands that don't have a parameter following
-         if(cmd == "sub")
-            next_line = block.end_line; // skip the subroutine completely
-         else if(cmd == "break")
-            next_line = block.end_line; // exit the current block
-         else if(cmd == "continue")
-            next_line = block.end_line - 1; // to the last line of the loop
-         else if(cmd == "endwhile")
-            next_line = block.start_line; // back to check the loop condition again
-         else if(cmd == "endrepeat"){
-            if(--block.run_times > 0) // have we finished repeating?
-               next_line = block.start_line + 1; // if not: go straight after 'repeat'
+   switch(ins.code){
+      // commands that don't have a parameter following
+      case Instruction::SUB: // skip the subroutine completely
+      case Instruction::BREAK: // exit the current block
+         _pc = control.exit;
+         break;
+      case Instruction::CONTINUE:
+         _pc = control.jump;
+         break;
+      case Instruction::ENDWHILE:
+         _loop_back = true;
+         _pc = control.jump;
+         break;
+      case Instruction::DO:
+         break;
+      case Instruction::ENDREPEAT:
+         if(--block.run_times > 0){ // have we finished repeating?
+            _pc = control.jump; // if not: go straight after 'repeat'
+            if(_replay.mode == Replay::RECORDING && _replay.block == control.block)
+               _replay.complete = true;
          }
-         else if(cmd == "else"){
-            if(block.run_times != 0) // just finished with 'if' body
-               next_line = block.end_line;
+         break;
+      case Instruction::ELSE:
+         if(block.run_times != 0) // just finished with 'if' body
+            _pc = control.exit;
+         break;
+
+      default:{
+         // the following commands may contain a parameter after the command
+         _EvaluateArguments<Policy>(ins);
+
+         if(ins.code == Instruction::CALL){
+            if(block.type != CodeBlock::SUB)
+               throw ErrorMsg(this, "Cannot find sub %d to call", control.number);
+            if(_frames.size() >= _stack_depth)
+               throw ErrorMsg(this, "Stack overflow calling sub %d", control.number);
+            if(block.pure && Policy::Remember(_journal.size == 0) && _FindSubCall(ins, control.block))
+               break; // the same call has been recorded before
+            _PushFrame(_line_start[ins.line + 1], control.locals, control.block); // preserve local params for after return from subroutine
+            // _local_params.fill(0); // LinuxCNC OCodes: keep "the same value as in the calling context"
+            size_t to_copy = min(_arguments.size(), _local_params.size());
+            for(size_t i=0; i<to_copy; ++i){
+               if(Policy::Journal(_journal.recording))
+                  _Journal(JournalWrite::LOCAL, static_cast<unsigned int>(i));
+               _local_params[i] = _arguments[i]; // assign arguments from the 'call' line
+            }
+            _pc = control.jump; // next after 'sub' declaration
+            break;
          }
-         else if(cmd != "do" && cmd != "endif"){
-            // the following commands may contain a parameter after the command
-            vector<double> arguments; // expressions as arguments
-            _SimplifyOperators(line);
-            _CalculateExpressions(line, &arguments);
-            if(_debug_level > 0)
-               cout << "Found " << arguments.size() << " argument(s)" << endl;
-            if(_debug_level > 1){
-               cout << "Arguments values:";
-               for(const auto& value: arguments)
-                  cout << " " << value;
-               cout << endl;
+         if(ins.code == Instruction::RETURN){
+            _ReturnValue(!_arguments.empty(), _arguments.empty()? Number(): _arguments[0]);
+            if(_frames.empty())
+               throw ErrorMsg(this, "Stack underrun returning form sub %d", control.number);
+            if(_memo.mode == SubMemo::RECORDING && _frames.size() == _memo.depth){
+               _memo.call.has_value = !_arguments.empty();
+               _memo.call.value = _memo.call.has_value? _arguments[0]: Number();
+               _memo.call.return_line = ins.line;
+               _memo.mode = SubMemo::RETURNED;
             }
+            _PopFrame();
+            break;
+         }
 
-            if(cmd == "call"){
-               if(block.type != CodeBlock::SUB)
-                  throw ErrorMsg(this, "Cannot find sub %d to call", o_num);
-               if(_return_stack.size() >= MAX_STACK_LEVELS)
-                  throw ErrorMsg(this, "Stack overflow calling sub %d", o_num);
-               _return_stack.push(next_line);
-               _param_stack.push(_local_params); // preserve local params for after return from subroutine
-               // _local_params.fill(0); // LinuxCNC OCodes: keep "the same value as in the calling context"
-               if(!arguments.empty()){
-                  size_t to_copy = min(arguments.size(), _local_params.size());
-                  for(size_t i=0; i<to_copy; ++i)
-                     _local_params[i] = arguments[i]; // assign arguments from the 'call' line
-               }
-               next_line = block.start_line + 1; // next after 'sub' declaration
+         // the following commands require at least one parameter after the command
+         if(_arguments.empty())
+            throw ErrorMsg(this, "No arguments specified for '%s' command", names[ins.code - Instruction::SUB]);
+
+         Number argument = _arguments[0];
+         if(ins.code == Instruction::REPEAT){
+            block.run_times = static_cast<int>(Numeric::ToDouble(argument));
+            if(block.steady && block.run_times > 1 && _replay.mode == Replay::NONE && Policy::Remember(_journal.size == 0)){
+               _replay.mode = Replay::RECORDING; // the first iteration
+               _replay.block = control.block;
+               _replay.complete = false;
+               _replay.steps.clear();
+               _replay.time = ++_clock;
             }
-            else if(cmd == "return" || cmd == "endsub"){
-               if(!arguments.empty()) // any return value?
-                  _params[RETURN_VALUE_PARAMETER-1] = arguments[0];
-               if(_return_stack.empty())
-                  throw ErrorMsg(this, "Stack underrun returning form sub %d", o_num);
-               _local_params = _param_stack.top(); _param_stack.pop();
-               next_line = _return_stack.top(); _return_stack.pop();
+         }
+         else if(ins.code == Instruction::WHILE)
+            _pc = (argument == Number())? control.exit: control.jump; // finished with the loop?
+         else if(ins.code == Instruction::IF){
+            block.run_times = (argument != Number())? 1: 0;
+            if(argument == Number()){
+               _pc = control.jump; // goto the next mid-line
+               if(control.table != NO_TABLE){ // or straight to the matching 'elseif' branch
+                  const JumpTable& table = _jump_tables[control.table];
+                  Number value = _Param(table.parameter);
+                  Number key = Numeric::Round(value); // the only constant which may be equal
+                  auto branch = (Numeric::Abs(value - key) < Numeric::Tolerance())?
+                                 table.branches.find(Numeric::ToDouble(key)): table.branches.end();
+                  if(branch != table.branches.end()){
+                     block.run_times = 1;
+                     _pc = branch->second;
+                  }
+                  else
+                     _pc = table.other;
+               }
             }
+         }
+         else if(ins.code == Instruction::ELSEIF){
+            if(block.run_times != 0)
+               _pc = control.exit; // just finished the previous 'if' body
             else{
-               // the following commands require at least one parameter after the command
-               if(line.empty() || arguments.empty())
-                  throw ErrorMsg(this, "No arguments specified for '%s' command", cmd.c_str());
-
-               double argument = arguments[0]; //stod(line);
-
-               if(cmd == "repeat")
-                  block.run_times = static_cast<int>(argument);
-               else if(cmd == "while"){
-                  if(argument == 0.0)
-                     next_line = block.end_line; // finished with the loop
-                  else if(_current_line != block.start_line)
-                     next_line = block.start_line + 1; // this is 'do-while' loop
-               }
-               else if(cmd == "if"){
-                  block.run_times = (argument != 0.0)? 1: 0;
-                  if(argument == 0.0)
-                     next_line = (block.mid_line.empty())? block.end_line: block.mid_line[0];
-               }
-               else if(cmd == "elseif"){
-                  if(block.run_times != 0)
-                     next_line = block.end_line; // just finished the previous 'if' body
-                  else{
-                     block.run_times = (argument != 0.0)? 1: 0;
-                     if(argument == 0.0){ // goto the next mid-line
-                        auto it = find(block.mid_line.begin(), block.mid_line.end(), _current_line);
-                        next_line = (it<block.mid_line.end()-1)? *(it+1): block.end_line;
-                     }
-                  }
+               block.run_times = (argument != Number())? 1: 0;
+               if(argument == Number())
+                  _pc = control.jump; // goto the next mid-line
+            }
+         }
+         break;
+      }
+   }
+}
+
+
+///////////  P u s h  F r a m e  ///////////
+// saves the local parameters (bits) and the return address before the call
+// the named parameters of the called <block> are saved as well, the sub starts without them
+// no allocations: the space is reserved by SetStackDepth() (unless the subs use named parameters)
+template<class Number>
+void BasicProgram<Number>::_PushFrame(size_t return_pc, unsigned int locals, unsigned int block)
+{
+   Frame frame = {return_pc, locals, _frame_values.size(), block};
+   for(unsigned int i=0; locals != 0; ++i, locals >>= 1)
+      if(locals & 1)
+         _frame_values.push_back(_local_params[i]);
+   if(block != NO_BLOCK){ // not the host sub
+      for(auto slot: _blocks[block].named){
+         _frame_values.push_back(_named_values[slot]);
+         _frame_values.push_back(_named_defined[slot]? Number(1): Number());
+         if(_journal.recording)
+            _Journal(JournalWrite::DEFINED, slot);
+         _named_defined[slot] = 0;
+      }
+   }
+   _frames.push_back(frame);
+   if(_journal.recording)
+      _Journal(JournalWrite::PUSH);
+}
+
+
+///////////  P o p  F r a m e  ///////////
+// restores the local parameters and continues after the call
+template<class Number>
+void BasicProgram<Number>::_PopFrame()
+{
+   if(_journal.recording)
+      _Journal(JournalWrite::POP); // with the values it restores
+   const Frame& frame = _frames.back();
+   size_t pos = frame.values;
+   unsigned int saved = frame.saved;
+   for(unsigned int i=0; saved != 0; ++i, saved >>= 1)
+      if(saved & 1)
+         _local_params[i] = _frame_values[pos++];
+   if(frame.block != NO_BLOCK){
+      for(auto slot: _blocks[frame.block].named){
+         _named_values[slot] = _frame_values[pos++];
+         _named_defined[slot] = (_frame_values[pos++] != Number());
+      }
+   }
+   _frame_values.resize(frame.values);
+   _pc = frame.return_pc;
+   _frames.pop_back();
+}
+
+
+///////////  R e s e r v e  S t a c k  ///////////
+// the frames of the sub calls never allocate memory, once it is reserved for the loaded program
+template<class Number>
+void BasicProgram<Number>::_ReserveStack()
+{
+   if(!_has_calls)
+      return;
+   _frames.reserve(_stack_depth);
+   _frame_values.reserve(_stack_depth * TOTAL_LOCAL_PARAMETERS);
+}
+
+
+///////////  R e t u r n  V a l u e  ///////////
+// the value returned by the sub goes to #5000 and #<_value> (if used), #<_value_returned> tells if there was any
+template<class Number>
+void BasicProgram<Number>::_ReturnValue(bool returned, Number value)
+{
+   if(_journal.recording){
+      if(returned)
+         _Journal(JournalWrite::GLOBAL, RETURN_VALUE_PARAMETER-1);
+      if(returned && _value_slot != NO_SLOT)
+         _Journal(JournalWrite::NAMED, _value_slot);
+      if(_value_returned_slot != NO_SLOT)
+         _Journal(JournalWrite::NAMED, _value_returned_slot);
+   }
+   if(returned)
+      _params.Ref(RETURN_VALUE_PARAMETER-1) = value;
+   if(returned && _value_slot != NO_SLOT){
+      _named_values[_value_slot] = value;
+      _named_defined[_value_slot] = 1;
+   }
+   if(_value_returned_slot != NO_SLOT){
+      _named_values[_value_returned_slot] = returned? Number(1): Number();
+      _named_defined[_value_returned_slot] = 1;
+   }
+}
+
+
+///////////  E v a l u a t e  A r g u m e n t s  ///////////
+// o-word command arguments, the values are placed in _arguments
+template<class Number>
+template<class Policy>
+void BasicProgram<Number>::_EvaluateArguments(const Instruction& ins)
+{
+   _arguments.clear();
+   for(unsigned int i=0; i<ins.count; ++i)
+      _arguments.push_back(_EvaluateOperand<Policy>(_operands[ins.first + i]));
+   if(Policy::Debug(0, _debug_level))
+      cout << "Found " << _arguments.size() << " argument(s)" << endl;
+   if(Policy::Debug(1, _debug_level)){
+      cout << "Arguments values:";
+      for(const auto& value: _arguments)
+         cout << " " << Numeric::ToDouble(value);
+      cout << endl;
+   }
+}
+
+
+////////  E v a l u a t e O p e r a n d  ////////
+template<class Number>
+template<class Policy>
+Number BasicProgram<Number>::_EvaluateOperand(const Operand& op)
+{
+   return _Evaluate<Policy>(op.first, op.first + op.count);
+}
+
+
+////////  E v a l u a t e  ////////
+// executes the operations of the compiled expression over the stack of values
+// the operations are of the program or of the host expression (no CACHED and NAMED ones there)
+template<class Number>
+template<class Policy>
+Number BasicProgram<Number>::_Evaluate(const Operation* operations, const Number* constants, size_t first, size_t last)
+{
+   const Number zero = Number(), one = Number(1);
+   _stack.clear();
+   for(size_t i=first; i<last; ++i){
+      const Operation& op = operations[i];
+      if(op.code == Operation::NUMBER){
+         _stack.push_back(constants[op.nref]);
+         continue;
+      }
+      if(op.code >= Operation::CACHED){ // nothing is taken from the stack
+         switch(op.code){
+            case Operation::CACHED:{
+               const Cache& cache = _caches[op.nref];
+               if(cache.time > _blocks[cache.block].entry && cache.time > _cache_reset){
+                  _stack.push_back(cache.value);
+                  i = cache.end; // skip the calculation
                }
+               break;
             }
+            case Operation::STORE:{
+               Cache& cache = _caches[op.nref];
+               cache.value = _stack.back();
+               cache.time = ++_clock;
+               break;
+            }
+            case Operation::NAMED:
+               if(!_named_defined[op.nref])
+                  throw ErrorMsg(this, "Named parameter #<%s> is not defined", _named[op.nref].name.c_str());
+               _stack.push_back(_named_values[op.nref]);
+               break;
+            default: // DEFINED
+               _stack.push_back(_named_defined[op.nref]? one: zero);
          }
-         _current_line = next_line;
-         line.clear();
-         if(extra.FirstNonEmpty())
-            return true; // G-code line is ready to go! (or active comment)
+         continue;
+      }
+
+      Number& lhs = _stack[_stack.size() - ((op.code > Operation::NEGATE && op.code < Operation::FUNCTION)? 2: 1)];
+      Number rhs = _stack.back();
+      switch(op.code){
+         case Operation::PARAMETER: // unwind references
+            for(unsigned int nref = op.nref; nref > 0; --nref){
+               size_t idx = Numeric::Index(lhs);
+               if(idx == 0 || idx > TOTAL_PARAMETERS)
+                  throw ErrorMsg(this, "Parameter #%d does not exist", idx);
+               lhs = (idx <= TOTAL_LOCAL_PARAMETERS)? _local_params[idx-1]: _params[idx-1];
+            }
+            continue;
+         case Operation::NEGATE:
+            lhs = -lhs;
+            continue;
+         case Operation::FUNCTION:
+            if(op.func == ATAN){ // two arguments
+               _stack.pop_back();
+               _stack.back() = _ApplyFunction(op.func, _stack.back(), rhs);
+            }
+            else if(op.func == NATIVE)
+               _CallNative(op.nref);
+            else
+               lhs = _ApplyFunction(op.func, lhs);
+            continue;
+
+         case Operation::ADD:      lhs = lhs + rhs; break;
+         case Operation::SUBTRACT: lhs = lhs - rhs; break;
+         case Operation::MULTIPLY: lhs = lhs * rhs; break;
+         case Operation::DIVIDE:   lhs = lhs / rhs; break;
+         case Operation::MODULO:   lhs = Numeric::Mod(lhs, rhs); break; // same as fmod()
+         case Operation::POWER:    lhs = Numeric::Pow(lhs, rhs); break;
+
+         // simple tolerance-based comparison may not be effective in all cases
+         //  but let's follow LinuxCNC approach for now
+         case Operation::EQ: lhs = (Numeric::Abs(lhs - rhs) < Numeric::Tolerance())? one: zero; break;
+         case Operation::NE: lhs = (Numeric::Abs(lhs - rhs) >= Numeric::Tolerance())? one: zero; break;
+         case Operation::LT: lhs = (lhs < rhs)? one: zero; break;
+         case Operation::LE: lhs = (lhs <= rhs)? one: zero; break;
+         case Operation::GT: lhs = (lhs > rhs)? one: zero; break;
+         case Operation::GE: lhs = (lhs >= rhs)? one: zero; break;
+
+         case Operation::AND: lhs = (lhs!=zero && rhs!=zero)? one: zero; break;
+         case Operation::OR:  lhs = (lhs!=zero || rhs!=zero)? one: zero; break;
+         case Operation::XOR: lhs = ((lhs!=zero && rhs==zero) || (lhs==zero && rhs!=zero))? one: zero; break;
+         default: break;
+      }
+      _stack.pop_back(); // binary operation: the result replaces the left operand
+   }
+   if(Policy::Debug(3, _debug_level))
+      cout << "Evaluated " << (last - first) << " operation(s): " << Numeric::ToDouble(_stack.back()) << endl;
+   return _stack.back();
+}
+
+
+////////  E v a l u a t e  ////////
+// the expressions evaluated while loading the program
+template<class Number>
+Number BasicProgram<Number>::_Evaluate(size_t first, size_t last)
+{
+   return _Evaluate<DynamicPolicy>(first, last);
+}
+
+
+////////  E v a l u a t e  ////////
+// the expression of the host, the stack has enough memory since it was compiled
+template<class Number>
+Number BasicProgram<Number>::Evaluate(const CompiledExpression& expression)
+{
+   if(expression.operations.empty())
+      throw ErrorMsg(this, "The expression is not compiled");
+   if(_debug_level > 0)
+      return _Evaluate<DynamicPolicy>(expression.operations.data(), expression.constants.data(),
+                                      0, expression.operations.size());
+   return _Evaluate<StaticPolicy<false, false, false, 0>>(expression.operations.data(), expression.constants.data(),
+                                                           0, expression.operations.size());
+}
+
+
+////////  E v a l u a t e  ////////
+// the parameters are assigned directly: the values of the loop-invariant expressions stay valid,
+//  because every parameter has its' own value again when the evaluations are over
+template<class Number>
+void BasicProgram<Number>::Evaluate(const CompiledExpression& expression, const unsigned int* numbers, size_t count,
+                                    const double* values, size_t rows, double* results)
+{
+   for(size_t i=0; i<count; ++i)
+      if(numbers[i] == 0 || numbers[i] > TOTAL_CNC_PARAMETERS)
+         throw ErrorMsg(this, "Attempt to set unexisting parameter #%d", numbers[i]);
+
+   _overridden.clear();
+   for(size_t i=0; i<count; ++i)
+      _overridden.push_back(_Param(numbers[i]));
+   try{
+      for(size_t row=0; row<rows; ++row){
+         for(size_t i=0; i<count; ++i)
+            _ParamRef(numbers[i]) = Numeric::FromDouble(values[row * count + i]);
+         results[row] = Numeric::ToDouble(Evaluate(expression));
       }
-      else{ // non-control G-code
-         ++_current_line;
-         _SimplifyOperators(line);
-         _CalculateExpressions(line);
-         _ResolveParameters(line, 3);
-
-         if(line.substr(0, 2) == "m2" || line.substr(0, 3) == "m30")
-            _current_line = static_cast<LineNumber>(_code.size()); // make it the last line
-
-         _FormatPretty(line);
-         if(!line.empty() || extra.FirstNonEmpty())
-            return true; // G-code line is ready to go! (or active comment)
+   }
+   catch(ErrorMsg&){
+      for(size_t i=count; i>0; --i) // the first one is restored last, if the number is repeated
+         _ParamRef(numbers[i-1]) = _overridden[i-1];
+      throw;
+   }
+   for(size_t i=count; i>0; --i)
+      _ParamRef(numbers[i-1]) = _overridden[i-1];
+}
+
+
+////////  A s s i g n  O p e r a n d  ////////
+// <target> is the parameter operand, all its references except the last one are unwound
+template<class Number>
+template<class Policy>
+void BasicProgram<Number>::_AssignOperand(const Operand& target, Number value)
+{
+   const Operation& param = _operations[target.first + target.count - 1];
+   if(param.code == Operation::NAMED){ // #<name>
+      if(Policy::Debug(0, _debug_level))
+         cout << "Assigning value " << Numeric::ToDouble(value) << " to parameter #<" << _named[param.nref].name << ">" << endl;
+      if(Policy::Journal(_journal.recording))
+         _Journal(JournalWrite::NAMED, param.nref);
+      _named_values[param.nref] = value;
+      _named_defined[param.nref] = 1;
+      return;
+   }
+   Number index = _Evaluate<Policy>(target.first, target.first + target.count - 1);
+   size_t idx = 0;
+   for(unsigned int nref = param.nref; nref > 0; --nref){
+      idx = Numeric::Index(index);
+      if(idx == 0 || idx > TOTAL_PARAMETERS)
+         throw ErrorMsg(this, "Parameter #%d does not exist", idx);
+      if(nref > 1)
+         index = (idx <= TOTAL_LOCAL_PARAMETERS)? _local_params[idx-1]: _params[idx-1];
+   }
+   if(Policy::Debug(0, _debug_level))
+      cout << "Assigning value " << Numeric::ToDouble(value) << " to parameter #" << idx << endl;
+   if(Policy::Journal(_journal.recording))
+      _Journal((idx <= TOTAL_LOCAL_PARAMETERS)? JournalWrite::LOCAL: JournalWrite::GLOBAL, static_cast<unsigned int>(idx-1));
+
+   if(idx <= TOTAL_LOCAL_PARAMETERS)
+      _local_params[idx-1] = value;
+   else // global
+      _params.Ref(idx-1) = value;
+}
+
+
+///////////  R e c o r d  S t e p  ///////////
+// keeps the result of the step in the first iteration of the steady 'repeat' loop
+template<class Number>
+void BasicProgram<Number>::_RecordStep(const string& line, const ExtraInfo& extra)
+{
+   const CodeBlock& block = _blocks[_replay.block];
+   LineNumber at = _last_used_line; // where the step has finished
+   if(_replay.time <= _cache_reset || _pc == _program_end || at < block.start_line || at >= block.end_line){
+      _replay.mode = Replay::NONE; // left the loop or something has changed
+      return;
+   }
+   if(at == block.start_line) // messages in the 'repeat' line are not part of the iteration
+      return;
+
+   ReplayStep step = {line, extra, _last_used_line, _pc};
+   _replay.steps.push_back(step);
+   if(_replay.complete)
+      _StartReplay(); // the last step was in the 'endrepeat' line
+}
+
+
+///////////  S t a r t  R e p l a y  ///////////
+// after the first iteration of the steady 'repeat' loop, replay the recorded steps
+template<class Number>
+bool BasicProgram<Number>::_StartReplay()
+{
+   if(_replay.steps.empty() || _replay.time <= _cache_reset){
+      _replay.mode = Replay::NONE; // nothing to replay, just run it
+      return false;
+   }
+   _replay.mode = Replay::REPLAYING;
+   _replay.next = 0;
+   _replay.remaining = _blocks[_replay.block].run_times;
+   if(_debug_level > 1)
+      cout << "Replaying " << _replay.steps.size() << " step(s) of the loop in line " <<
+               _blocks[_replay.block].start_line << " " << _replay.remaining << " time(s)" << endl;
+   return true;
+}
+
+
+///////////  R e p l a y  ///////////
+// produces the next recorded step
+// if parameters or the format have been changed in the meantime, the rest is executed as usual
+template<class Number>
+bool BasicProgram<Number>::_Replay(string& line, ExtraInfo& extra)
+{
+   CodeBlock& block = _blocks[_replay.block];
+   if(_replay.next == _replay.steps.size()){ // the iteration is finished
+      _replay.next = 0;
+      block.run_times = --_replay.remaining;
+      if(_replay.remaining == 0){ // so is the loop
+         _replay.mode = Replay::NONE;
+         _pc = _line_start[block.end_line];
+         return _Run(line, extra);
       }
    }
-   line.clear();
-   return false; // current line is beyond the code lines
+
+   if(_replay.time <= _cache_reset){
+      _replay.mode = Replay::NONE;
+      _pc = (_replay.next == 0)? _line_start[block.start_line + 1]: _replay.steps[_replay.next - 1].pc;
+      return _Run(line, extra);
+   }
+
+   const ReplayStep& step = _replay.steps[_replay.next++];
+   line = step.line;
+   extra = step.extra;
+   _last_used_line = step.line_number;
+   return true;
+}
+
+
+///////////  F i n d  S u b  C a l l  ///////////
+// looks for the remembered call of the pure sub with the same values of the parameters it reads
+// if found, it's served instead of the call (true on return), otherwise the call is recorded
+template<class Number>
+bool BasicProgram<Number>::_FindSubCall(const Instruction& ins, unsigned int block)
+{
+   if(_sub_cache_size == 0 || _memo.mode != SubMemo::NONE)
+      return false;
+
+   vector<Number>& key = _memo.call.key;
+   key.clear();
+   key.push_back(Numeric::FromDouble(block));
+   key.push_back(Numeric::FromDouble((_block_delete? 1: 0) + (_format_pretty? 2: 0) + (_convert_to_upper? 4: 0)));
+   unsigned int reads = _blocks[block].reads;
+   for(size_t i=0; reads != 0; ++i, reads >>= 1){
+      if(reads & 1)
+         key.push_back((i < _arguments.size())? _arguments[i]: _local_params[i]);
+      if(Numeric::IsNan(key.back()) || Numeric::IsNegativeZero(key.back()))
+         return false; // NaN can't be the key, -0 may be printed differently
+   }
+
+   auto found = _sub_index.find(key);
+   if(found == _sub_index.end()){
+      _memo.mode = SubMemo::RECORDING;
+      _memo.call.steps.clear();
+      _memo.depth = _frames.size() + 1; // incl. the frame of this call
+      _memo.time = ++_clock;
+      return false;
+   }
+
+   _sub_calls.splice(_sub_calls.begin(), _sub_calls, found->second); // the most recently used
+   _memo.mode = SubMemo::SERVING;
+   _memo.served = &_sub_calls.front();
+   _memo.next = 0;
+   _pc = _line_start[ins.line + 1]; // continue after the call
+   if(_debug_level > 1)
+      cout << "Serving " << _memo.served->steps.size() << " step(s) of the call in line " << ins.line << endl;
+   return true;
+}
+
+
+///////////  R e c o r d  S u b  S t e p  ///////////
+// keeps the result of the step inside the pure sub call
+template<class Number>
+void BasicProgram<Number>::_RecordSubStep(const string& line, const ExtraInfo& extra)
+{
+   if(_memo.time <= _cache_reset || _pc == _program_end || _memo.call.steps.size() == MAX_SUB_CALL_STEPS){
+      _memo.mode = SubMemo::NONE; // parameters changed from outside, m2 or too long to remember
+      return;
+   }
+   ReplayStep step = {line, extra, _last_used_line, _pc};
+   _memo.call.steps.push_back(step);
 }
+
+
+///////////  S t o r e  S u b  C a l l  ///////////
+// remembers the recorded call, the least recently used one is dropped if there are too many
+template<class Number>
+void BasicProgram<Number>::_StoreSubCall(const ExtraInfo& extra)
+{
+   _memo.mode = SubMemo::NONE;
+   if(_memo.time <= _cache_reset || _sub_cache_size == 0)
+      return;
+   while(!_sub_calls.empty() && _sub_calls.size() >= _sub_cache_size){
+      _sub_index.erase(_sub_calls.back().key);
+      _sub_calls.pop_back();
+   }
+   _memo.call.extra = extra;
+   _sub_calls.push_front(move(_memo.call));
+   _sub_index[_sub_calls.front().key] = _sub_calls.begin();
+}
+
+
+///////////  S e r v e  S u b  C a l l  ///////////
+// produces the next step of the remembered call, then continues after the call
+template<class Number>
+bool BasicProgram<Number>::_ServeSubCall(string& line, ExtraInfo& extra)
+{
+   const SubCall& call = *_memo.served;
+   if(_memo.next < call.steps.size()){
+      const ReplayStep& step = call.steps[_memo.next++];
+      line = step.line;
+      extra = step.extra;
+      _last_used_line = step.line_number;
+      return true;
+   }
+
+   _memo.mode = SubMemo::NONE;
+   _ReturnValue(call.has_value, call.value);
+   _last_used_line = call.return_line;
+   if(call.extra.FirstNonEmpty()){
+      extra = call.extra;
+      line.clear();
+      return true;
+   }
+   return _Run(line, extra);
+}
+
+
+template class gsharp::BasicProgram<double>;
+template class gsharp::BasicProgram<float>;
+template class gsharp::BasicProgram<gsharp::Fixed>;
@@ -34,59 +34,457 @@
 #include <cmath>
 #include <array>
 #include <vector>
+#include <list>
+#include <map>
+#include <set>
 #include <string>
-#include <stack>
+#include <iosfwd>
+#include <functional>
+#include <exception>
 #include <unordered_map>
 #include "gsharp_extra.h"
+#include "gsharp_number.h"
+#include "gsharp_memory.h"
+#include "gsharp_native.h"
+#include "gsharp_params.h"
+#include "gsharp_modal.h"
 
 #ifdef TEST_BUILD
 #include "../test/gsharp_test.h"
 #endif // TEST_BUILD
 
-#ifndef M_PI
-#define M_PI 3.14159265358979323846
-#endif
-
 namespace gsharp
 {
 
 using namespace std;
 
+class ErrorMsg;
+
 typedef unsigned int ONumber;
 typedef unsigned int LineNumber; // all valid LineNumbers start from 1, anyhwere in the code !!!
 
+// containers of the loaded program, their memory comes from the arena of the program
+template<class T> using ArenaVector = vector<T, ArenaAllocator<T>>;
+typedef basic_string<char, char_traits<char>, ArenaAllocator<char>> ArenaString;
+
 typedef struct
 {
    enum {UNDEF, SUB, IF, DO, WHILE, REPEAT} type;
    LineNumber start_line; // where this code block starts
-   vector<LineNumber> mid_line; // all internal lines (elseif, else)
+   ArenaVector<LineNumber> mid_line; // all internal lines (elseif, else)
    LineNumber end_line; // the first line after(!) the block
    int run_times;
+   unsigned long long entry; // loops: time of the last entry, values cached before are not valid
+   unsigned int locals; // subs: local parameters changed inside (bits, #1 is the lowest)
+   bool steady; // repeat: nothing changes inside, so every iteration produces the same output
+   bool pure; // sub: changes only the local parameters and #5000, reads only the local parameters
+   unsigned int reads; // pure sub: local parameters read inside (bits)
+   ArenaVector<unsigned int> named; // subs: slots of the local named parameters, saved by the calls
 } CodeBlock;
 
+// o-word command line, resolved at load time
+// jump targets are the instructions of the compiled program
+typedef struct
+{
+   ONumber number;
+   unsigned int block; // index in the list of o-blocks (NO_BLOCK if not found)
+   size_t exit; // the first instruction after the block
+   size_t jump; // depends on the command: start of the loop, sub body, next condition, etc.
+   unsigned int table; // 'if' only: jump table for the rest of the chain (NO_TABLE if none)
+   unsigned int locals; // 'call' only: local parameters to preserve (bits, incl. arguments)
+   unsigned int native; // 'call' only: the sub registered by the host (NO_NATIVE if none)
+} Control;
+
+// subroutine call, the saved local parameters are kept in the frame arena
+typedef struct
+{
+   size_t return_pc; // instruction to continue with after return
+   unsigned int saved; // local parameters (bits, #1 is the lowest)
+   size_t values; // position of the first saved value in the arena
+   unsigned int block; // the called sub, its' named parameters are saved after the numbered ones
+} Frame;
+
+// if-elseif chain where all conditions are [#n EQ constant] with integer constants
+// the matching 'elseif' branch is selected by the value of the parameter
+typedef struct
+{
+   unsigned int parameter; // #n
+   unordered_map<double, size_t> branches; // constant to the first instruction of the branch
+   size_t other; // no match: 'else' line or the end of the block
+} JumpTable;
+
+// functions which can be applied to an expression, e.g. abs[..]
+// NATIVE is registered by the host, see RegisterFunction()
+enum Function: unsigned char {NO_FUNCTION, EXISTS, ROUND, ACOS, ASIN, SQRT, ATAN, ABS, COS, FIX, FUP, SIN, TAN, EXP, LN, NATIVE};
+
+// single operation of the compiled expression (reverse polish notation)
+typedef struct
+{
+   enum Code: unsigned char {
+      NUMBER,        // push constant <nref> (<value> is the same one, as written)
+      PARAMETER,     // replace the index on the stack with the parameter value, <nref> times
+      NEGATE,        // unary minus
+      ADD, SUBTRACT, MULTIPLY, DIVIDE, MODULO, POWER,
+      EQ, NE, LT, LE, GT, GE,
+      AND, OR, XOR,
+      FUNCTION,      // apply <func> to the argument(s) on the stack (NATIVE: function <nref>)
+      CACHED,        // push the value of cache <nref> if it's valid, otherwise evaluate the operations up to STORE
+      STORE,         // keep the value on the stack in cache <nref>
+      NAMED,         // push the value of named parameter <nref> (slot)
+      DEFINED        // push 1 if named parameter <nref> has a value, 0 otherwise (EXISTS function)
+   } code;
+   Function func;
+   unsigned int nref;
+   double value;
+} Operation;
+
+// #<name> is resolved to the slot (index in the list) at load time
+// local ones belong to the sub where they are used (or the main program), global ones start with '_'
+typedef struct
+{
+   string name; // lowercase, without whitespaces
+   unsigned int block; // the sub (NO_BLOCK: main program or global)
+   bool global;
+} NamedParameter;
+
+// call of the small sub, which is compiled straight into the calling line
+typedef struct
+{
+   ONumber number;
+   vector<unsigned int> locals; // local parameters changed by the sub, incl. arguments (0-based)
+   size_t body; // the first instruction of the sub's body
+   size_t copy; // and of its' copy in the calling line
+   size_t size; // instructions of the body
+} InlineCall;
+
+// result of the step during the first iteration of the steady 'repeat' loop
+typedef struct
+{
+   string line;
+   ExtraInfo extra;
+   LineNumber line_number;
+   size_t pc; // where to continue, if the replay is cancelled
+} ReplayStep;
+
+// the first iteration of the steady 'repeat' loop is recorded, others are replayed
+typedef struct
+{
+   enum {NONE, RECORDING, REPLAYING} mode;
+   unsigned int block;
+   bool complete; // the first iteration is recorded
+   vector<ReplayStep> steps;
+   size_t next; // step to replay
+   int remaining; // iterations, incl. the current one
+   unsigned long long time; // when the recording started
+} Replay;
+
+// straight part of the main program: no o-words, only the parameters with constant numbers,
+//  so it can be interpreted by a worker as soon as the values of the parameters it reads are known
+typedef struct
+{
+   size_t first; // the first instruction (at the start of the line)
+   size_t last; // the first instruction after the region (at the start of the line)
+   vector<unsigned int> reads; // parameters read inside
+   vector<unsigned int> writes; // parameters assigned inside
+} Region;
 
-///////  class  P r o g r a m  ////////
+// lexical element of the line
+typedef struct
+{
+   enum Type: unsigned char {
+      TEXT,          // any other character
+      WORD,          // letters, e.g. g-code word or function name
+      NUMBER,        // decimal number, <value>
+      PARAMETER,     // '#'
+      NAME,          // name of the parameter in angle brackets, follows '#'
+      OPEN,          // '['
+      CLOSE,         // ']'
+      OPERATOR,      // <op>, incl. keywords like MOD or EQ
+      ASSIGN,        // '='
+      BLOCK_DELETE,  // '/' at the start of the line
+      OWORD,         // O-word at the start of the line, <value> is the o-number
+      COMMAND        // o-word command, follows OWORD
+   } type;
+   Operation::Code op;
+   unsigned int start; // position of the text in the lexeme
+   unsigned int len;
+   double value;
+} Token;
+
+// value used by the compiled code: parameter or expression
+// its' operations are stored in the program at <first> position
+typedef struct
+{
+   enum Type {PARAMETER, EXPRESSION} type;
+   unsigned int first; // first operation
+   unsigned int count; // number of operations
+} Operand;
+
+// single instruction of the compiled program
+typedef struct
+{
+   enum Code: unsigned char {
+      TEXT,          // append literal <data> to the output
+      VALUE,         // append operand <first> printed with precision <data>
+      ASSIGN,        // the output which follows is the value for PARAMETER operand <data>
+      COMMIT,        // read the values from the output and perform all pending assignments
+      MESSAGE,       // send the output as a message of type <data>
+      BLOCK_DELETE,  // if enabled, skip the line: jump to instruction <data>
+      OUTPUT,        // the g-code line is ready
+      PLAIN,         // plain g-code line: output literal <data> (formatted), <first> is the source text
+      FLUSH,         // return if there are any messages
+      ERROR,         // throw error with text from literal <data>
+      ENTER,         // inlined sub call <data>: save the local parameters, assign arguments <first>, <count>
+      LEAVE,         // the end of the inlined sub <data>: return value <first>, restore the local parameters
+      END,           // the end of the program
+      // o-word commands, <data> is the control record, arguments are the operands <first>, <count>
+      SUB, CALL, RETURN, IF, ELSEIF, ELSE, WHILE, ENDWHILE, REPEAT, ENDREPEAT, BREAK, CONTINUE, DO
+   } code;
+   bool flush; // return after the instruction if any messages are present (PLAIN: m2/m30 line)
+   LineNumber line; // source line the instruction was compiled from
+   unsigned int data; // depends on the code
+   unsigned int first; // first operand
+   unsigned int count; // number of operands
+} Instruction;
+
+
+///////  E x e c u t i o n  P o l i c y  ////////
+// options of the execution fixed at compile time, the branches on them are removed from the executing code
+// only <DEBUG_LEVEL> 0 is used by the program: any debug output (or the journal) is produced with the dynamic policy
+template<bool BLOCK_DELETE, bool PRETTY_FORMAT, bool CONVERT_TO_UPPER, unsigned int DEBUG_LEVEL>
+struct StaticPolicy
+{
+   static inline bool BlockDelete(bool) {return BLOCK_DELETE;}
+   static inline bool PrettyFormat(bool) {return PRETTY_FORMAT;}
+   static inline bool ConvertToUpper(bool) {return CONVERT_TO_UPPER;}
+   static inline bool Debug(unsigned int level, unsigned int) {return DEBUG_LEVEL > level;}
+   static inline bool Silent() {return false;}
+   static inline bool Journal(bool) {return false;}
+   static inline bool Remember(bool) {return true;}
+};
+
+// options as they are set in the program
+struct DynamicPolicy
+{
+   static inline bool BlockDelete(bool enabled) {return enabled;}
+   static inline bool PrettyFormat(bool enabled) {return enabled;}
+   static inline bool ConvertToUpper(bool enabled) {return enabled;}
+   static inline bool Debug(unsigned int level, unsigned int current) {return current > level;}
+   static inline bool Silent() {return false;}
+   static inline bool Journal(bool enabled) {return enabled;} // the writes of the step are recorded
+   static inline bool Remember(bool enabled) {return enabled;} // the replays and the remembered calls
+};
+
+// seeking: the lines are not formatted, the values are not output unless they are read back (see SeekToOutputLine())
+struct SilentPolicy
+{
+   static inline bool BlockDelete(bool enabled) {return enabled;}
+   static inline bool PrettyFormat(bool) {return false;}
+   static inline bool ConvertToUpper(bool) {return false;}
+   static inline bool Debug(unsigned int, unsigned int) {return false;}
+   static inline bool Silent() {return true;}
+   static inline bool Journal(bool enabled) {return enabled;}
+   static inline bool Remember(bool) {return false;}
+};
+
+
+///////  class  B a s i c P r o g r a m  ////////
 // storage for the program code
 // each instance keeps one subroutine (or main program)
-class Program
+// <Number> is the type of the parameters and the expressions: double, float or Fixed (see "gsharp_number.h")
+template<class Number>
+class BasicProgram
 {
 public:
    const static size_t TOTAL_CNC_PARAMETERS = 5602; // defined in LinuxCNC and RS274/NGC standard
-   const static size_t TOTAL_LOCAL_PARAMETERS = 30; // within the TOTAL_CNC_PARAMETERS number
+   const static size_t TOTAL_LOCAL_PARAMETERS = 30; // within the TOTAL_CNC_PARAMETERS number (fits the bits of unsigned int)
    const static size_t TOTAL_INTERNAL_PARAMETERS = 50; // max possible to parse a single line
    const static size_t TOTAL_PARAMETERS = TOTAL_CNC_PARAMETERS + TOTAL_INTERNAL_PARAMETERS;
    const static size_t INTERNAL_PARAMETERS_START = TOTAL_CNC_PARAMETERS; // above the valid range of CNC parameters
-   const static size_t MAX_STACK_LEVELS = 1000; // TODO: define real & safe stack depth
+   const static size_t DEFAULT_STACK_LEVELS = 1000; // max depth of sub calls, see SetStackDepth()
+   const static unsigned int NO_BLOCK = ~0u; // o-block is not defined
+   const static unsigned int NO_TABLE = ~0u; // if-elseif chain doesn't have a jump table
+   const static unsigned int NO_SLOT = ~0u; // named parameter is not used by the program
+   const static unsigned int NO_NATIVE = ~0u; // the sub is interpreted
+   const static size_t MIN_JUMP_TABLE_BRANCHES = 4; // shorter if-elseif chains are checked one by one
+   const static size_t MAX_INLINE_SUB_LINES = 5; // longer subs are always called
+   const static size_t DEFAULT_SUB_CACHE_SIZE = 64; // pure sub calls to remember, see SetSubCacheSize()
+   const static size_t MAX_SUB_CALL_STEPS = 1000; // longer pure sub calls are not remembered
+   const static size_t PARALLEL_REGION_SIZE = 4096; // instructions given to the worker at once, see Run()
+   const static size_t PARALLEL_WAVE_REGIONS = 4; // regions per worker dispatched together
+   const static size_t EMIT_FUNCTION_SIZE = 256; // instructions per function of the emitted C++ code, see EmitCpp()
    const static size_t RETURN_VALUE_PARAMETER = 5000; // if any sub returns value, it is stored here
-   const double TOLERANCE_EQUAL = 0.0001; // defined in LinuxCNC for comparison of doubles
+   const static size_t ARENA_BYTES_PER_CHAR = 32; // compiled code per source character, sizes the first arena chunk
+   const static size_t LINE_BUFFER_SIZE = 256; // reserved for the output line and the messages, see Step()
+   const static size_t JOURNAL_CHECKPOINTS = 16; // kept to step back beyond the journal, see StepBack()
+   const static size_t JOURNAL_INTERVAL = 1000; // steps between these checkpoints, doubled when there are too many
+   const static unsigned int MAX_FUNCTION_ARGUMENTS = 16; // of the native functions, see RegisterFunction()
+   const double TOLERANCE_EQUAL = 0.0001; // defined in LinuxCNC for comparison of doubles (see Numeric::Tolerance())
    const static bool USE_BLOCK_DELETE = false; // disabled by default
    const static bool USE_PRETTY_FORMAT = true; // enabled: add spaces between g-words
    const static bool CONVERT_TO_UPPER = true; // enabled: all output characters are in upper case
+   const static bool USE_INLINE_SUBS = true; // enabled: small subs are compiled into the calling lines
+
+   // host function called from the expressions, the arguments are in the order of the call
+   typedef function<Number(const Number* args)> NativeFunction;
+   // host implementation of the sub, see RegisterSub()
+   typedef function<void(NativeCall<Number>& call)> SubHandler;
+
+   // expression of the host, evaluated over the parameters of the program, see CompileExpression()
+   typedef struct
+   {
+      string text; // as given
+      vector<Operation> operations;
+      vector<Number> constants; // of NUMBER operations
+   } CompiledExpression;
+
+protected:
+   typedef gsharp::Numeric<Number> Numeric; // the functions of the expressions
+
+   // native function, resolved by the name at load time
+   typedef struct
+   {
+      string name; // lowercase
+      unsigned int arity;
+      NativeFunction function;
+   } Native;
+
+   // value of the loop-invariant sub-expression, calculated once per loop entry
+   typedef struct
+   {
+      unsigned int block; // the loop
+      size_t end; // STORE operation
+      Number value;
+      unsigned long long time; // when the value was calculated
+   } Cache;
+
+   // recorded call of the pure sub, served again for the same values of the parameters it reads
+   typedef struct
+   {
+      vector<Number> key; // the sub block, the format settings and the values of the parameters
+      vector<ReplayStep> steps;
+      ExtraInfo extra; // messages of the 'return' line
+      LineNumber return_line;
+      bool has_value; // returns a value (to #5000)
+      Number value;
+   } SubCall;
+
+   // the call of the pure sub is recorded, the next ones with the same arguments are served from the cache
+   typedef struct
+   {
+      enum {NONE, CALLED, RECORDING, RETURNED, SERVING} mode; // CALLED: the step of the call line with its' messages
+      SubCall call; // being recorded
+      size_t depth; // number of frames during the recorded call
+      unsigned long long time; // when the recording started
+      const SubCall* served;
+      size_t next; // step to serve
+   } SubMemo;
+
+   // the call of the native sub, the lines are collected into _native_call
+   class NativeSubCall: public NativeCall<Number>
+   {
+   public:
+      NativeSubCall(BasicProgram& program, size_t return_pc): _program(program), _return_pc(return_pc) {}
+      virtual unsigned int Arguments() const;
+      virtual Number Argument(unsigned int index) const;
+      virtual double GetParam(unsigned int number) const;
+      virtual void SetParam(unsigned int number, double value);
+      virtual void Output(const string& line);
+      virtual void Message(ExtraInfo::Type type, const string& text);
+      virtual void Return(Number value);
+   private:
+      BasicProgram& _program;
+      size_t _return_pc;
+   };
+
+   // the state of the execution between the steps, see Checkpoint()
+   // the loop-invariant values and the recordings are not kept: they are calculated again after Restore()
+   typedef struct
+   {
+      size_t pc;
+      LineNumber current_line;
+      LineNumber last_used_line;
+      bool loop_back;
+      ParameterPages<Number, TOTAL_PARAMETERS> params; // shares the pages with the program
+      array<Number, TOTAL_LOCAL_PARAMETERS> local_params;
+      array<Number, TOTAL_LOCAL_PARAMETERS> saved_locals;
+      vector<Number> named_values;
+      vector<unsigned char> named_defined;
+      vector<Frame> frames;
+      vector<Number> frame_values;
+      vector<int> run_times; // of all o-blocks
+      LineNumber percent_start;
+      LineNumber percent_stop;
+      Replay replay; // only REPLAYING is kept
+      bool serving; // the remembered call, its' steps are in <served>
+      SubCall served;
+      size_t next; // step of the served call
+      size_t steps; // since Rewind()
+   } ExecutionState;
+
+   // undo of the write made by the step (the value before it), see StepBack()
+   typedef struct
+   {
+      enum Kind: unsigned char {
+         GLOBAL,        // parameter (0-based index)
+         LOCAL,         // #1..#30 (0-based index)
+         SAVED_LOCAL,   // during the inlined call
+         NAMED,         // value of the slot
+         DEFINED,       // the slot has a value (non-zero)
+         RUN_TIMES,     // of the o-block
+         FRAME_VALUE,   // the position of the popped value
+         PUSH,          // the frame of the call
+         POP,           // the frame of the return (the number of its' values), it's in Journal::frames
+         NATIVE_CALL    // the lines of the previous native call, they are in Journal::calls
+      } kind;
+      unsigned int index;
+      Number value;
+      int run_times;
+   } JournalWrite;
+
+   // the state before the step, the writes of the step follow it in Journal::writes
+   typedef struct
+   {
+      size_t pc;
+      LineNumber last_used_line;
+      bool loop_back;
+      bool serving; // the remembered call or the native one
+      const SubCall* served;
+      size_t next; // step of the served call
+      size_t writes;
+   } JournalStep;
+
+   // the steps to undo, the oldest are dropped once the memory is over the size
+   // the checkpoints are taken every <interval> steps to go back beyond it
+   // (the vectors don't take any memory until the journal is used, unlike the deques)
+   typedef struct
+   {
+      size_t size; // bytes (0: no journal)
+      size_t bytes;
+      bool recording; // the current step
+      vector<JournalStep> steps;
+      vector<JournalWrite> writes;
+      vector<Frame> frames; // popped by the steps
+      vector<SubCall> calls; // native calls replaced by the steps
+      vector<pair<size_t, shared_ptr<ExecutionState>>> checkpoints; // by the number of the step
+      size_t interval;
+   } Journal;
+
+   // steps produced by the worker, merged in the program order
+   typedef struct
+   {
+      vector<ReplayStep> steps;
+      vector<Number> values; // of the assigned parameters, in the order of Region::writes
+      size_t pc; // where the worker has stopped (not at the end of the region after m2 or m30)
+      LineNumber last_line; // the last used line
+      exception_ptr error; // if any, the region is executed again by the program
+   } RegionResult;
 
 public:
     // stores the program, extracts sub-routines as separate routines
-   Program();
-   virtual ~Program() {}
+   // the memory of the loaded program is taken from <upstream> (nullptr: the heap), see "gsharp_memory.h"
+   explicit BasicProgram(MemoryResource* upstream=nullptr);
+   virtual ~BasicProgram() {}
 
    // load the program code
    void Load(const string& code);
@@ -94,19 +492,90 @@ public:
    // produce next g-code line in sequence
    // false on return means that there are no more lines left
    // extra messages can be present, even if the line is empty
+   // once the lines and the messages are not longer than before, the step doesn't allocate memory
    bool Step(string& line, ExtraInfo& extra);
 
    void Rewind(); // to start program over again
 
-   inline void Clear() {_params.fill(0);} // clears global paramteres
+   // runs the rest of the program, same as Step() until it returns false, passing every step to <handler>
+   // independent parts of the main program are interpreted by <threads> workers (0: one per core),
+   //  the steps are still passed in the program order and GetCurrentLineNumber() is valid in <handler>
+   typedef function<void(const string& line, ExtraInfo& extra)> StepHandler;
+   void Run(const StepHandler& handler, unsigned int threads=1);
 
-   inline void EnableBlockDelete(bool enable=true) {_block_delete = enable;}
-   inline void EnablePrettyFormat(bool enable=true) {_format_pretty = enable;}
-   inline void EnableConvertToUpper(bool enable=true) {_convert_to_upper = enable;}
+   void Clear(); // clears global paramteres, incl. the named ones
+
+   inline void EnableBlockDelete(bool enable=true) {_block_delete = enable; _Configure();}
+   void EnablePrettyFormat(bool enable=true);
+   void EnableConvertToUpper(bool enable=true);
+   inline void EnableInlineSubs(bool enable=true) {_inline_subs = enable;} // takes effect on the next Load
 
    void SetParam(unsigned int number, double value);
    double GetParam(unsigned int number) const;
 
+   // max depth of sub calls, the memory is allocated here or by Load() of the program with the calls
+   //  (not during the calls), the program without them doesn't take it
+   void SetStackDepth(size_t levels);
+
+   // number of pure sub calls to remember (least recently used are dropped), 0 disables the cache
+   // while the remembered call is served, the local parameters keep the values of the calling context
+   inline void SetSubCacheSize(size_t calls) {_sub_cache_size = calls;}
+
+   // makes function <name>[arg1][arg2].. with <arity> arguments available to the expressions of the next Load()
+   // the name (letters only, case-insensitive) must not hide the built-in functions or contain the keywords (mod, eq, ..)
+   // the result must depend only on the arguments: the calls with the constant arguments are calculated at load time
+   //  and the values inside the loops may be reused, the workers of Run() call it concurrently
+   void RegisterFunction(const string& name, unsigned int arity, const NativeFunction& function);
+
+   // 'o<number> call [..]' of the next Load() runs <handler> instead of the sub of the program (empty: no handler)
+   // the lines of the handler are produced by the steps which follow, same as the lines of the interpreted sub
+   void RegisterSub(ONumber number, const SubHandler& handler);
+
+   // compiles <text> (e.g. "[#1 * 60 / #2]") the same way as the expressions of the program
+   // it doesn't depend on the loaded program, the native functions must be registered before
+   // the named parameters are not supported: their slots are valid only for the loaded program
+   void CompileExpression(const string& text, CompiledExpression& expression);
+
+   // the value of the compiled expression for the current parameters, the memory is reserved by the compiling
+   Number Evaluate(const CompiledExpression& expression);
+
+   // evaluates <expression> <rows> times: parameters <numbers>[<count>] take the values of the next row
+   //  from <values> for every evaluation and get back their values after all of them
+   // the memory for the saved values is kept, so the next calls with the same <count> don't allocate it
+   void Evaluate(const CompiledExpression& expression, const unsigned int* numbers, size_t count,
+                 const double* values, size_t rows, double* results);
+
+   // saves the complete state of the execution between the steps, returns the handle to Restore() it
+   // the pages of the global parameters are shared with the program until one of them is written
+   // the states belong to the loaded program, Load() releases all of them
+   unsigned int Checkpoint();
+   void Restore(unsigned int checkpoint); // the state stays for the next Restore()
+   void ReleaseCheckpoint(unsigned int checkpoint);
+
+   // the steps record the writes of the parameters and the jumps, so StepBack() undoes them one by one
+   // the oldest steps are dropped once the journal takes more than <bytes> (0 disables it, the default)
+   // the replays and the remembered calls are not used while it's enabled
+   void SetJournalSize(size_t bytes);
+   // goes back <steps> steps (incl. the ones with only the messages), the next Step() produces the same
+   //  beyond the journal it restores one of the checkpoints taken every few thousand steps and runs on silently
+   // the parameters set by the host between the steps are not undone (unless the steps write them)
+   void StepBack(size_t steps);
+
+   // runs the program from the start (same as Rewind()) up to the output line <line> (1-based):
+   //  the assignments and the flow control are executed, the lines which are skipped are not formatted,
+   //  their messages are dropped, the steps with only the messages after the line <line>-1 are not skipped
+   //  (the next Step() may return them before the line <line>)
+   // false: the program has finished before
+   bool SeekToOutputLine(size_t line);
+   // same up to the <occurrence> of the source line <line> (e.g. the second iteration of the loop)
+   bool SeekToSourceLine(LineNumber line, unsigned int occurrence=1);
+   // the modal words and the positions of the lines skipped by the last seek, to build the preamble
+   inline const ModalState& GetModalState() const {return _modal;}
+
+   // writes the loaded program as C++ class <name>, which produces the same output (see "gsharp_runtime.h")
+   // the programs with named parameters, native functions or subs can't be written
+   void EmitCpp(ostream& out, const string& name) const;
+
    inline LineNumber GetCurrentLineNumber() const {return _last_used_line;}
    const string GetSourceLine(LineNumber num) const;
 
@@ -116,69 +585,207 @@ public:
    // 2:   relatively verbouse
    // 3:   detailed messaging
    // >3:  all messages, including very specific local ones (may flood stdout)
-   inline void DebugLevel(unsigned int level) {_debug_level = level;}
+   inline void DebugLevel(unsigned int level) {_debug_level = level; _Configure();}
 
 protected:
-   vector<string> _code; // the program code split into lines (incl. empty)
+   // the loaded program is kept here, released at once by the next Load()
+   MonotonicArena _arena;
+
+   ArenaVector<ArenaString> _code; // the program code split into lines (incl. empty)
+
+   // compiled program
+   ArenaVector<Instruction> _bytecode;
+   ArenaVector<size_t> _line_start; // the first instruction of every line (incl. one after the last)
+   ArenaVector<Operand> _operands;
+   ArenaVector<Operation> _operations;
+   ArenaVector<Number> _constants; // of NUMBER operations
+   ArenaVector<string> _literals;
+   size_t _program_start; // first instruction to execute after rewind
+   size_t _program_end; // instruction to finish with the program
+
+   size_t _pc; // next instruction to execute
+   string _output; // the line under construction
+   vector<pair<unsigned int, size_t>> _pending; // assignments waiting for COMMIT: target and output position
+   vector<size_t> _lengths; // of the values assigned by COMMIT, kept to avoid allocations in the steps
+   vector<Number> _arguments; // evaluated o-word arguments
+   vector<Number> _stack; // values for evaluation of the expressions
+   vector<Number> _overridden; // values of the parameters during the evaluations of the host expression
+
+   vector<Token> _tokens; // the line being compiled
+   string _lexeme; // text of the tokens: lowercase, without whitespaces
 
    LineNumber _current_line; // current line number in the code for parsing
    LineNumber _last_used_line; // the number of the last line at which execution paused
 
-   unordered_map<ONumber, CodeBlock> _blocks; // list of o-blocks with parameters
-
-   array<double, TOTAL_PARAMETERS> _params; // global access (valid id > TOTAL_LOCAL_PARAMETERS)
-   array<double, TOTAL_LOCAL_PARAMETERS> _local_params;
-   size_t _current_internal_param; // only for the interpreter use itself
-
-   // call stack for subroutines
-   stack<array<double, TOTAL_LOCAL_PARAMETERS>> _param_stack;
-   stack<LineNumber> _return_stack;
+   ArenaVector<CodeBlock> _blocks; // list of o-blocks with parameters
+   unordered_map<ONumber, unsigned int, hash<ONumber>, equal_to<ONumber>,
+                 ArenaAllocator<pair<const ONumber, unsigned int>>> _block_ids; // o-number to the index in the list of o-blocks
+   ArenaVector<Control> _controls; // all o-word command lines of the program
+   ArenaVector<JumpTable> _jump_tables; // for long if-elseif chains
+   ArenaVector<Cache> _caches; // loop-invariant values
+   ArenaVector<InlineCall> _inline_calls;
+   ArenaVector<NamedParameter> _named; // all named parameters of the program, index is the slot
+   unordered_map<string, unsigned int> _named_ids; // scope and name to the slot, used only while loading
+   unsigned int _compiling_sub; // sub which body is being compiled (NO_BLOCK: main program)
+   unsigned int _value_slot; // #<_value> (NO_SLOT if not used)
+   unsigned int _value_returned_slot; // #<_value_returned>
+   vector<Native> _natives; // index is <nref> of the FUNCTION operation
+   unordered_map<string, unsigned int> _native_ids; // name to the latest registered function
+   size_t _longest_native; // name length
+   vector<SubHandler> _sub_handlers; // index is Control::native
+   unordered_map<ONumber, unsigned int> _sub_handler_ids; // o-number to the latest registered handler
+   SubCall _native_call; // the lines of the last native sub call (or of the restored one), served as the remembered call
+   vector<shared_ptr<ExecutionState>> _checkpoints; // by the handle (empty: released)
+   array<Number, TOTAL_LOCAL_PARAMETERS> _saved_locals; // during the inlined call (they can't be nested)
+   unsigned long long _clock; // counts loop entries and cached values
+   unsigned long long _cache_reset; // time when all cached values became invalid (parameters changed from outside)
+   bool _loop_back; // 'endwhile' jumps back to the loop condition
+   Replay _replay;
+   SubMemo _memo;
+   list<SubCall> _sub_calls; // remembered calls of the pure subs, the most recently used first
+   map<vector<Number>, typename list<SubCall>::iterator> _sub_index; // key of the call to the remembered one
+   size_t _sub_cache_size;
+   bool _seeking; // _Run() is silent, nothing is cached or recorded
+   LineNumber _seek_line; // the source line to stop the seek at (0: the seek counts the output lines)
+   vector<size_t> _seek_pcs; // its' first instruction and the ones of its' inlined copies
+   unsigned int _seek_hits; // times left to reach one of them
+   ModalState _modal; // of the lines skipped by the seek
+   Journal _journal; // of the last steps, see StepBack()
+   size_t _steps; // since Rewind()
+
+   ParameterPages<Number, TOTAL_PARAMETERS> _params; // global access (valid id > TOTAL_LOCAL_PARAMETERS)
+   array<Number, TOTAL_LOCAL_PARAMETERS> _local_params;
+   vector<Number> _named_values; // by the slot
+   vector<unsigned char> _named_defined; // the named parameter has a value (assigned in the current scope)
+
+   // call stack for subroutines (preallocated)
+   vector<Frame> _frames;
+   vector<Number> _frame_values; // saved local parameters of all frames
+   size_t _stack_depth;
+   bool _has_calls; // the loaded program calls the subs, the memory of the stack is reserved
 
    ExtraInfo _extra; // any active comments during execution? They are stores here
 
    bool _block_delete; // disable lines starting with '/'?
    bool _format_pretty; // place spaces between g-code words?
    bool _convert_to_upper; // output charcters in upper case?
+   bool _inline_subs; // compile small subs into the calling lines?
 
    LineNumber _percent_start;
    LineNumber _percent_stop;
-   bool _percent_active;
 
    unsigned int _debug_level;
 
+   // instantiation of _Run() for the current options, selected by _Configure()
+   bool (BasicProgram::*_run)(string& line, ExtraInfo& extra);
+
 private:
+   // compiling functions (token based)
+   void _CompileLine(const string& source, int precision, bool control=true);
+   void _RegisterBlock(ONumber number, const string& command);
+   void _CompileControl(size_t t, ONumber number, const string& command, bool flush);
+   bool _CompileInlineCall(ONumber number, unsigned int first, unsigned int count, bool flush);
+   unsigned int _CopyOperand(unsigned int operand);
+   void _ResolveControls();
+   void _BuildJumpTable(size_t pc);
+   bool _IsEqualityTest(const Instruction& ins, unsigned int& parameter, double& constant) const;
+   bool _ReadParameters(const Operand& operand, vector<unsigned int>& params) const;
+   bool _ReadsLocals(const Operand& operand, unsigned int& reads) const;
+   unsigned int _NamedSlot(const string& name);
+   unsigned int _FindSlot(const string& name) const;
+   void _FindRegions(vector<Region>& regions) const;
+   void _CompileText(size_t t, bool expressions, int precision);
+   bool _IsOperand(size_t t, size_t end, bool expressions);
+   unsigned int _CompileOperand(size_t& t, bool expressions);
+   unsigned int _AddOperand(Operand::Type type, size_t first);
+   void _FoldOperations(size_t first);
+   size_t _CountArguments(const Operation& op) const;
+   void _HoistInvariants();
+   void _HoistOperand(unsigned int operand, unsigned int block, const vector<bool>& assigned);
+
+   // expression compiling functions
+   void _CompileExpression(size_t& t, Function func, unsigned int native=0); // [..]
+   void _CompileBinary(size_t& t, size_t end, int precedence);
+   void _CompileUnary(size_t& t, size_t end);
+   void _CompilePrimary(size_t& t, size_t end, bool expressions);
+   int  _Precedence(Operation::Code code) const;
+   void _AddOperation(Operation::Code code, double value=0.0, unsigned int nref=0, Function func=NO_FUNCTION);
+   void _AddInstruction(Instruction::Code code, unsigned int data=0, unsigned int first=0, unsigned int count=0);
+   unsigned int _AddLiteral(const string& text);
+   void _AddError(const ErrorMsg& err);
+
+   // execution of the compiled code
+   void _Reset(bool finish=true, size_t first_chunk=0);
+   // empties the container and gives it the memory of the arena
+   template<class Container> inline void _Vacate(Container& c, MemoryResource* resource) {Container(typename Container::allocator_type(resource)).swap(c);}
+   void _Configure();
+   inline bool _Run(string& line, ExtraInfo& extra) {return (this->*_run)(line, extra);}
+   template<class Policy> bool _Run(string& line, ExtraInfo& extra);
+   template<class Policy> void _RunControl(const Instruction& ins);
+   template<class Policy> void _EvaluateArguments(const Instruction& ins);
+   void _RecordStep(const string& line, const ExtraInfo& extra);
+   bool _StartReplay();
+   bool _Replay(string& line, ExtraInfo& extra);
+   bool _FindSubCall(const Instruction& ins, unsigned int block);
+   void _RecordSubStep(const string& line, const ExtraInfo& extra);
+   void _StoreSubCall(const ExtraInfo& extra);
+   bool _ServeSubCall(string& line, ExtraInfo& extra);
+   void _CallNativeSub(const Instruction& ins, const Control& control);
+   bool _Seek(size_t count, bool steps=false);
+   inline bool _SeekHit(size_t pc) // at the start of the source line to seek, the last one of its' occurrences?
+   {
+      for(auto start: _seek_pcs)
+         if(pc == start)
+            return --_seek_hits == 0;
+      return false;
+   }
+   void _SaveState(ExecutionState& state);
+   void _RestoreState(ExecutionState& state);
+   void _StartJournalStep();
+   void _Journal(typename JournalWrite::Kind kind, unsigned int index=0);
+   void _UndoStep();
+   void _TrimJournal();
+   void _ClearJournal();
+   bool _RunUntil(size_t stop, const StepHandler& handler);
+   size_t _RunRegions(const vector<Region>& regions, size_t next, vector<BasicProgram>& workers, const StepHandler& handler);
+   void _RunRegion(const Region& region, const vector<Number>& inputs, RegionResult& result);
+   inline Number _Param(unsigned int number) const {return (number <= TOTAL_LOCAL_PARAMETERS)?
+                                                      _local_params[number-1]: _params[number-1];}
+   inline Number& _ParamRef(unsigned int number) {return (number <= TOTAL_LOCAL_PARAMETERS)?
+                                                    _local_params[number-1]: _params.Ref(number-1);}
+   void _ReserveStack();
+   void _PushFrame(size_t return_pc, unsigned int locals, unsigned int block);
+   void _PopFrame();
+   void _ReturnValue(bool returned, Number value);
+   template<class Policy> Number _EvaluateOperand(const Operand& op);
+   template<class Policy> inline Number _Evaluate(size_t first, size_t last) // operations in range [first, last)
+                                                   {return _Evaluate<Policy>(_operations.data(), _constants.data(), first, last);}
+   template<class Policy> Number _Evaluate(const Operation* operations, const Number* constants, size_t first, size_t last);
+   Number _Evaluate(size_t first, size_t last); // same, outside of the execution
+   template<class Policy> void _AssignOperand(const Operand& target, Number value);
+   void _FormatValue(Number value, int precision, string& str);
+
+   // emitting C++ code of the compiled program
+   void _EmitInstruction(size_t pc, size_t plain, size_t first, size_t last, ostream& out,
+                         unsigned int& temp, set<size_t>& labels) const;
+   void _EmitArguments(const Instruction& ins, ostream& out, unsigned int& temp) const;
+   string _EmitExpression(size_t first, size_t last, ostream& out, unsigned int& temp) const;
+   string _EmitTarget(const Operand& target, ostream& out, unsigned int& temp) const;
+
    // major parsing functions
-   void _ProcessComments(string& line, ExtraInfo* extra=nullptr);
-   void _PrepareLine(string& line); // check for abnormal symbols, remove whitespaces, convert to lowercase
-   void _RemoveNword(string& str); // if there is an N-word infront, remove it
-   bool _ReadOword(string& str, ONumber& number, string& command);
-   void _SimplifyOperators(string& line); // replace with single-character operators
-   void _CalculateExpressions(string& line, vector<double>* output = nullptr);
-   void _ResolveParameters(string& line, int precision=4);
+   void _ProcessComments(string& line, vector<pair<ExtraInfo::Type, string>>* active=nullptr);
+   void _Tokenize(const string& line, bool control, bool raw=false); // single scan: whitespaces, lowcase, operators
    const string _ParseLine(const string& line, int precision=4); // for test routines (no o-codes)
 
-   // expression parsing support functions
-   double _ParseLogical(const string& expr);        // AND, OR, XOR
-   double _ParseConditional(const string& expr);    // EQ, NE, GT, GE, LT, LE
-   double _ParseSummation(const string& expr);      // +, -
-   double _ParseMultiplication(const string& expr); // *, /, MOD
-   double _ParsePower(const string& expr);          // **
-   double _ParseOperand(const string& expr);        // direct value or parameter
-
    // other parsing support functions
-   void   _ReplaceWithParameter(double value, string& line, size_t start, size_t len);
-   double _ReadParameter(const string& line, size_t pos, size_t& len);
-   void   _AssignParameter(const string& line, size_t pos, size_t& len);
-   void   _ReplaceSingleOperator(string& line, const string& operation, char replacement);
-   double _CalculateExpressionFromBracket(const string& line, size_t start, size_t& len);
-   double _ApplyAsFunctionArgument(double arg, const string& line, size_t& start, size_t& len);
-   double _EvaluateExpression(string& expr);
-   double _ParseExpression(const string& expr);
+   Function _FindFunction(const Token& word, size_t& name_len, unsigned int* native=nullptr);
+   Number _ApplyFunction(Function func, Number arg, Number arg2=Number());
+   void _CallNative(unsigned int native);
    void   _FormatPretty(string& line);
-
-   // degrees - radian conversion
-   inline double _radians (double degrees) const { return degrees * M_PI / 180; }
-   inline double _degrees (double radians) const { return radians * 180 / M_PI; }
+   void   _InsertSpaces(string& line) const;
+   void   _ConvertToUpper(string& line) const;
+   void   _Normalize(string& line) const;
+   void   _FormatPlainLines();
 
 private:
 
@@ -189,6 +796,8 @@ private:
 #endif // TEST_BUILD
 };
 
+typedef BasicProgram<double> Program;
+
 } // namespace gsharp
 
 #endif // GSHARP_PROGRAM_H_INCLUDED
@@ -0,0 +1,110 @@
+/*
+ *  Copyright 2016, Night Road Software (https://github.com/nrsoft)
+ *  All rights reserved.
+ *  
+ *  Redistribution and use in source and binary forms, with or without
+ *  modification, are permitted provided that the following conditions are
+ *  met:
+ *  
+ *      * Redistributions of source code must retain the above copyright
+ *  notice, this list of conditions and the following disclaimer.
+ *      * Redistributions in binary form must reproduce the above
+ *  copyright notice, this list of conditions and the following disclaimer
+ *  in the documentation and/or other materials provided with the
+ *  distribution.
+ *      * Neither the name of "Night Road Software" nor the names of its
+ *  contributors may be used to endorse or promote products derived from
+ *  this software without specific prior written permission.
+ *  
+ *  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ *  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ *  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ *  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ *  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ *  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <iostream>
+#include "gsharp_program.h"
+#include "gsharp_except.h"
+
+using namespace std;
+using namespace gsharp;
+
+
+/////////  S e e k  T o  O u t p u t  L i n e  /////////
+template<class Number>
+bool BasicProgram<Number>::SeekToOutputLine(size_t line)
+{
+   Rewind();
+   _seek_line = 0;
+   return _Seek((line > 0)? line - 1: 0);
+}
+
+
+/////////  S e e k  T o  S o u r c e  L i n e  /////////
+// the line without instructions (e.g. comment) is reached with the next one
+// the lines of the small subs are also executed as the copies inside the calling lines, each copy counts
+template<class Number>
+bool BasicProgram<Number>::SeekToSourceLine(LineNumber line, unsigned int occurrence)
+{
+   if(line == 0 || line + 1 >= _line_start.size())
+      throw ErrorMsg(this, "Line %d is not in the program", line);
+   Rewind();
+   size_t start = _line_start[line];
+   _seek_pcs.assign(1, start);
+   for(const auto& call: _inline_calls)
+      if(start >= call.body && start < call.body + call.size)
+         _seek_pcs.push_back(call.copy + start - call.body);
+   _seek_line = _bytecode[start].line; // of the next line with instructions
+   _seek_hits = max(occurrence, 1u);
+   bool found = _Seek(~static_cast<size_t>(0));
+   return found && _seek_hits == 0;
+}
+
+
+/////////  S e e k  /////////
+// skips <count> output lines or <steps> (or stops at _seek_line), the skipped lines only update the modal state
+// the program stays in the state of the normal steps, so it continues with them
+template<class Number>
+bool BasicProgram<Number>::_Seek(size_t count, bool steps)
+{
+   string line;
+   ExtraInfo extra;
+   _modal.Reset();
+   _seeking = true;
+   _Configure();
+   bool running = true;
+   try{
+      while(count > 0 && running){
+         running = Step(line, extra);
+         if(_seek_line != 0 && _seek_hits == 0)
+            break; // at the source line
+         if(!line.empty())
+            _modal.Update(line);
+         if(steps || !line.empty())
+            --count;
+      }
+   }
+   catch(ErrorMsg&){
+      _seeking = false;
+      _seek_line = 0;
+      _Configure();
+      throw;
+   }
+   _seeking = false;
+   _seek_line = 0;
+   _Configure();
+   if(_debug_level > 1)
+      cout << "Seek stopped at line " << _last_used_line << endl;
+   return running;
+}
+
+
+template class gsharp::BasicProgram<double>;
+template class gsharp::BasicProgram<float>;
+template class gsharp::BasicProgram<gsharp::Fixed>;
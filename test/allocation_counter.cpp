@@ -0,0 +1,30 @@
+#include <cstdlib>
+#include <new>
+
+
+// every allocation of the test executable goes through here, only the counted steps are checked (see "allocation_test.cpp")
+// the operators are kept apart from the code which uses them: inlined into it, free() would be seen
+//  releasing the memory of 'operator new' and the compiler warns about the mismatch
+namespace gsharp
+{
+bool count_allocations = false;
+std::size_t allocations = 0;
+std::size_t allocated_bytes = 0;
+}
+
+void* operator new(std::size_t size)
+{
+   if(gsharp::count_allocations){
+      ++gsharp::allocations;
+      gsharp::allocated_bytes += size;
+   }
+   void* ptr = std::malloc(size? size: 1);
+   if(ptr == nullptr)
+      throw std::bad_alloc();
+   return ptr;
+}
+
+void operator delete(void* ptr) noexcept
+{
+   std::free(ptr);
+}
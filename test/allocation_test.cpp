@@ -0,0 +1,187 @@
+#include <string>
+#include "gsharp_test.h"
+#include "../src/gsharp_program.h"
+#include "../src/gsharp_except.h"
+
+
+namespace gsharp
+{
+
+extern bool count_allocations; // see "allocation_counter.cpp"
+extern size_t allocations;
+extern size_t allocated_bytes;
+
+using namespace std;
+
+TEST_F(GSharpTest, StepAllocations)
+{
+   Program r;
+   ExtraInfo extra;
+   string str;
+
+   r.DebugLevel(0);
+   try{
+      r.Load(
+         "(msg,Counting allocations)\n"
+         "o100 sub (changes a global parameter, so it's called every time)\n"
+         "   #31 = [#31 + #2]\n"
+         "   g1 x#1 y[#2 + 0.5]\n"
+         "   o110 if [#1 gt 1000000]\n"
+         "      o100 return [1]\n"
+         "   o110 endif\n"
+         "o100 endsub [2]\n"
+         "o200 sub (pure, the calls with the same argument are remembered)\n"
+         "   #2 = [#1 * #1]\n"
+         "   g0 z#2\n"
+         "o200 endsub\n"
+         "#1 = 0\n"
+         "o300 while [#1 lt 100000]\n"
+         "   #1 = [#1 + 1] #2 = [#1 * 0.1]\n"
+         "   g1 x[#1 * 0.1] y[sin[#1]] f[#2]\n"
+         "   o310 if [[#1 mod 10] eq 0]\n"
+         "      (debug,count #1 sum #31)\n"
+         "   o310 endif\n"
+         "   o100 call [#1] [#1 / 3]\n"
+         "   o200 call [[#1 mod 4]]\n"
+         "o300 endwhile\n"
+         "m2\n");
+
+      for(int i=0; i<1000; ++i) // warm up: the buffers reach their sizes, the pure calls are remembered
+         ASSERT_TRUE(r.Step(str, extra));
+
+      allocations = 0;
+      count_allocations = true;
+      for(int i=0; i<10000; ++i){
+         r.Step(str, extra);
+         extra.Retrieve(ExtraInfo::DBG);
+      }
+      count_allocations = false;
+      EXPECT_EQ(0u, allocations) << "Heap allocations in the steps of the running program";
+   }
+   catch(ErrorMsg& err){
+      count_allocations = false;
+      FAIL() << "Due to exception: " << err.what();
+   }
+}
+
+
+TEST_F(GSharpTest, ExpressionAllocations)
+{
+   Program r;
+   Program::CompiledExpression feed;
+
+   try{
+      r.RegisterFunction("max", 2, [](const double* a){return (a[0] > a[1])? a[0]: a[1];});
+      r.CompileExpression("max[#1 * #2 * [#3 + 1]] [[#1 + #2] / [#3 + #4 + 1] * sin[#1]]", feed);
+      const unsigned int numbers[] = {1, 2};
+      const double values[] = {1, 2, 3, 4, 5, 6, 7, 8};
+      double results[4];
+      r.Evaluate(feed, numbers, 2, values, 4, results); // the values of the parameters are saved here
+
+      allocations = 0;
+      count_allocations = true;
+      double sum = 0.0;
+      for(int i=0; i<1000; ++i){
+         r.SetParam(3, i);
+         sum += r.Evaluate(feed);
+         r.Evaluate(feed, numbers, 2, values, 4, results);
+      }
+      count_allocations = false;
+      EXPECT_EQ(0u, allocations) << "Heap allocations in the evaluations of the compiled expression";
+      EXPECT_EQ(0, sum);
+      EXPECT_EQ(7 * 8 * 1000, results[3]);
+   }
+   catch(ErrorMsg& err){
+      count_allocations = false;
+      FAIL() << "Due to exception: " << err.what();
+   }
+}
+
+
+// upstream of the program arena, keeps track of the memory given out
+class CountingResource: public MemoryResource
+{
+public:
+   CountingResource(): chunks(0), bytes(0) {}
+   virtual void* Allocate(size_t size, size_t) {++chunks; bytes += size; return ::operator new(size);}
+   virtual void Deallocate(void* ptr, size_t size, size_t) {--chunks; bytes -= size; ::operator delete(ptr);}
+   size_t chunks;
+   size_t bytes;
+};
+
+
+TEST_F(GSharpTest, LoadArena)
+{
+   CountingResource upstream;
+   string code = "o100 sub\n   g1 x#1\no100 endsub\n";
+   for(int i=0; i<200; ++i)
+      code += "o" + to_string(200 + i) + " if [#1 gt " + to_string(i) + "]\n   x#1 (line " + to_string(i) +
+              ")\no" + to_string(200 + i) + " elseif [#1 lt 0]\n   y[#1 * 2]\no" + to_string(200 + i) + " endif\n";
+   code += "o100 call [1]\nm2\n";
+
+   try{
+      Program* p = new Program(&upstream);
+      p->DebugLevel(0);
+      p->Load(code);
+      EXPECT_GT(upstream.chunks, 0u);
+      EXPECT_LT(upstream.chunks, 20u) << "The memory is taken in big chunks";
+      size_t loaded = upstream.bytes;
+      EXPECT_STREQ("o350 if [#1 gt 150]", p->GetSourceLine(4 + 150*5).c_str());
+
+      for(int i=0; i<5; ++i){ // the memory of the previous program is given back
+         p->Load(code);
+         EXPECT_EQ(loaded, upstream.bytes);
+      }
+
+      string str;
+      ExtraInfo extra;
+      EXPECT_TRUE(p->Step(str, extra));
+      EXPECT_STREQ("G1 X1", str.c_str());
+
+      // the copy (e.g. parallel worker) doesn't take the memory of the arena
+      Program copy(*p);
+      EXPECT_EQ(loaded, upstream.bytes);
+      delete p;
+      EXPECT_EQ(0u, upstream.chunks);
+      EXPECT_EQ(0u, upstream.bytes);
+      EXPECT_TRUE(copy.Step(str, extra));
+      EXPECT_STREQ("M2", str.c_str());
+   }
+   catch(ErrorMsg& err){
+      FAIL() << "Due to exception: " << err.what();
+   }
+}
+
+
+TEST_F(GSharpTest, IdleFootprint)
+{
+   CountingResource upstream;
+   delete new Program(&upstream); // the shared memory of all the programs is taken once
+
+   allocations = 0;
+   allocated_bytes = 0;
+   count_allocations = true;
+   Program* p = new Program(&upstream);
+   count_allocations = false;
+   EXPECT_EQ(0u, upstream.chunks) << "The arena is taken by the loaded program only";
+   EXPECT_LT(allocated_bytes, sizeof(Program) + 512) << "Heap memory of the program waiting to be loaded";
+
+   try{
+      string code = "g0 x0\n";
+      for(int i=1; i<100; ++i)
+         code += "g1 x[#1 + " + to_string(i) + "] y[sin[#2]]\n";
+      p->DebugLevel(0);
+      p->Load(code);
+      EXPECT_GT(upstream.chunks, 0u);
+      EXPECT_LT(upstream.chunks, 4u) << "The first chunk is sized for the program";
+      EXPECT_LT(upstream.bytes, 64 * code.size()) << "The first chunk is sized for the program";
+   }
+   catch(ErrorMsg& err){
+      count_allocations = false;
+      FAIL() << "Due to exception: " << err.what();
+   }
+   delete p;
+   EXPECT_EQ(0u, upstream.chunks);
+}
+
+} // namespace
@@ -0,0 +1,18 @@
+# runs the program by the interpreter (GS2G) and its C++ translation (EMITTED),
+#  the g-code files and the messages must be the same
+execute_process (COMMAND ${GS2G} ${NGC} ${OUTPUT}_interpreted.ngc 1
+  OUTPUT_VARIABLE INTERPRETED_MESSAGES RESULT_VARIABLE INTERPRETED_RESULT)
+execute_process (COMMAND ${EMITTED} ${OUTPUT}_emitted.ngc
+  OUTPUT_VARIABLE EMITTED_MESSAGES RESULT_VARIABLE EMITTED_RESULT)
+
+# g#2g prints the banner first
+string (REGEX REPLACE "^([^\n]*\n)([^\n]*\n)([^\n]*\n)(\n)" "" INTERPRETED_MESSAGES "${INTERPRETED_MESSAGES}")
+if (NOT INTERPRETED_MESSAGES STREQUAL EMITTED_MESSAGES OR NOT INTERPRETED_RESULT EQUAL EMITTED_RESULT)
+  message (FATAL_ERROR "Different messages:\n${INTERPRETED_MESSAGES}\nand\n${EMITTED_MESSAGES}")
+endif ()
+
+file (READ ${OUTPUT}_interpreted.ngc INTERPRETED_CODE)
+file (READ ${OUTPUT}_emitted.ngc EMITTED_CODE)
+if (NOT INTERPRETED_CODE STREQUAL EMITTED_CODE)
+  message (FATAL_ERROR "Different g-code: ${OUTPUT}_interpreted.ngc and ${OUTPUT}_emitted.ngc")
+endif ()
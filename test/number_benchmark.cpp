@@ -0,0 +1,66 @@
+/*
+ *  Speed of the interpreter with the numeric types of "gsharp_number.h"
+ *
+ *  The same program is run with double, float and Fixed parameters,
+ *   the loop body is evaluated on every iteration (nothing is cached)
+ *
+ *  Usage: gsharp_bench [iterations]
+ */
+#include <chrono>
+#include <string>
+#include <cstdlib>
+#include <iostream>
+#include "gsharp.h"
+
+using namespace std;
+
+
+// contour of trigonometric and power functions, one g-code line per iteration
+static string BenchmarkProgram(int iterations)
+{
+   return
+      "#1 = 0\n"
+      "o100 while [#1 lt " + to_string(iterations) + "]\n"
+      "#2 = [#1 * 0.018]\n"
+      "g1 x[cos[#2 * 57] * 50 + #2 mod 7] y[sin[#2 * 57] * 50 - sqrt[#2 + 1]] z[atan[#2]/[10] + [#2 ** 1.5] / 1000]\n"
+      "#1 = [#1 + 1]\n"
+      "o100 endwhile\n";
+}
+
+template<class Number>
+static void Benchmark(const char* name, const string& program)
+{
+   gsharp::BasicInterpreter<Number> r;
+   r.Load(program);
+
+   string line, last;
+   gsharp::ExtraInfo extra;
+   size_t lines = 0;
+   auto start = chrono::steady_clock::now();
+   while(r.Step(line, extra)){
+      if(!line.empty()){
+         ++lines;
+         last.swap(line);
+      }
+   }
+   double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+   cout << name << ": " << lines << " lines in " << seconds << " s, " <<
+           static_cast<long>(lines / seconds) << " lines/s, last: " << last << endl;
+}
+
+int main(int argc, char* argv[])
+{
+   int iterations = (argc > 1)? atoi(argv[1]): 100000;
+   string program = BenchmarkProgram(iterations);
+   try{
+      Benchmark<double>("double", program);
+      Benchmark<float>("float ", program);
+      Benchmark<gsharp::Fixed>("Fixed ", program);
+   }
+   catch(exception& e){
+      cout << "Interpreter error: " << e.what() << endl;
+      return 1;
+   }
+   return 0;
+}
@@ -1,3 +1,6 @@
+#include <stdexcept>
+#include <clocale>
+#include <iostream>
 #include "gsharp_test.h"
 #include "../src/gsharp_program.h"
 #include "../src/gsharp_except.h"
@@ -78,6 +81,22 @@ TEST_F(GSharpTest, ParseExpression)
       EXPECT_STREQ("Y2", r._ParseLine("Y[ ROU N(com (ment) ) D (co) [2. 37() 4571]] ").c_str());
       // plus and minus signs
       EXPECT_STREQ("Z-3", r._ParseLine("z [-1*+3]").c_str());
+      EXPECT_STREQ("", r._ParseLine("#2=3").c_str());
+      EXPECT_STREQ("Z-6", r._ParseLine("z [2*-#2]").c_str());
+      EXPECT_STREQ("Z1", r._ParseLine("z [--[1]]").c_str());
+      // the sign of any operand: parameter, expression in brackets, function (see "gsharp.h")
+      EXPECT_STREQ("Z-3", r._ParseLine("z [-#2]").c_str());
+      EXPECT_STREQ("Z3", r._ParseLine("z [+#2]").c_str());
+      EXPECT_STREQ("Z-4", r._ParseLine("z [-[#2 + 1]]").c_str());
+      EXPECT_STREQ("Z-0.5", r._ParseLine("z [-sin[30]]").c_str());
+      EXPECT_STREQ("Z-45", r._ParseLine("z [-atan[1]/[1]]").c_str());
+      EXPECT_STREQ("Z5", r._ParseLine("z [2 - -#2]").c_str());
+      EXPECT_STREQ("Z9", r._ParseLine("z [-#2 ** 2]").c_str()) << "The sign belongs to the operand, as in [-2 ** 2]";
+      // operators precedence and left-to-right processing
+      EXPECT_STREQ("X7", r._ParseLine("x [1 + 2 * 3]").c_str());
+      EXPECT_STREQ("X64", r._ParseLine("x [2 ** 3 ** 2]").c_str());
+      EXPECT_STREQ("X4", r._ParseLine("x [-2 ** 2]").c_str());
+      EXPECT_STREQ("X1", r._ParseLine("x [1 + 1 eq 2 and 3 gt 2]").c_str());
       // parameter assignment
       EXPECT_STREQ("X0", r._ParseLine("#1=.8 x#1").c_str());
       EXPECT_STREQ("X0.8", r._ParseLine("#1=[#1+1] x#1").c_str());
@@ -88,6 +107,8 @@ TEST_F(GSharpTest, ParseExpression)
       // upper-case output
       r.EnableConvertToUpper(false); // disable
       EXPECT_STREQ("g21g1x3f20", r._ParseLine("n0010 g21 g1 x3 f20").c_str());
+      r.EnablePrettyFormat();
+      EXPECT_STREQ("g21 g1 x3 f20", r._ParseLine("n0010 g21 g1 x3 f20").c_str());
       r.EnableConvertToUpper();
       r.EnablePrettyFormat();
 
@@ -148,7 +169,261 @@ TEST_F(GSharpTest, ParseExpression)
       FAIL() << "Due to exception: " << err.what();
    }
 
+   // the sign without the operand
+   Program e;
+   e.DebugLevel(0);
+   EXPECT_THROW(e._ParseLine("z [-]"), ErrorMsg);
+   EXPECT_THROW(e._ParseLine("z [2 * -]"), ErrorMsg);
+   EXPECT_THROW(e._ParseLine("z [-sin]"), ErrorMsg);
+
 //TODO: test failure cases to catch the expected exceptions (line number? exact phrase?)
 }
 
+
+TEST_F(GSharpTest, ParseParameters)
+{
+   Program r;
+   string str;
+   ExtraInfo extra;
+
+   EXPECT_EQ(0U, r._params.Pages()) << "Nothing is written yet";
+   try{
+      r.SetParam(100, 1.5);
+      r.Load("#101 = [#100 * 2] #5221 = 3\n#5650 = #101\nx#5650 y#3000\no1 sub\no1 endsub [7]\no1 call\n");
+      EXPECT_TRUE(r.Step(str, extra));
+      EXPECT_STREQ("X3 Y0", str.c_str()) << "The parameters which are not written are zero";
+      EXPECT_FALSE(r.Step(str, extra));
+      EXPECT_EQ(7, r.GetParam(5000));
+      EXPECT_EQ(4U, r._params.Pages()) << "#100-#101, #5000, #5221, #5650";
+
+      Program copy(r);
+      r.Clear();
+      EXPECT_EQ(0, r.GetParam(101));
+      EXPECT_EQ(0, r.GetParam(5221));
+      EXPECT_EQ(4U, r._params.Pages()) << "The memory is kept";
+      EXPECT_EQ(3, copy.GetParam(101));
+      EXPECT_EQ(3, copy.GetParam(5221));
+
+      r.SetParam(5221, 2);
+      Program second(r);
+      EXPECT_EQ(0, second.GetParam(101));
+      EXPECT_EQ(2, second.GetParam(5221));
+      EXPECT_EQ(1U, second._params.Pages()) << "Only the written pages are copied";
+   }
+   catch(ErrorMsg& err){
+      FAIL() << "Due to exception: " << err.what();
+   }
+}
+
+
+// runs the program with the parameters and the expressions in <Number>, returns all lines
+template<class Number>
+string GSharpTest_RunNumeric(const string& code)
+{
+   BasicProgram<Number> r;
+   r.Load(code);
+   string line, output;
+   ExtraInfo extra;
+   while(r.Step(line, extra))
+      output += line + "\n";
+   return output;
+}
+
+TEST_F(GSharpTest, NumericTypes)
+{
+   // same semantics for all types: degrees, fmod, pow, the tolerance of EQ/NE
+   const string code =
+      "x sin[30] y cos[60] z tan[45]\n"
+      "x atan[1]/[1] y asin[0.5] z acos[0.5]\n"
+      "x atan[-1]/[-1] y atan[1]/[-1] z atan[0]/[-1]\n"
+      "x [7 mod -3] y [-7 mod 3] z [7.5 mod 2]\n"
+      "x [2 ** 10] y [-2 ** 3] z [4 ** 0.5]\n"
+      "x [0.1 + 0.2 eq 0.3] y [1 ne 1.00005] z [1 ne 1.0002]\n"
+      "x round[-2.5] y fix[-2.5] z fup[-2.5]\n"
+      "x exp[1] y ln[100] z sqrt[2]\n"
+      "x [1/3] y [-2/3] z [1/0]\n"
+      "#1=0.375\n"
+      "x#1 #1=[#1 * 8]\n"
+      "#[#1]=[#1 + 0.5]\n"
+      "x#1 y#3\n";
+   const string expected =
+      "X0.5 Y0.5 Z1\n"
+      "X45 Y30 Z60\n"
+      "X-135 Y135 Z180\n"
+      "X1 Y-1 Z1.5\n"
+      "X1024 Y-8 Z2\n"
+      "X1 Y0 Z1\n"
+      "X-3 Y-3 Z-2\n"
+      "X2.718 Y4.605 Z1.414\n"
+      "X0.333 Y-0.667 ZINF\n"
+      "X0.375\n"
+      "X3 Y3.5\n";
+
+   try{
+      EXPECT_EQ(expected, GSharpTest_RunNumeric<double>(code));
+      EXPECT_EQ(expected, GSharpTest_RunNumeric<float>(code));
+      EXPECT_EQ(expected, GSharpTest_RunNumeric<Fixed>(code));
+   }
+   catch(ErrorMsg& err){
+      FAIL() << "Due to exception: " << err.what();
+   }
+
+   // fixed point: saturation instead of infinity, exact decimal output
+   EXPECT_EQ(Fixed::MAX_RAW, (Fixed(1) / Fixed()).Raw());
+   EXPECT_EQ(-Fixed::MAX_RAW, (Fixed(-65536) * Fixed(65536)).Raw());
+   EXPECT_TRUE((Fixed() / Fixed()).IsNan());
+   EXPECT_TRUE(Numeric<Fixed>::Pow(Fixed(-8), Fixed(1.0 / 3)).IsNan());
+   char buf[64];
+   Numeric<Fixed>::Print(Fixed::FromRaw(1), 12, buf, sizeof(buf));
+   EXPECT_STREQ("0.000000000233", buf);
+   char* end;
+   EXPECT_EQ(Fixed(0.375).Raw(), Numeric<Fixed>::Parse("0.375X", &end).Raw());
+   EXPECT_EQ('X', *end);
+}
+
+
+TEST_F(GSharpTest, CommaLocale)
+{
+   // the numbers of G-code have the decimal point '.', whatever LC_NUMERIC of the process is
+   const char* names[] = {"de_DE.UTF-8", "de_DE.utf8", "de_DE", "fr_FR.UTF-8", "ru_RU.UTF-8", "German_Germany.1252"};
+   string saved = setlocale(LC_NUMERIC, nullptr);
+   const char* name = nullptr;
+   for(const char* n: names){
+      if(setlocale(LC_NUMERIC, n) != nullptr && localeconv()->decimal_point[0] == ','){
+         name = n;
+         break;
+      }
+   }
+   if(name == nullptr){
+      setlocale(LC_NUMERIC, saved.c_str());
+      cout << "No comma-decimal locale to test" << endl;
+      return;
+   }
+
+   const string code =
+      "#1 = 1.5\n"
+      "g1 x#1 y[#1 / 4] z[-.25 * 3] f[150.5]\n"
+      "#2 = [#1 * 2.25] (the values to assign are read back from the output)\n"
+      "x#2 y2.5\n";
+   const string expected =
+      "G1 X1.5 Y0.375 Z-0.75 F150.5\n"
+      "X3.375 Y2.5\n";
+   try{
+      EXPECT_EQ(expected, GSharpTest_RunNumeric<double>(code)) << "Locale " << name;
+      EXPECT_EQ(expected, GSharpTest_RunNumeric<float>(code)) << "Locale " << name;
+      EXPECT_EQ(expected, GSharpTest_RunNumeric<Fixed>(code)) << "Locale " << name;
+
+      Program r;
+      r.Load("g1 x1.25 y-0.5\nx2\nm2\n");
+      EXPECT_TRUE(r.SeekToOutputLine(2)); // the modal state after the first line
+      EXPECT_EQ(1.25, r.GetModalState().position[ModalState::X]);
+      EXPECT_EQ(-0.5, r.GetModalState().position[ModalState::Y]);
+   }
+   catch(ErrorMsg& err){
+      setlocale(LC_NUMERIC, saved.c_str());
+      FAIL() << "Due to exception: " << err.what();
+   }
+
+   char buf[32];
+   EXPECT_EQ(8, PrintDecimal(-12.3456, 4, buf, sizeof(buf)));
+   EXPECT_STREQ("-12.3456", buf);
+   char* end;
+   EXPECT_EQ(0.125, ParseDecimal("0.125X", &end, strtod));
+   EXPECT_EQ('X', *end);
+   EXPECT_EQ(7.0, ParseDecimal("7,5", &end, strtod));
+   EXPECT_EQ(',', *end);
+   setlocale(LC_NUMERIC, saved.c_str());
+}
+
+
+TEST_F(GSharpTest, NativeFunctions)
+{
+   Program r;
+   string str;
+   ExtraInfo extra;
+   int calls = 0;
+
+   try{
+      r.RegisterFunction("Mix", 3, [&](const double* a){++calls; return a[0] + (a[1] - a[0]) * a[2];});
+      r.RegisterFunction("inv", 1, [](const double* a){ // involute of the angle in degrees
+         if(a[0] < 0)
+            throw std::domain_error("negative angle");
+         double rad = a[0] * atan(1.0) / 45.0;
+         return tan(rad) - rad;
+      });
+      r.Load(
+         "#1 = 0.25\n"
+         "g1 xMIX[0][10][#1] y[mix [2] [4] [0.5] * 2]\n" // the name is case-insensitive, the constant call is folded
+         "x[inv[20] * 1000] y abs[mix[-4][-2][#1]]\n"
+         "x inv[-1]\n");
+      EXPECT_EQ(1, calls) << "Calculated at load time";
+      EXPECT_TRUE(r.Step(str, extra));
+      EXPECT_STREQ("G1 X2.5 Y6", str.c_str());
+      EXPECT_EQ(2, calls);
+      EXPECT_TRUE(r.Step(str, extra));
+      EXPECT_STREQ("X14.904 Y3.5", str.c_str());
+      EXPECT_THROW(r.Step(str, extra), ErrorMsg) << "Exception of the function is reported for the line";
+   }
+   catch(ErrorMsg& err){
+      FAIL() << "Due to exception: " << err.what();
+   }
+
+   EXPECT_THROW(r.Load("x mix[1][2]\nm2\n"); r.Step(str, extra), ErrorMsg) << "Not enough arguments";
+   EXPECT_THROW(r.RegisterFunction("sin", 1, [](const double* a){return a[0];}), ErrorMsg) << "Built-in";
+   EXPECT_THROW(r.RegisterFunction("table", 1, [](const double* a){return a[0];}), ErrorMsg) << "Keyword 'le'";
+   EXPECT_THROW(r.RegisterFunction("f2", 1, [](const double* a){return a[0];}), ErrorMsg) << "Letters only";
+   EXPECT_THROW(r.RegisterFunction("mix", 0, [](const double* a){return a[0];}), ErrorMsg) << "No arguments";
+}
+
+
+TEST_F(GSharpTest, HostExpressions)
+{
+   Program r;
+   Program::CompiledExpression rpm, chip, index;
+
+   try{
+      r.RegisterFunction("clamp", 3, [](const double* a){return (a[0] < a[1])? a[1]: (a[0] > a[2])? a[2]: a[0];});
+      r.CompileExpression("clamp[#100 * 1000 / [3.1416 * #101]] [100] [24000]", rpm);
+      r.CompileExpression("[#3 * [2 + 2] * #1]", chip); // outer brackets are optional
+      r.CompileExpression("##2 + #[1 + 1] mod 3", index);
+      EXPECT_EQ(7U, chip.operations.size()) << "[2 + 2] is folded";
+
+      r.SetParam(100, 150);
+      r.SetParam(101, 10);
+      EXPECT_NEAR(4774.637, r.Evaluate(rpm), 0.001);
+      r.SetParam(101, 1);
+      EXPECT_EQ(24000, r.Evaluate(rpm));
+
+      r.Load("#1 = 0.05 #2 = 3 #3 = 4\nm2\n"); // stays valid for the next program
+      string str;
+      ExtraInfo extra;
+      EXPECT_TRUE(r.Step(str, extra));
+      EXPECT_NEAR(0.8, r.Evaluate(chip), 1e-9);
+      EXPECT_EQ(4, r.Evaluate(index)) << "#3 + [#2 mod 3]";
+
+      const unsigned int numbers[] = {1, 3};
+      const double values[] = {0.1, 2,  0.2, 3,  0.0, 1};
+      double results[3];
+      r.Evaluate(chip, numbers, 2, values, 3, results);
+      EXPECT_NEAR(0.8, results[0], 1e-9);
+      EXPECT_NEAR(2.4, results[1], 1e-9);
+      EXPECT_EQ(0, results[2]);
+      EXPECT_EQ(0.05, r.GetParam(1)) << "Restored";
+      EXPECT_EQ(4, r.GetParam(3));
+
+      const unsigned int wrong[] = {2};
+      const double refs[] = {6000};
+      EXPECT_THROW(r.Evaluate(index, wrong, 1, refs, 1, results), ErrorMsg) << "#6000 doesn't exist";
+      EXPECT_EQ(3, r.GetParam(2)) << "Restored after the error";
+   }
+   catch(ErrorMsg& err){
+      FAIL() << "Due to exception: " << err.what();
+   }
+
+   EXPECT_THROW(r.CompileExpression("#1 +", rpm), ErrorMsg);
+   EXPECT_THROW(r.CompileExpression("[#1] #2", rpm), ErrorMsg);
+   EXPECT_THROW(r.CompileExpression("#<_feed> * 2", rpm), ErrorMsg) << "Named parameters";
+   EXPECT_EQ(24000, r.Evaluate(rpm)) << "Not changed by the errors";
+}
+
 } // namespace
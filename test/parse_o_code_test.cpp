@@ -298,12 +298,660 @@ TEST_F(GSharpTest, ParseOCode)
       EXPECT_FALSE(extra.FirstNonEmpty());
 
       EXPECT_FALSE(r.Step(str, extra));
+
+      // output format can be changed after the program is loaded
+      r.Rewind();
+      r.EnablePrettyFormat(false);
+      r.EnableConvertToUpper(false);
+      EXPECT_TRUE(r.Step(str, extra));
+      EXPECT_TRUE(r.Step(str, extra));
+      EXPECT_STREQ(str.c_str(), "g0x0y0z0");
+      r.EnableConvertToUpper();
+      r.EnablePrettyFormat();
    }
    catch(ErrorMsg& err){
       FAIL() << "Due to exception: " << err.what();
    }
    file.close();
 
+
+////////////  long if-elseif chain  ////////////
+   const char* chain =
+      "o1 sub\n"
+      "o2 if [#1 eq 1]\n"
+      "  x1\n"
+      "o2 elseif [#1 eq 2]\n"
+      "  x2\n"
+      "o2 elseif [3 eq #1]\n"
+      "  x3\n"
+      "o2 elseif [#1 eq 4]\n"
+      "  x4\n"
+      "o2 elseif [#1 eq 2] (never reached)\n"
+      "  x5\n"
+      "o2 else\n"
+      "  x0\n"
+      "o2 endif\n"
+      "o1 endsub\n"
+      "o1 call [2]\n"
+      "o1 call [3.00001]\n"
+      "o1 call [4.1]\n"
+      "o1 call [1]\n";
+   try{
+      r.Load(chain);
+      EXPECT_TRUE(r.Step(str, extra));
+      EXPECT_STREQ(str.c_str(), "X2");
+      EXPECT_TRUE(r.Step(str, extra));
+      EXPECT_STREQ(str.c_str(), "X3");
+      EXPECT_TRUE(r.Step(str, extra));
+      EXPECT_STREQ(str.c_str(), "X0");
+      EXPECT_TRUE(r.Step(str, extra));
+      EXPECT_STREQ(str.c_str(), "X1");
+      EXPECT_FALSE(r.Step(str, extra));
+   }
+   catch(ErrorMsg& err){
+      FAIL() << "Due to exception: " << err.what();
+   }
+
+
+////////////  loop-invariant values  ////////////
+   const char* loop =
+      "#1 = 0\n"
+      "o1 while [#1 lt 3]\n"
+      "  x[#100 * 2 + 1] y[25.4 * 3 / 2]\n"
+      "  #1 = [#1 + 1]\n"
+      "o1 endwhile\n";
+   try{
+      r.Load(loop);
+      r.SetParam(100, 1);
+      EXPECT_TRUE(r.Step(str, extra));
+      EXPECT_STREQ(str.c_str(), "X3 Y38.1");
+      EXPECT_TRUE(r.Step(str, extra));
+      EXPECT_STREQ(str.c_str(), "X3 Y38.1");
+      r.SetParam(100, 2); // changed outside of the loop
+      EXPECT_TRUE(r.Step(str, extra));
+      EXPECT_STREQ(str.c_str(), "X5 Y38.1");
+      EXPECT_FALSE(r.Step(str, extra));
+   }
+   catch(ErrorMsg& err){
+      FAIL() << "Due to exception: " << err.what();
+   }
+
+
+////////////  inlined subs  ////////////
+   const char* calls =
+      "o1 sub\n"
+      "  #2 = [#1 * 2]\n"
+      "  x#1 y#2 (print,sub #1)\n"
+      "o1 endsub [#2 + 1]\n"
+      "#1 = 5 #2 = 6\n"
+      "o1 call [3]\n"
+      "x#1 y#2 z#5000\n";
+   for(int inline_subs = 0; inline_subs < 2; ++inline_subs){
+      try{
+         r.EnableInlineSubs(inline_subs != 0);
+         r.Load(calls);
+         EXPECT_TRUE(r.Step(str, extra));
+         EXPECT_STREQ(str.c_str(), "X3 Y6");
+         EXPECT_STREQ(extra.Retrieve(ExtraInfo::PRN), "sub 3");
+         EXPECT_TRUE(r.Step(str, extra));
+         EXPECT_STREQ(str.c_str(), "X5 Y6 Z7"); // local parameters are restored
+         EXPECT_FALSE(r.Step(str, extra));
+      }
+      catch(ErrorMsg& err){
+         FAIL() << "Due to exception: " << err.what();
+      }
+   }
+
+
+////////////  stack depth  ////////////
+   const char* recursion =
+      "o1 sub\n"
+      "  o2 if [#1 gt 0]\n"
+      "    o1 call [#1 - 1]\n"
+      "  o2 endif\n"
+      "o1 endsub\n"
+      "o1 call [#100]\n"
+      "x1\n";
+   try{
+      r.Load(recursion);
+      r.SetStackDepth(10);
+      r.SetParam(100, 9);
+      EXPECT_TRUE(r.Step(str, extra));
+      EXPECT_STREQ(str.c_str(), "X1");
+      r.Rewind();
+      r.SetParam(100, 10);
+      EXPECT_THROW(r.Step(str, extra), ErrorMsg);
+      r.Rewind();
+      r.SetStackDepth(Program::DEFAULT_STACK_LEVELS);
+   }
+   catch(ErrorMsg& err){
+      FAIL() << "Due to exception: " << err.what();
+   }
+
+
+////////////  replayed repeat  ////////////
+   const char* repeat =
+      "o1 repeat [3]\n"
+      "  x#100\n"
+      "  y2\n"
+      "o1 endrepeat\n"
+      "o2 repeat [2]\n" // recorded straight after the replay
+      "  z3\n"
+      "o2 endrepeat\n";
+   try{
+      r.Load(repeat);
+      r.SetParam(100, 1);
+      for(int i = 0; i < 2; ++i){
+         EXPECT_TRUE(r.Step(str, extra));
+         EXPECT_STREQ(str.c_str(), "X1");
+         EXPECT_EQ(r.GetCurrentLineNumber(), 2U);
+         EXPECT_TRUE(r.Step(str, extra));
+         EXPECT_STREQ(str.c_str(), "Y2");
+         EXPECT_EQ(r.GetCurrentLineNumber(), 3U);
+      }
+      r.SetParam(100, 4); // invalidates the recorded output
+      EXPECT_TRUE(r.Step(str, extra));
+      EXPECT_STREQ(str.c_str(), "X4");
+      EXPECT_TRUE(r.Step(str, extra));
+      EXPECT_STREQ(str.c_str(), "Y2");
+      for(int i = 0; i < 2; ++i){
+         EXPECT_TRUE(r.Step(str, extra));
+         EXPECT_STREQ(str.c_str(), "Z3");
+      }
+      EXPECT_FALSE(r.Step(str, extra));
+   }
+   catch(ErrorMsg& err){
+      FAIL() << "Due to exception: " << err.what();
+   }
+
+
+////////////  remembered sub calls  ////////////
+   const char* pure =
+      "o1 sub\n"
+      "  #2 = [#1 * 2]\n"
+      "  x#1 (print,sub #1)\n"
+      "  y#2\n"
+      "o1 endsub [#2]\n"
+      "o1 call [3]\n"
+      "o1 call [3]\n"
+      "z#5000\n";
+   for(size_t cache_size = 0; cache_size < 2; ++cache_size){
+      try{
+         r.EnableInlineSubs(false);
+         r.SetSubCacheSize(cache_size);
+         r.Load(pure);
+         for(int i = 0; i < 2; ++i){
+            EXPECT_TRUE(r.Step(str, extra));
+            EXPECT_STREQ(str.c_str(), "X3");
+            EXPECT_STREQ(extra.Retrieve(ExtraInfo::PRN), "sub 3");
+            EXPECT_EQ(r.GetCurrentLineNumber(), 3U);
+            EXPECT_TRUE(r.Step(str, extra));
+            EXPECT_STREQ(str.c_str(), "Y6");
+         }
+         EXPECT_TRUE(r.Step(str, extra));
+         EXPECT_STREQ(str.c_str(), "Z6");
+         EXPECT_EQ(r.GetParam(2), 0.0); // local parameters are restored
+         EXPECT_FALSE(r.Step(str, extra));
+      }
+      catch(ErrorMsg& err){
+         FAIL() << "Due to exception: " << err.what();
+      }
+   }
+   // the messages of the 'call' line come before the call, they are not the part of it
+   string called(pure);
+   for(size_t pos = called.find("o1 call [3]\n"); pos != string::npos; pos = called.find("o1 call [3]\n", pos + 1))
+      called.replace(pos, 12, "o1 call [3] (msg,calling)\n");
+   for(size_t cache_size = 0; cache_size < 2; ++cache_size){
+      try{
+         r.EnableInlineSubs(false);
+         r.SetSubCacheSize(cache_size);
+         r.Load(called);
+         for(LineNumber call_line = 6; call_line < 8; ++call_line){
+            EXPECT_TRUE(r.Step(str, extra));
+            EXPECT_STREQ(str.c_str(), "");
+            EXPECT_STREQ(extra.Retrieve(ExtraInfo::MSG), "calling");
+            EXPECT_EQ(r.GetCurrentLineNumber(), call_line);
+            EXPECT_TRUE(r.Step(str, extra));
+            EXPECT_STREQ(str.c_str(), "X3") << "Cache size " << cache_size << ", call in line " << call_line;
+            EXPECT_EQ(extra.Retrieve(ExtraInfo::MSG), nullptr);
+            EXPECT_TRUE(r.Step(str, extra));
+            EXPECT_STREQ(str.c_str(), "Y6");
+         }
+         EXPECT_TRUE(r.Step(str, extra));
+         EXPECT_STREQ(str.c_str(), "Z6");
+         EXPECT_FALSE(r.Step(str, extra));
+      }
+      catch(ErrorMsg& err){
+         FAIL() << "Due to exception: " << err.what();
+      }
+   }
+   r.EnableInlineSubs(true);
+   r.SetSubCacheSize(Program::DEFAULT_SUB_CACHE_SIZE);
+
+
+////////////  named parameters  ////////////
+   string named =
+      "#<x> = 2 #<_Global> = 10\n"
+      "o1 sub\n"
+      "  o2 if [EXISTS[#<x>]]\n"
+      "    (print,caller's x is visible)\n"
+      "  o2 endif\n"
+      "  #<x> = [#1 + #<_global>]\n"
+      "  x#<x> (debug,sub x #< x >)\n"
+      "  o3 if [#1 lt 2]\n"
+      "    o1 call [#1 + 1]\n"
+      "    y#<x> (the value of this call is restored)\n"
+      "  o3 endif\n"
+      "  #<_global> = [#<_global> + 1]\n"
+      "o1 endsub [#<x> * 2]\n"
+      "o1 call [1]\n"
+      "z#<_value> a#<_value_returned> b#<x> c#<_global>\n"
+      "#<y> = 3 #[#<y>] = 5 (indirect, #3 = 5)\n"
+      "a##<y> b[exists[#<y>] + exists[#<z>]]\n"
+      "o4 sub\n"
+      "o4 endsub\n"
+      "o4 call\n"
+      "a#<_value_returned>\n"
+      "b#<z>\n";
+   try{
+      r.Load(named);
+      EXPECT_TRUE(r.Step(str, extra));
+      EXPECT_STREQ(str.c_str(), "X11");
+      EXPECT_FALSE(extra.Retrieve(ExtraInfo::PRN)) << "The sub doesn't see the local parameters of the caller";
+      EXPECT_STREQ(extra.Retrieve(ExtraInfo::DBG), "sub x 11");
+      EXPECT_TRUE(r.Step(str, extra));
+      EXPECT_STREQ(str.c_str(), "X12");
+      EXPECT_STREQ(extra.Retrieve(ExtraInfo::DBG), "sub x 12");
+      EXPECT_TRUE(r.Step(str, extra));
+      EXPECT_STREQ(str.c_str(), "Y11");
+      EXPECT_TRUE(r.Step(str, extra));
+      EXPECT_STREQ(str.c_str(), "Z22 A1 B2 C12");
+      EXPECT_TRUE(r.Step(str, extra));
+      EXPECT_STREQ(str.c_str(), "A5 B1");
+      EXPECT_TRUE(r.Step(str, extra));
+      EXPECT_STREQ(str.c_str(), "A0");
+      EXPECT_THROW(r.Step(str, extra), ErrorMsg) << "#<z> is not defined";
+
+      // the global ones are kept for the next program
+      r.Load("x#<_global> y[exists[#<x>]]\n");
+      EXPECT_TRUE(r.Step(str, extra));
+      EXPECT_STREQ(str.c_str(), "X12 Y0");
+      r.Clear();
+      r.Rewind();
+      EXPECT_THROW(r.Step(str, extra), ErrorMsg) << "#<_global> is cleared";
+   }
+   catch(ErrorMsg& err){
+      FAIL() << "Due to exception: " << err.what();
+   }
+
+////////////  subs of the host  ////////////
+   // trochoidal slot: <passes> loops along X, each one is a full circle of <radius>
+   r.RegisterSub(500, [](NativeCall<double>& call){
+      double radius = call.Argument(0);
+      int passes = static_cast<int>(call.Argument(1));
+      call.Message(ExtraInfo::MSG, "slot");
+      for(int i = 0; i < passes; ++i){
+         call.Output("g2 x" + to_string(i) + " i" + to_string(static_cast<int>(radius)));
+         call.SetParam(100, call.GetParam(100) + 1);
+      }
+      call.SetParam(1, 99); // local to the call
+      call.Message(ExtraInfo::PRN, "done");
+      call.Return(passes * 2);
+   });
+   const string host =
+      "#1 = 7\n"
+      "o500 sub (replaced by the host)\n"
+      "  x#1\n"
+      "o500 endsub\n"
+      "o500 call [2] [3]\n"
+      "x#1 y#100 z#5000\n"
+      "o500 call [1] [0]\n";
+   try{
+      r.SetParam(100, 0);
+      r.Load(host);
+      EXPECT_TRUE(r.Step(str, extra));
+      EXPECT_STREQ(str.c_str(), "G2 X0 I2");
+      EXPECT_STREQ(extra.Retrieve(ExtraInfo::MSG), "slot");
+      EXPECT_EQ(r.GetCurrentLineNumber(), 5U);
+      EXPECT_TRUE(r.Step(str, extra));
+      EXPECT_STREQ(str.c_str(), "G2 X1 I2");
+      EXPECT_FALSE(extra.FirstNonEmpty());
+      EXPECT_TRUE(r.Step(str, extra));
+      EXPECT_STREQ(str.c_str(), "G2 X2 I2");
+      EXPECT_TRUE(r.Step(str, extra));
+      EXPECT_TRUE(str.empty()) << "String: " << str.c_str();
+      EXPECT_STREQ(extra.Retrieve(ExtraInfo::PRN), "done");
+      EXPECT_TRUE(r.Step(str, extra));
+      EXPECT_STREQ(str.c_str(), "X7 Y3 Z6");
+      EXPECT_TRUE(r.Step(str, extra));
+      EXPECT_TRUE(str.empty()) << "String: " << str.c_str(); // no lines: the messages come on their own
+      EXPECT_STREQ(extra.Retrieve(ExtraInfo::MSG), "slot");
+      EXPECT_STREQ(extra.Retrieve(ExtraInfo::PRN), "done");
+      EXPECT_FALSE(r.Step(str, extra));
+      r.Load("o600 call\n");
+      EXPECT_THROW(r.Step(str, extra), ErrorMsg) << "o600 is neither defined nor registered";
+
+      r.RegisterSub(500, [](NativeCall<double>&){throw std::runtime_error("tool is too big");});
+      r.Load(host);
+      EXPECT_THROW(r.Step(str, extra), ErrorMsg);
+      r.RegisterSub(500, Program::SubHandler());
+      r.Load(host);
+      EXPECT_TRUE(r.Step(str, extra));
+      EXPECT_STREQ(str.c_str(), "X2") << "The sub of the program";
+   }
+   catch(ErrorMsg& err){
+      FAIL() << "Due to exception: " << err.what();
+   }
+
+////////////  parallel run  ////////////
+   stringstream job;
+   job << "o1 sub\n  x#1 y#100\no1 endsub\n";
+   for(int i = 0; i < 5000; ++i){
+      job << "g1 x" << i << " y[#100 + " << i % 7 << "]\n";
+      if(i % 2000 == 1999)
+         job << "#100 = [#100 + 1] (print,#100)\no1 call [" << i << "]\n";
+   }
+   job << "m2\nx0\n";
+   try{
+      r.Load(job.str());
+      r.SetParam(100, 0);
+      vector<string> expected;
+      while(r.Step(str, extra)){
+         expected.push_back(str);
+         const char* print = extra.Retrieve(ExtraInfo::PRN);
+         if(print)
+            expected.back() += print;
+      }
+      r.Rewind();
+      r.SetParam(100, 0);
+      size_t i = 0;
+      r.Run([&](const string& line, ExtraInfo& messages){
+         const char* print = messages.Retrieve(ExtraInfo::PRN);
+         ASSERT_LT(i, expected.size());
+         EXPECT_EQ(line + (print? print: ""), expected[i++]);
+      }, 3);
+      EXPECT_EQ(i, expected.size());
+      EXPECT_EQ(r.GetParam(100), 2.0);
+      EXPECT_EQ(r.GetCurrentLineNumber(), 5008U); // m2
+   }
+   catch(ErrorMsg& err){
+      FAIL() << "Due to exception: " << err.what();
+   }
+   // the assignments after m2 or after the error are not executed by the parallel run either
+   for(string stop: {"m2\n", "x[1 +* 2]\n"}){
+      string program = "#101 = 1\no1 if [1]\n  #101 = 2\no1 endif\nx1\n" + stop + "#101 = 3\nx2\n";
+      vector<string> expected, lines;
+      bool thrown = false;
+      r.Load(program);
+      try{
+         while(r.Step(str, extra))
+            expected.push_back(str);
+      }
+      catch(ErrorMsg& err){
+         thrown = true;
+      }
+      EXPECT_EQ(2.0, r.GetParam(101)) << "Step() stopped at " << stop;
+      LineNumber last_line = r.GetCurrentLineNumber();
+      r.Rewind();
+      if(thrown)
+         EXPECT_THROW(r.Run([&](const string& line, ExtraInfo&){lines.push_back(line);}, 4), ErrorMsg);
+      else
+         r.Run([&](const string& line, ExtraInfo&){lines.push_back(line);}, 4);
+      EXPECT_EQ(expected, lines) << "Run() stopped at " << stop;
+      EXPECT_EQ(2.0, r.GetParam(101)) << "Run() stopped at " << stop;
+      EXPECT_EQ(last_line, r.GetCurrentLineNumber());
+   }
+
+////////////  checkpoints  ////////////
+   const string retry =
+      "#<_feed> = 100\n"
+      "o1 sub (pure and long: the calls are remembered)\n"
+      "  g1 x#1 (msg,in sub)\n"
+      "  g1 y[#1 * 2]\n"
+      "  #2 = [#1 + 1]\n"
+      "  g1 y#2\n"
+      "  g1 x0 y0\n"
+      "  g1 z#1\n"
+      "o1 endsub [#1]\n"
+      "o2 repeat [3] (steady: replayed)\n"
+      "  g0 z1\n"
+      "  g0 z2\n"
+      "o2 endrepeat\n"
+      "#1 = 0\n"
+      "o3 while [#1 lt 6]\n"
+      "  #1 = [#1 + 1]\n"
+      "  #200 = [#200 + #1]\n"
+      "  o1 call [[#1 mod 2]]\n"
+      "  x#200 f#<_feed> z#5000\n"
+      "  #<_feed> = [#<_feed> + 10]\n"
+      "o3 endwhile\n"
+      "o4 if [#200 gt 10]\n"
+      "  (print,done)\n"
+      "o4 endif\n"
+      "m2\n";
+   // the line with all its' messages
+   auto step = [&](string& result) -> bool{
+      bool more = r.Step(str, extra);
+      result = to_string(r.GetCurrentLineNumber()) + ":" + str;
+      ExtraInfo::Type type;
+      while(extra.FirstNonEmpty(&type))
+         result += "|" + to_string(type) + extra.Retrieve(type);
+      return more;
+   };
+   try{
+      vector<string> expected;
+      r.Clear();
+      r.Load(retry);
+      for(string result; step(result); )
+         expected.push_back(result);
+      ASSERT_GT(expected.size(), 30U);
+
+      for(size_t k=0; k<expected.size(); ++k){
+         r.Clear();
+         r.Load(retry);
+         string result;
+         for(size_t i=0; i<k; ++i)
+            step(result);
+         unsigned int cp = r.Checkpoint();
+         for(int pass=0; pass<2; ++pass){
+            for(size_t i=k; i<expected.size(); ++i){
+               EXPECT_TRUE(step(result));
+               EXPECT_EQ(expected[i], result) << "Step " << i << " after the checkpoint at step " << k;
+            }
+            EXPECT_FALSE(step(result));
+            EXPECT_EQ(21.0, r.GetParam(200));
+            r.SetParam(200, 999); // the checkpoint keeps its' own value
+            r.Restore(cp);
+         }
+         r.ReleaseCheckpoint(cp);
+      }
+      EXPECT_THROW(r.Restore(0), ErrorMsg) << "Released";
+      unsigned int cp = r.Checkpoint();
+      r.Load(retry);
+      EXPECT_THROW(r.Restore(cp), ErrorMsg) << "Released by the next program";
+   }
+   catch(ErrorMsg& err){
+      FAIL() << "Due to exception: " << err.what();
+   }
+
+////////////  seek  ////////////
+   try{
+      vector<string> expected;
+      vector<size_t> output; // steps with the lines
+      r.Clear();
+      r.Load(retry);
+      for(string result; step(result); ){
+         if(!str.empty())
+            output.push_back(expected.size());
+         expected.push_back(result);
+      }
+      // the steps after the seek are the same as the steps after the previous output line
+      for(size_t n=1; n<=output.size(); ++n){
+         r.Clear();
+         EXPECT_TRUE(r.SeekToOutputLine(n));
+         string result;
+         for(size_t i=(n > 1)? output[n-2] + 1: 0; i<expected.size(); ++i){
+            EXPECT_TRUE(step(result));
+            EXPECT_EQ(expected[i], result) << "Step " << i << " after the seek to output line " << n;
+         }
+         EXPECT_FALSE(step(result));
+         EXPECT_EQ(21.0, r.GetParam(200));
+      }
+      r.Clear();
+      EXPECT_FALSE(r.SeekToOutputLine(output.size() + 2));
+
+      // lines of the sub, of the replayed loop, of the while loop and the message
+      for(LineNumber line: {3, 6, 11, 12, 19, 23}){
+         string prefix = to_string(line) + ":";
+         for(unsigned int occurrence=1; ; ++occurrence){
+            size_t k = 0;
+            for(unsigned int found=0; k<expected.size(); ++k)
+               if(expected[k].compare(0, prefix.size(), prefix) == 0 && ++found == occurrence)
+                  break;
+            r.Clear();
+            bool found = r.SeekToSourceLine(line, occurrence);
+            EXPECT_EQ(k < expected.size(), found) << "Line " << line << ", occurrence " << occurrence;
+            if(!found)
+               break;
+            string result;
+            for(size_t i=k; i<expected.size(); ++i){
+               EXPECT_TRUE(step(result));
+               EXPECT_EQ(expected[i], result) << "Step " << i << " after the seek to line " << line;
+            }
+            EXPECT_EQ(21.0, r.GetParam(200));
+         }
+      }
+      EXPECT_THROW(r.SeekToSourceLine(100), ErrorMsg);
+
+      // the small sub is copied into the calling lines, the calls of the pure one are served from the cache
+      r.Load("o1 sub (inlined)\n"
+             "  g1 x#1\n"
+             "  y[#1 * 2]\n"
+             "o1 endsub\n"
+             "o2 sub (pure and long)\n"
+             "  g0 z#1\n"
+             "  g0 z[#1 + 1]\n"
+             "  g0 z[#1 + 2]\n"
+             "  g0 z[#1 + 3]\n"
+             "  g0 z[#1 + 4]\n"
+             "  g0 z[#1 + 5]\n"
+             "o2 endsub\n"
+             "#1 = 0\n"
+             "o3 while [#1 lt 4]\n"
+             "  #1 = [#1 + 1]\n"
+             "  o1 call [#1]\n"
+             "  o2 call [[#1 mod 2]]\n"
+             "o3 endwhile\n"
+             "m2\n");
+      expected.clear();
+      for(string result; step(result); )
+         expected.push_back(result);
+      for(LineNumber line: {2, 3, 6, 11}){
+         string prefix = to_string(line) + ":";
+         unsigned int occurrence = 1;
+         for(size_t k=0; k<expected.size(); ++k){
+            if(expected[k].compare(0, prefix.size(), prefix) != 0)
+               continue;
+            EXPECT_TRUE(r.SeekToSourceLine(line, occurrence)) << "Line " << line << ", occurrence " << occurrence;
+            string result;
+            for(size_t i=k; i<expected.size(); ++i){
+               EXPECT_TRUE(step(result));
+               EXPECT_EQ(expected[i], result) << "Step " << i << " after the seek to line " << line;
+            }
+            ++occurrence;
+         }
+         EXPECT_EQ(4U, occurrence - 1) << "Line " << line;
+         EXPECT_FALSE(r.SeekToSourceLine(line, occurrence));
+      }
+
+      // the modal state to restart the job
+      r.Load("g21 g17 g90 g54 (msg,start)\n"
+             "t2 m6\n"
+             "s[1000 * 2] m3 m8\n"
+             "g0 x1 y2 z[5]\n"
+             "g91 g1 x0.5 f200\n"
+             "#1 = 3\n"
+             "#2 = 7\n"
+             "x#1 i#1 j0\n"
+             "g90 m9 (print,max#2)\n"
+             "g28 z0\n"
+             "g2 x1 y1 i1 j0\n"
+             "m2\n");
+      EXPECT_TRUE(r.SeekToOutputLine(9)); // the messages are dropped
+      const ModalState& modal = r.GetModalState();
+      EXPECT_EQ("G21 G17 G90 G54 T2 S2000 M3 M9 F200 G1", modal.Preamble());
+      EXPECT_EQ(4.5, modal.position[ModalState::X]);
+      EXPECT_EQ(2.0, modal.position[ModalState::Y]);
+      EXPECT_EQ(5.0, modal.position[ModalState::Z]);
+      EXPECT_FALSE(modal.known[ModalState::A]);
+      EXPECT_TRUE(r.Step(str, extra));
+      EXPECT_EQ("G2 X1 Y1 I1 J0", str);
+
+      // the seek stops after the previous output line: the steps with only the messages come before the line
+      r.Load("g0 x1 (msg,first)\n"
+             "(msg,tool)\n"
+             "#1 = 2\n"
+             "(print,ready#1)\n"
+             "g0 x#1\n"
+             "m2\n");
+      EXPECT_TRUE(r.SeekToOutputLine(2));
+      EXPECT_TRUE(r.Step(str, extra));
+      EXPECT_EQ("", str);
+      EXPECT_STREQ("tool", extra.Retrieve(ExtraInfo::MSG)) << "Not the message of the line 1";
+      EXPECT_EQ(2U, r.GetCurrentLineNumber());
+      EXPECT_TRUE(r.Step(str, extra));
+      EXPECT_EQ("", str);
+      EXPECT_STREQ("ready2", extra.Retrieve(ExtraInfo::PRN));
+      EXPECT_TRUE(r.Step(str, extra));
+      EXPECT_EQ("G0 X2", str);
+   }
+   catch(ErrorMsg& err){
+      FAIL() << "Due to exception: " << err.what();
+   }
+
+////////////  step back  ////////////
+   try{
+      vector<string> expected;
+      r.Clear();
+      r.Load(retry);
+      for(string result; step(result); )
+         expected.push_back(result);
+      EXPECT_THROW(r.StepBack(1), ErrorMsg) << "The journal is disabled";
+
+      // the journal keeps all the steps, or only the last few (the rest runs again from the checkpoint)
+      for(size_t size: {size_t(1) << 20, size_t(512)}){
+         r.SetJournalSize(size);
+         for(size_t k=1; k<expected.size(); ++k){
+            for(size_t n: {size_t(1), size_t(2), size_t(7), k}){
+               if(n > k)
+                  continue;
+               r.Clear();
+               r.Load(retry);
+               string result;
+               for(size_t i=0; i<k; ++i)
+                  step(result);
+               r.StepBack(n);
+               for(size_t i=k-n; i<expected.size(); ++i){
+                  EXPECT_TRUE(step(result));
+                  EXPECT_EQ(expected[i], result) << "Step " << i << " after " << n << " steps back from step " << k;
+               }
+               EXPECT_FALSE(step(result));
+               EXPECT_EQ(21.0, r.GetParam(200));
+            }
+         }
+         r.Clear();
+         r.Load(retry);
+         string result;
+         for(size_t i=0; i<3; ++i)
+            step(result);
+         EXPECT_THROW(r.StepBack(4), ErrorMsg) << "Before the start";
+      }
+      r.SetJournalSize(0);
+   }
+   catch(ErrorMsg& err){
+      FAIL() << "Due to exception: " << err.what();
+   }
+
 //TODO: create ngc files with errors and catch the expected exceptions (line number? exact phrase?)
 }
 